@@ -0,0 +1,57 @@
+#ifndef LUABIND_BENCH_HPP
+#define LUABIND_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace luabind::bench {
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Runs aBody once and returns the elapsed wall time in seconds
+ */
+template <typename Body>
+double timeSeconds(Body &&aBody) {
+  auto start = Clock::now();
+  aBody();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * Runs aBody aIterations times and returns the mean time per iteration in nanoseconds
+ */
+template <typename Body>
+double nanosPerIteration(std::size_t aIterations, Body &&aBody) {
+  auto seconds = timeSeconds([&]() {
+    for (std::size_t i = 0; i < aIterations; ++i) {
+      aBody();
+    }
+  });
+  return seconds*1e9/static_cast<double>(aIterations);
+}
+
+/*
+ * Returns the aPercentile-th (0-100) percentile of aSamples, sorting them in place
+ */
+inline double percentile(std::vector<double> &aSamples, double aPercentile) {
+  if (aSamples.empty()) {
+    return 0;
+  }
+  std::sort(aSamples.begin(), aSamples.end());
+  auto idx = static_cast<std::size_t>(aPercentile/100.0*static_cast<double>(aSamples.size() - 1));
+  return aSamples[idx];
+}
+
+/*
+ * Keeps the optimizer from discarding a computed value
+ */
+template <typename T>
+void doNotOptimize(T const &aValue) {
+  asm volatile("" : : "r,m"(aValue) : "memory");
+}
+}
+
+#endif //LUABIND_BENCH_HPP
@@ -0,0 +1,60 @@
+#include "bench.hpp"
+#include "luabind/globals.hpp"
+
+#include <string>
+#include <vector>
+
+/*
+ * Keeping scripts in sync with tunables that C++ changes between calls: pushing every
+ * tunable into its global before each call, against binding each global to its variable
+ * once. The handler reads a few tunables per call, as a rule evaluation would.
+ */
+static constexpr int TUNABLES = 300;
+
+static const char *const HANDLER = R"(
+    function handle(x)
+        return x * tunable7 + tunable42 - tunable299
+    end
+)";
+
+int main() {
+  constexpr std::size_t calls = 20000;
+  std::vector<double> tunables(TUNABLES, 1.0);
+
+  luabind::Lua pushing;
+  pushing << HANDLER;
+  luabind::Lua bound;
+  for (int i = 0; i < TUNABLES; ++i) {
+    luabind::bindVariable(bound, "tunable" + std::to_string(i), &tunables[i]);
+  }
+  bound << HANDLER;
+
+  std::vector<std::string> names;
+  for (int i = 0; i < TUNABLES; ++i) {
+    names.push_back("tunable" + std::to_string(i));
+  }
+
+  double pushNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    tunables[7] += 1;
+    for (int i = 0; i < TUNABLES; ++i) {
+      pushing[names[i]] = tunables[i];
+    }
+    double result = pushing["handle"](2.0);
+    luabind::bench::doNotOptimize(result);
+  });
+  double boundNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    tunables[7] += 1;
+    double result = bound["handle"](2.0);
+    luabind::bench::doNotOptimize(result);
+  });
+  double plainNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    double result = pushing["handle"](2.0);
+    luabind::bench::doNotOptimize(result);
+  });
+
+  std::printf("%d tunables, 3 read per call\n", TUNABLES);
+  std::printf("%28s %10.0f ns/call\n", "push all, then call", pushNs);
+  std::printf("%28s %10.0f ns/call\n", "bound variables", boundNs);
+  std::printf("%28s %10.0f ns/call\n", "call only (stale values)", plainNs);
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <string>
+
+/*
+ * Rendering a payload of about 2 MB (100000 rows of an id, a price with two decimals and a
+ * name) and getting it into a std::string: pieces collected in a table, joined with
+ * table.concat and copied out; and appended to a ByteBuffer and moved out.
+ */
+int main() {
+  constexpr std::size_t renders = 20;
+  luabind::Lua lua;
+  lua << R"(
+        rows = 100000
+        function render_concat()
+          local parts = {}
+          for i = 1, rows do
+            parts[#parts + 1] = i .. "," .. string.format("%.2f", i * 0.37) .. ",item-" .. i .. "\n"
+          end
+          return table.concat(parts)
+        end
+        function render_buffer(out)
+          out:reserve(rows * 24)
+          for i = 1, rows do
+            out:append(i, ","):append_number(i * 0.37, 2):append(",item-", i, "\n")
+          end
+        end
+    )";
+
+  std::size_t size = 0;
+  double concatMs = luabind::bench::timeSeconds([&]() {
+    for (std::size_t i = 0; i < renders; ++i) {
+      auto payload = lua["render_concat"]().as<std::string>();
+      size = payload.size();
+      luabind::bench::doNotOptimize(payload);
+    }
+  })*1e3/renders;
+  double bufferMs = luabind::bench::timeSeconds([&]() {
+    for (std::size_t i = 0; i < renders; ++i) {
+      luabind::ByteBuffer out;
+      lua["render_buffer"](out);
+      auto payload = out.take();
+      size = payload.size();
+      luabind::bench::doNotOptimize(payload);
+    }
+  })*1e3/renders;
+
+  std::printf("payload of %zu bytes\n", size);
+  std::printf("%28s %8.1f ms/render\n", "table.concat + copy", concatMs);
+  std::printf("%28s %8.1f ms/render\n", "ByteBuffer + take", bufferMs);
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include "bench.hpp"
+#include "luabind/channel.hpp"
+
+#include <thread>
+#include <vector>
+
+/*
+ * Messages per second through one Channel with N producer and N consumer states, each
+ * on its own thread, for scalar messages and for small tables. Thread counts go up to
+ * twice the hardware concurrency, so the last rows show oversubscription.
+ */
+static double run(std::size_t aPairs, std::size_t aMessages, const char *aMessage) {
+  luabind::Channel channel(1024);
+  std::size_t perProducer = aMessages/aPairs;
+  return luabind::bench::timeSeconds([&]() {
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+    for (std::size_t i = 0; i < aPairs; ++i) {
+      producers.emplace_back([&]() {
+        luabind::Lua lua;
+        channel.installGlobal(lua, "ch");
+        lua["count"] = static_cast<double>(perProducer);
+        lua << std::string("for i = 1, count do ch:send(") + aMessage + ") end";
+      });
+      consumers.emplace_back([&]() {
+        luabind::Lua lua;
+        channel.installGlobal(lua, "ch");
+        lua << "local n = 0; for value in ch.recv, ch do n = n + 1 end";
+      });
+    }
+    for (auto &producer : producers) {
+      producer.join();
+    }
+    channel.close();
+    for (auto &consumer : consumers) {
+      consumer.join();
+    }
+  });
+}
+
+int main() {
+  constexpr std::size_t messages = 400000;
+  std::size_t maxPairs = std::max(1u, std::thread::hardware_concurrency());
+  std::printf("%zu messages, channel capacity 1024\n", messages);
+  std::printf("%18s %16s %16s\n", "producer/consumer", "ints (M msg/s)", "tables (M msg/s)");
+  for (std::size_t pairs = 1; pairs <= maxPairs*2; pairs *= 2) {
+    double ints = run(pairs, messages, "i");
+    double tables = run(pairs, messages, "{ id = i, name = 'job', tags = { 'a', 'b' } }");
+    std::printf("%15zu/%-2zu %16.2f %16.2f\n", pairs, pairs, messages/ints/1e6, messages/tables/1e6);
+  }
+  return 0;
+}
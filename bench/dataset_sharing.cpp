@@ -0,0 +1,70 @@
+#include "bench.hpp"
+#include "luabind/dataset.hpp"
+
+#include <cstdio>
+#include <vector>
+
+/*
+ * Memory and lookup cost of giving every state the same reference data: each state
+ * building its own tables against every state reading one shared Dataset. Memory is what
+ * each state's allocator reports (the shared dataset's bytes are counted once, separately).
+ */
+static const char *const BUILD_REFERENCE = R"(
+    reference = {}
+    for i = 1, 50000 do
+        reference[i] = { id = i, name = "item" .. i, score = i * 0.25, tags = { "a" .. (i % 10), "b" .. (i % 7) } }
+    end
+)";
+
+static const char *const LOOKUPS = R"(
+    function lookups(n)
+        local total = 0
+        for i = 1, n do
+            local item = reference[(i * 7919) % 50000 + 1]
+            total = total + item.score + #item.tags[2]
+        end
+        return total
+    end
+)";
+
+static double stateKilobytes(luabind::Lua &aLua) {
+  aLua.collectGarbage();
+  return lua_gc(aLua.state(), LUA_GCCOUNT, 0) + lua_gc(aLua.state(), LUA_GCCOUNTB, 0)/1024.0;
+}
+
+int main() {
+  constexpr int states = 8;
+  constexpr int lookups = 200000;
+
+  luabind::Lua builder;
+  builder << BUILD_REFERENCE;
+  auto dataset = luabind::Dataset::fromLua(builder, "reference");
+
+  std::vector<luabind::Lua> owning(states);
+  std::vector<luabind::Lua> sharing(states);
+  double owningKb = 0;
+  double sharingKb = 0;
+  for (int i = 0; i < states; ++i) {
+    owning[i] << BUILD_REFERENCE;
+    owning[i] << LOOKUPS;
+    owningKb += stateKilobytes(owning[i]);
+    dataset.installGlobal(sharing[i], "reference");
+    sharing[i] << LOOKUPS;
+    sharingKb += stateKilobytes(sharing[i]);
+  }
+
+  double expected = owning[0]["lookups"](lookups);
+  double shared = sharing[0]["lookups"](lookups);
+  if (expected!=shared) {
+    std::printf("dataset disagrees with the tables: %f != %f\n", shared, expected);
+    return 1;
+  }
+  double owningNs = luabind::bench::timeSeconds([&]() { double r = owning[1]["lookups"](lookups); luabind::bench::doNotOptimize(r); })*1e9/lookups;
+  double sharingNs = luabind::bench::timeSeconds([&]() { double r = sharing[1]["lookups"](lookups); luabind::bench::doNotOptimize(r); })*1e9/lookups;
+
+  std::printf("%d states, dataset %zu KB shared\n", states, dataset.bytes().size()/1024);
+  std::printf("%20s %10.0f KB total, %8.2f ns/lookup\n", "per-state tables", owningKb, owningNs);
+  std::printf("%20s %10.0f KB total, %8.2f ns/lookup\n", "shared dataset",
+              sharingKb + static_cast<double>(dataset.bytes().size())/1024, sharingNs);
+  return 0;
+}
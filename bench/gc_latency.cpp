@@ -0,0 +1,62 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <functional>
+
+/*
+ * Call latency distribution of an allocating request handler under each garbage
+ * collector configuration. "stopped + idle steps" stops the collector and pays the
+ * collection debt between requests with stepGcFor, outside of the
+ * measured latency, which is how a server with idle time between requests would use it.
+ */
+static const char *gHandler = R"(
+    handle = function(id)
+        local record = {id = id, name = "request " .. id, tags = {}}
+        for i = 1, 20 do
+            record.tags[i] = {key = "k" .. i, value = i * id}
+        end
+        return #record.tags
+    end
+)";
+
+struct Configuration {
+  const char *fName;
+  std::function<void(luabind::Lua &)> fSetup;
+  bool fIdleSteps;
+};
+
+int main() {
+  constexpr std::size_t requests = 200000;
+  Configuration configurations[] = {
+      {"incremental (default)", [](luabind::Lua &aLua) { aLua.setIncrementalGc(); }, false},
+      {"incremental pause=100", [](luabind::Lua &aLua) { aLua.setIncrementalGc({.fPause = 100, .fStepMultiplier = 400}); }, false},
+      {"incremental pause=400", [](luabind::Lua &aLua) { aLua.setIncrementalGc({.fPause = 400}); }, false},
+      {"generational", [](luabind::Lua &aLua) { aLua.setGenerationalGc(); }, false},
+      {"stopped + idle steps", [](luabind::Lua &aLua) { aLua.stopGc(); }, true},
+  };
+
+  std::printf("%zu requests per configuration\n", requests);
+  std::printf("%24s %10s %10s %10s %12s\n", "configuration", "p50 (us)", "p99 (us)", "max (us)", "memory (KB)");
+  for (auto const &configuration : configurations) {
+    luabind::Lua lua;
+    lua << gHandler;
+    configuration.fSetup(lua);
+
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    for (std::size_t i = 0; i < requests; ++i) {
+      auto start = luabind::bench::Clock::now();
+      int result = lua["handle"](static_cast<int>(i));
+      luabind::bench::doNotOptimize(result);
+      latencies.push_back(std::chrono::duration<double, std::micro>(luabind::bench::Clock::now() - start).count());
+      if (configuration.fIdleSteps) {
+        lua.stepGcFor(std::chrono::microseconds(20));
+      }
+    }
+    std::size_t memory = lua.memoryInUse()/1024;
+    double p50 = luabind::bench::percentile(latencies, 50);
+    double p99 = luabind::bench::percentile(latencies, 99);
+    std::printf("%24s %10.2f %10.2f %10.2f %12zu\n", configuration.fName, p50, p99, latencies.back(), memory);
+  }
+  return 0;
+}
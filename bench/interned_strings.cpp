@@ -0,0 +1,70 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace luabind::meta::literals;
+
+enum class Outcome { ACCEPTED, DEFERRED, REJECTED };
+
+template <>
+struct luabind::EnumStrings<Outcome> {
+  static constexpr std::array<std::pair<Outcome, std::string_view>, 3> fNames{{
+      {Outcome::ACCEPTED, "accepted"}, {Outcome::DEFERRED, "deferred"}, {Outcome::REJECTED, "rejected"}}};
+};
+
+/*
+ * Pushing the same few status strings over and over, as std::strings, as interned strings
+ * and as enumerators, then the same through callbacks a script calls in a loop.
+ */
+static const char *const LOOP = R"(
+    function run(n)
+        local accepted = 0
+        for i = 1, n do
+            if status(i % 3) == "accepted" then accepted = accepted + 1 end
+        end
+        return accepted
+    end
+)";
+
+int main() {
+  constexpr std::size_t pushes = 2000000;
+  luabind::Lua lua;
+  lua_State *state = lua.state();
+  const std::array<std::string, 3> strings{"accepted", "deferred", "rejected"};
+  const std::array<luabind::InternedString const *, 3> internedStrings{
+      &luabind::interned<"accepted"_f>, &luabind::interned<"deferred"_f>, &luabind::interned<"rejected"_f>};
+
+  std::size_t i = 0;
+  double stringNs = luabind::bench::nanosPerIteration(pushes, [&]() {
+    luabind::detail::toLua(state, strings[i++ % 3]);
+    lua_pop(state, 1);
+  });
+  i = 0;
+  double internedNs = luabind::bench::nanosPerIteration(pushes, [&]() {
+    luabind::detail::toLua(state, *internedStrings[i++ % 3]);
+    lua_pop(state, 1);
+  });
+  i = 0;
+  double enumNs = luabind::bench::nanosPerIteration(pushes, [&]() {
+    luabind::detail::toLua(state, static_cast<Outcome>(i++ % 3));
+    lua_pop(state, 1);
+  });
+
+  constexpr int calls = 1000000;
+  lua << LOOP;
+  lua["status"] = [&strings](int aCode) { return strings[aCode]; };
+  double stringCallbackNs = luabind::bench::timeSeconds([&]() { int n = lua["run"](calls); (void) n; })*1e9/calls;
+  lua["status"] = [](int aCode) { return static_cast<Outcome>(aCode); };
+  double enumCallbackNs = luabind::bench::timeSeconds([&]() { int n = lua["run"](calls); (void) n; })*1e9/calls;
+
+  std::printf("%24s %8.1f ns/push\n", "std::string", stringNs);
+  std::printf("%24s %8.1f ns/push\n", "InternedString", internedNs);
+  std::printf("%24s %8.1f ns/push\n", "enum", enumNs);
+  std::printf("%24s %8.1f ns/call\n", "callback -> std::string", stringCallbackNs);
+  std::printf("%24s %8.1f ns/call\n", "callback -> enum", enumCallbackNs);
+  return 0;
+}
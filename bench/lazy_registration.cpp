@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include "luabind/registry.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Creating a state with 2000 bound functions: binding each one eagerly (adapt,
+ * lua_pushcfunction and lua_setglobal), and installing a BindingRegistry, for a script
+ * that calls 10 of them. The per-call cost after the first use is the same either way.
+ */
+static constexpr std::size_t FUNCTIONS = 2000;
+
+template <std::size_t I>
+double shift(double aValue) {
+  return aValue + static_cast<double>(I);
+}
+
+static std::string functionName(std::size_t aIndex) {
+  return "shift_" + std::to_string(aIndex);
+}
+
+template <std::size_t ...I>
+static void bindEagerly(luabind::Lua &aLua, std::vector<std::string> const &aNames, std::index_sequence<I...>) {
+  ((lua_pushcfunction(aLua.state(), luabind::adapt<&shift<I>>()), lua_setglobal(aLua.state(), aNames[I].c_str())), ...);
+}
+
+template <std::size_t ...I>
+static void fillRegistry(luabind::BindingRegistry &aRegistry, std::vector<std::string> const &aNames,
+                         std::index_sequence<I...>) {
+  (aRegistry.add(aNames[I], &shift<I>), ...);
+}
+
+int main() {
+  constexpr std::size_t states = 500;
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < FUNCTIONS; ++i) {
+    names.push_back(functionName(i));
+  }
+  const char *script = "local x = 0 for i = 0, 9 do x = _G['shift_' .. i * 100](x) end assert(x == 4500)";
+
+  double eagerUs = luabind::bench::timeSeconds([&]() {
+    for (std::size_t i = 0; i < states; ++i) {
+      luabind::Lua lua;
+      bindEagerly(lua, names, std::make_index_sequence<FUNCTIONS>());
+      lua << script;
+    }
+  })*1e6/states;
+
+  luabind::BindingRegistry registry;
+  fillRegistry(registry, names, std::make_index_sequence<FUNCTIONS>());
+  double lazyUs = luabind::bench::timeSeconds([&]() {
+    for (std::size_t i = 0; i < states; ++i) {
+      luabind::Lua lua;
+      registry.install(lua);
+      lua << script;
+    }
+  })*1e6/states;
+
+  double emptyUs = luabind::bench::timeSeconds([&]() {
+    for (std::size_t i = 0; i < states; ++i) {
+      luabind::Lua lua;
+      lua << "local x = 0";
+    }
+  })*1e6/states;
+
+  constexpr std::size_t calls = 1000000;
+  auto callCost = [&](auto &&aBind) {
+    luabind::Lua lua;
+    aBind(lua);
+    lua["n"] = static_cast<double>(calls);
+    return luabind::bench::timeSeconds([&]() {
+      lua << "local x = 0 for i = 1, n do x = shift_7(x) end";
+    })*1e9/calls;
+  };
+  double eagerCallNs = callCost([&](luabind::Lua &aLua) {
+    bindEagerly(aLua, names, std::make_index_sequence<FUNCTIONS>());
+  });
+  double lazyCallNs = callCost([&](luabind::Lua &aLua) { registry.install(aLua); });
+
+  std::printf("%zu functions, a script using 10 of them\n", FUNCTIONS);
+  std::printf("%28s %8.1f us/state\n", "no bindings", emptyUs);
+  std::printf("%28s %8.1f us/state %6.1f ns/call\n", "eager lua_setglobal", eagerUs, eagerCallNs);
+  std::printf("%28s %8.1f us/state %6.1f ns/call\n", "BindingRegistry", lazyUs, lazyCallNs);
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "bench.hpp"
+#include "luabind/memoize.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Calling a pure classification function directly against through a Memoized wrapper,
+ * for keys drawn from a skewed distribution (most calls hit a few hundred hot keys).
+ */
+static const char *const CLASSIFIER = R"(
+    function classify(key)
+        local score = 0
+        for i = 1, 20 do score = score + (key * i) % 7 end
+        if score > 60 then return "high" elseif score > 40 then return "medium" end
+        return "low"
+    end
+)";
+
+int main() {
+  constexpr std::size_t calls = 200000;
+  std::mt19937 random(42);
+  std::geometric_distribution<int> hot(0.01);
+  std::vector<int> keys(calls);
+  for (auto &key : keys) {
+    key = hot(random);
+  }
+
+  luabind::Lua lua;
+  lua << CLASSIFIER;
+  luabind::Memoized<std::string(int)> classify(lua, "classify", {.fCapacity = 1024});
+
+  std::size_t i = 0;
+  double directNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    std::string label = lua["classify"](keys[i++ % calls]);
+    luabind::bench::doNotOptimize(label.size());
+  });
+  i = 0;
+  double memoizedNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    std::string label = classify(keys[i++ % calls]);
+    luabind::bench::doNotOptimize(label.size());
+  });
+
+  auto stats = classify.stats();
+  std::printf("%20s %10.0f ns/call\n", "direct", directNs);
+  std::printf("%20s %10.0f ns/call (hit rate %.1f%%, %llu evictions)\n", "memoized", memoizedNs,
+              stats.hitRate()*100, static_cast<unsigned long long>(stats.fEvictions));
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include "bench.hpp"
+#include "luabind/parallel.hpp"
+
+#include <numeric>
+
+/*
+ * Scaling of StatePool::map and StatePool::mapChunks over 1..N worker states, with a
+ * transform that does enough work per element to be worth parallelizing.
+ */
+static void loadTransform(luabind::Lua &aLua) {
+  aLua << R"(
+      transform = function(x)
+          local acc = x
+          for i = 1, 200 do
+              acc = (acc * 31 + i) % 1000003
+          end
+          return acc
+      end
+      transformChunk = function(chunk)
+          local out = {}
+          for i, x in ipairs(chunk) do
+              out[i] = transform(x)
+          end
+          return out
+      end
+  )";
+}
+
+int main() {
+  constexpr std::size_t elementCount = 200000;
+  std::vector<int> input(elementCount);
+  std::iota(input.begin(), input.end(), 0);
+
+  std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::printf("%zu elements, 200 Lua loop iterations per element\n", elementCount);
+  std::printf("%8s %14s %10s %14s %10s\n", "threads", "map (s)", "speedup", "mapChunks (s)", "speedup");
+
+  double mapBaseline = 0;
+  double chunkBaseline = 0;
+  for (std::size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    luabind::StatePool pool(threads, loadTransform);
+    double mapTime = luabind::bench::timeSeconds([&]() {
+      luabind::bench::doNotOptimize(pool.map<int>("transform", input));
+    });
+    double chunkTime = luabind::bench::timeSeconds([&]() {
+      luabind::bench::doNotOptimize(pool.mapChunks<int>("transformChunk", input));
+    });
+    if (threads==1) {
+      mapBaseline = mapTime;
+      chunkBaseline = chunkTime;
+    }
+    std::printf("%8zu %14.3f %9.2fx %14.3f %9.2fx\n", threads, mapTime, mapBaseline/mapTime,
+                chunkTime, chunkBaseline/chunkTime);
+    if (threads < maxThreads && threads*2 > maxThreads) {
+      threads = maxThreads/2;
+    }
+  }
+  return 0;
+}
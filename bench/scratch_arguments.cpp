@@ -0,0 +1,89 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * A callback taking eight strings (too long for the small string buffer) in a table,
+ * called from a Lua loop: converted into std containers on the heap, into pmr containers
+ * on the default resource (also the heap), and into pmr containers from the scratch arena.
+ * Heap allocations are counted by replacing the global operator new; Lua's own allocations
+ * don't go through it.
+ */
+static std::size_t gAllocations = 0;
+
+void *operator new(std::size_t aSize) {
+  ++gAllocations;
+  if (void *pointer = std::malloc(aSize==0 ? 1 : aSize)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+// std::pmr::new_delete_resource allocates through the aligned forms
+void *operator new(std::size_t aSize, std::align_val_t aAlignment) {
+  ++gAllocations;
+  auto alignment = static_cast<std::size_t>(aAlignment);
+  if (void *pointer = std::aligned_alloc(alignment, (aSize + alignment - 1)/alignment*alignment)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *aPointer, std::align_val_t) noexcept {
+  std::free(aPointer);
+}
+
+void operator delete(void *aPointer, std::size_t, std::align_val_t) noexcept {
+  std::free(aPointer);
+}
+
+void operator delete(void *aPointer) noexcept {
+  std::free(aPointer);
+}
+
+void operator delete(void *aPointer, std::size_t) noexcept {
+  std::free(aPointer);
+}
+
+int main() {
+  constexpr std::size_t calls = 200000;
+  luabind::Lua lua;
+  lua["heap"] = [](std::vector<std::string> const &aWords) {
+    return static_cast<int>(aWords.size());
+  };
+  lua["pmr"] = [](std::pmr::vector<std::pmr::string> const &aWords) {
+    return static_cast<int>(aWords.size());
+  };
+  lua["scratch"] = luabind::scratch([](std::pmr::vector<std::pmr::string> const &aWords) {
+    return static_cast<int>(aWords.size());
+  });
+  lua << R"(
+        words = {}
+        for i = 1, 8 do words[i] = string.rep(string.char(96 + i), 24) end
+        function run(name, n)
+          local f = _G[name]
+          local total = 0
+          for _ = 1, n do total = total + f(words) end
+          return total
+        end
+    )";
+
+  auto measure = [&](const char *aName) {
+    lua["run"](aName, 1000).as<int>(); // Warm up: the arena grows to fit
+    std::size_t before = gAllocations;
+    double seconds = luabind::bench::timeSeconds([&]() {
+      luabind::bench::doNotOptimize(lua["run"](aName, calls).as<int>());
+    });
+    double allocations = static_cast<double>(gAllocations - before)/calls;
+    std::printf("%28s %8.0f ns/call %6.2f allocations/call\n", aName, seconds*1e9/calls, allocations);
+  };
+  measure("heap");
+  measure("pmr");
+  measure("scratch");
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "luabind/snapshot.hpp"
+
+#include <string>
+#include <utility>
+
+/*
+ * Time to get a ready-to-use state by running the initialization (binding functions and
+ * running the init scripts) against restoring it from a snapshot. The init script stands
+ * in for a real one: a large body of function definitions, which a snapshot stores as
+ * bytecode and so never parses again, plus some precomputed data tables, which cost
+ * roughly as much to decode as the script took to build them.
+ */
+static std::string makeInitScript() {
+  std::string script;
+  for (int i = 0; i < 1500; ++i) {
+    auto n = std::to_string(i);
+    script += "function rule" + n + "(request)\n"
+        "    local score = 0\n"
+        "    for key, value in pairs(request) do\n"
+        "        if type(value) == 'number' and value > " + n + " then\n"
+        "            score = score + offset" + std::to_string(i%30) + "(value)\n"
+        "        elseif type(value) == 'string' and #value > " + std::to_string(i%17) + " then\n"
+        "            score = score - #value\n"
+        "        end\n"
+        "    end\n"
+        "    return score\n"
+        "end\n";
+  }
+  script += R"(
+    lookup = {}
+    for i = 1, 20000 do
+        lookup[i] = (i * 7919) % 1000
+    end
+
+    words = {}
+    for i = 1, 500 do
+        words["word" .. i] = { id = i, tags = { "t" .. (i % 13), "u" .. (i % 7) }, weight = i / 3 }
+    end
+
+    function dispatch(name, x) return _G[name]({ value = x, name = "request" }) end
+)";
+  return script;
+}
+
+template <int N>
+static int offset(int aValue) {
+  return aValue + N;
+}
+
+template <int ...Ns>
+static void addBindings(luabind::SnapshotBindings &aBindings, std::integer_sequence<int, Ns...>) {
+  (aBindings.add("offset" + std::to_string(Ns), &offset<Ns>), ...);
+}
+
+int main() {
+  constexpr std::size_t iterations = 50;
+  luabind::SnapshotBindings bindings;
+  addBindings(bindings, std::make_integer_sequence<int, 30>{});
+
+  const std::string initScript = makeInitScript();
+  auto coldInit = [&]() {
+    luabind::Lua lua;
+    bindings.installGlobals(lua);
+    lua << initScript;
+    return lua;
+  };
+
+  luabind::Lua warm = coldInit();
+  auto snapshot = luabind::Snapshot::capture(warm, bindings);
+  luabind::Lua clone = snapshot.clone(bindings);
+  int expected = warm["dispatch"]("rule17", 300);
+  int cloned = clone["dispatch"]("rule17", 300);
+  if (expected!=cloned) {
+    std::printf("clone disagrees with the original: %d != %d\n", cloned, expected);
+    return 1;
+  }
+
+  double initMs = luabind::bench::nanosPerIteration(iterations, [&]() {
+    auto lua = coldInit();
+    luabind::bench::doNotOptimize(lua.state());
+  })/1e6;
+  double captureMs = luabind::bench::nanosPerIteration(iterations, [&]() {
+    auto captured = luabind::Snapshot::capture(warm, bindings);
+    luabind::bench::doNotOptimize(captured.data().size());
+  })/1e6;
+  double cloneMs = luabind::bench::nanosPerIteration(iterations, [&]() {
+    auto lua = snapshot.clone(bindings);
+    luabind::bench::doNotOptimize(lua.state());
+  })/1e6;
+
+  std::printf("snapshot size: %zu KB\n", snapshot.data().size()/1024);
+  std::printf("%20s %10.2f ms\n", "cold init", initMs);
+  std::printf("%20s %10.2f ms\n", "capture", captureMs);
+  std::printf("%20s %10.2f ms (%.1fx faster than cold init)\n", "clone", cloneMs, initMs/cloneMs);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "bench.hpp"
+#include "luabind/executor.hpp"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * N threads calling one small function in one shared state: through a std::mutex around
+ * the Lua, and through a StateExecutor, both waiting for each result before the next call
+ * (latency) and keeping up to 64 calls in flight per thread (throughput). Thread counts go
+ * up to twice the hardware concurrency.
+ */
+static constexpr std::size_t CALLS = 200000;
+static constexpr std::size_t WINDOW = 64;
+
+static void loadCounter(luabind::Lua &aLua) {
+  aLua << "total = 0  function add(n) total = total + n return total end";
+}
+
+struct Result {
+  double fCallsPerSecond;
+  double fP50Micros;
+  double fP99Micros;
+};
+
+/*
+ * Runs aCall CALLS times split over aThreads threads, timing each call
+ */
+template <typename Call>
+static Result run(std::size_t aThreads, Call &&aCall) {
+  std::vector<std::vector<double>> latencies(aThreads);
+  double seconds = luabind::bench::timeSeconds([&]() {
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < aThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        auto &samples = latencies[t];
+        samples.reserve(CALLS/aThreads);
+        for (std::size_t i = 0; i < CALLS/aThreads; ++i) {
+          auto start = luabind::bench::Clock::now();
+          aCall();
+          samples.push_back(std::chrono::duration<double, std::micro>(luabind::bench::Clock::now() - start).count());
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  });
+  std::vector<double> all;
+  for (auto &samples : latencies) {
+    all.insert(all.end(), samples.begin(), samples.end());
+  }
+  return {static_cast<double>(all.size())/seconds, luabind::bench::percentile(all, 50),
+          luabind::bench::percentile(all, 99)};
+}
+
+static double pipelined(std::size_t aThreads, luabind::StateExecutor &aExecutor) {
+  return CALLS/luabind::bench::timeSeconds([&]() {
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < aThreads; ++t) {
+      threads.emplace_back([&]() {
+        std::deque<std::future<int>> inFlight;
+        for (std::size_t i = 0; i < CALLS/aThreads; ++i) {
+          if (inFlight.size()==WINDOW) {
+            luabind::bench::doNotOptimize(inFlight.front().get());
+            inFlight.pop_front();
+          }
+          inFlight.push_back(aExecutor.call<int>("add", 1));
+        }
+        for (auto &future : inFlight) {
+          luabind::bench::doNotOptimize(future.get());
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  });
+}
+
+int main() {
+  std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::printf("%zu calls of a one-line function\n", CALLS);
+  std::printf("%8s %30s %30s %14s %8s\n", "threads", "mutex (M calls/s, p50/p99 us)",
+              "executor (M calls/s, p50/p99)", "pipelined", "batch");
+  for (std::size_t threads = 1; threads <= maxThreads*2; threads *= 2) {
+    luabind::Lua lua;
+    loadCounter(lua);
+    std::mutex mutex;
+    auto locked = run(threads, [&]() {
+      std::lock_guard lock(mutex);
+      luabind::bench::doNotOptimize(lua["add"](1).as<int>());
+    });
+
+    luabind::StateExecutor executor(loadCounter);
+    auto queued = run(threads, [&]() {
+      luabind::bench::doNotOptimize(executor.call<int>("add", 1).get());
+    });
+    auto before = executor.stats();
+    double pipelinedRate = pipelined(threads, executor);
+    auto after = executor.stats();
+    double batch = static_cast<double>(after.fCalls - before.fCalls)/static_cast<double>(after.fBatches - before.fBatches);
+
+    std::printf("%8zu %12.2f %8.2f/%-8.2f %12.2f %8.2f/%-8.2f %14.2f %8.1f\n", threads,
+                locked.fCallsPerSecond/1e6, locked.fP50Micros, locked.fP99Micros,
+                queued.fCallsPerSecond/1e6, queued.fP50Micros, queued.fP99Micros, pipelinedRate/1e6, batch);
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+/*
+ * Per-call cost of a trivial C++ callback through each adapt() path:
+ * - gCallable:   the generic path, which dereferences a std::optional global
+ * - stateless:   adapt() of a captureless lambda, constructed in place per call
+ * - static:      adapt<&func>(), the callable named directly in the lua_CFunction
+ * - handwritten: a lua_CFunction written against the C API, as a floor
+ *
+ * Each callback is measured both when called from a Lua loop and when its
+ * lua_CFunction is invoked directly from C++ with the argument already pushed,
+ * which isolates the entry-point overhead from the interpreter.
+ */
+static int increment(int aX) {
+  return aX + 1;
+}
+
+static int handwritten(lua_State *aState) {
+  lua_pushnumber(aState, lua_tonumber(aState, 1) + 1);
+  return 1;
+}
+
+struct GCallableTag {};
+
+int main() {
+  constexpr std::size_t iterations = 10000000;
+  auto lambda = [](int aX) { return aX + 1; };
+  using Lambda = decltype(lambda);
+
+  luabind::detail::gCallable<Lambda, GCallableTag>.emplace(lambda);
+  std::pair<const char *, lua_CFunction> variants[] = {
+      {"gCallable", &luabind::detail::adapted<Lambda, GCallableTag>},
+      {"stateless", luabind::adapt(lambda)},
+      {"static", luabind::adapt<&increment>()},
+      {"handwritten", &handwritten},
+  };
+
+  std::printf("%zu calls per variant\n", iterations);
+  std::printf("%12s %16s %16s\n", "variant", "from Lua (ns)", "direct (ns)");
+  for (auto [name, function] : variants) {
+    lua_State *state = luaL_newstate();
+    lua_register(state, "callback", function);
+    luabind::Lua lua(state);
+    lua["iterations"] = static_cast<double>(iterations);
+    double viaLua = luabind::bench::timeSeconds([&]() {
+      lua << R"(
+          local f = callback
+          local acc = 0
+          for i = 1, iterations do
+              acc = f(acc)
+          end
+      )";
+    })*1e9/static_cast<double>(iterations);
+
+    double viaDirect = luabind::bench::nanosPerIteration(iterations, [&]() {
+      lua_pushnumber(state, 1);
+      function(state);
+      lua_settop(state, 0);
+    });
+    lua_close(state);
+    std::printf("%12s %16.2f %16.2f\n", name, viaLua, viaDirect);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <ranges>
+#include <vector>
+
+/*
+ * Moving a generated sequence of a million numbers between the domains: materialized in a
+ * vector or table first, against streamed through a lazy range or LuaRange. Memory is the
+ * peak growth of the Lua heap while the sequence is consumed.
+ */
+static const char *const SCRIPT = R"(
+    peak = 0
+    function sum()
+        local total = 0
+        for _, v in ipairs(values) do total = total + v end
+        return total
+    end
+    function sumLazy(nextValue)
+        local base, total, count = collectgarbage("count"), 0, 0
+        for v in nextValue do
+            total = total + v
+            count = count + 1
+            if count % 65536 == 0 then peak = math.max(peak, collectgarbage("count") - base) end
+        end
+        return total
+    end
+    function makeTable(n)
+        local t = {}
+        for i = 1, n do t[i] = i * 0.5 end
+        return t
+    end
+    function generate(n)
+        return function(_, i)
+            if i < n then return i + 1, (i + 1) * 0.5 end
+        end, nil, 0
+    end
+)";
+
+int main() {
+  constexpr int count = 1000000;
+  auto generated = std::views::iota(0, count) | std::views::transform([](int i) { return i*0.5; });
+
+  luabind::Lua lua;
+  lua << SCRIPT;
+  lua.collectGarbage();
+  double base = lua_gc(lua.state(), LUA_GCCOUNT, 0);
+  double eagerSeconds = luabind::bench::timeSeconds([&]() {
+    std::vector<double> values(generated.begin(), generated.end());
+    lua["values"] = values;
+    double total = lua["sum"]();
+    luabind::bench::doNotOptimize(total);
+  });
+  double eagerKb = lua_gc(lua.state(), LUA_GCCOUNT, 0) - base;
+  lua << "values = nil";
+  lua.collectGarbage();
+
+  lua << "peak = 0";
+  double lazySeconds = luabind::bench::timeSeconds([&]() {
+    double total = lua["sumLazy"](luabind::lazy(generated));
+    luabind::bench::doNotOptimize(total);
+  });
+  double lazyKb = lua["peak"];
+
+  double tableSeconds = luabind::bench::timeSeconds([&]() {
+    std::vector<double> values = lua["makeTable"](count);
+    double total = 0;
+    for (double value : values) {
+      total += value;
+    }
+    luabind::bench::doNotOptimize(total);
+  });
+  double iterateSeconds = luabind::bench::timeSeconds([&]() {
+    double total = 0;
+    for (auto [index, value] : lua.iterate<int, double>("generate", count)) {
+      total += value;
+    }
+    luabind::bench::doNotOptimize(total);
+  });
+
+  std::printf("C++ -> Lua, %d elements\n", count);
+  std::printf("%20s %8.1f ns/element %10.0f KB Lua heap\n", "vector + table", eagerSeconds*1e9/count, eagerKb);
+  std::printf("%20s %8.1f ns/element %10.0f KB Lua heap\n", "lazy", lazySeconds*1e9/count, lazyKb);
+  std::printf("Lua -> C++, %d elements\n", count);
+  std::printf("%20s %8.1f ns/element\n", "table + vector", tableSeconds*1e9/count);
+  std::printf("%20s %8.1f ns/element\n", "LuaRange", iterateSeconds*1e9/count);
+  return 0;
+}
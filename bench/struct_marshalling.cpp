@@ -0,0 +1,71 @@
+#include "bench.hpp"
+#include "luabind/luabind.hpp"
+
+#include <array>
+#include <string_view>
+
+using namespace luabind::meta::literals;
+using luabind::meta::field;
+
+/*
+ * Round-tripping a five-member record through a Lua function: copied through an
+ * equivalent meta::table, converted member by member as a table, and stored whole in a
+ * userdata.
+ */
+struct Sample {
+  double x;
+  double y;
+  double z;
+  int id;
+  bool valid;
+};
+
+struct PackedSample {
+  double x;
+  double y;
+  double z;
+  int id;
+  bool valid;
+};
+
+template <>
+struct luabind::StructFields<Sample> {
+  static constexpr std::array<std::string_view, 5> fNames{"x", "y", "z", "id", "valid"};
+};
+
+template <>
+struct luabind::StructFields<PackedSample> {
+  static constexpr std::array<std::string_view, 5> fNames{"x", "y", "z", "id", "valid"};
+  static constexpr bool fAsUserdata = true;
+};
+
+using SampleTable = luabind::meta::table<field<"x"_f, double>, field<"y"_f, double>, field<"z"_f, double>,
+                                         field<"id"_f, int>, field<"valid"_f, bool>>;
+
+int main() {
+  constexpr std::size_t calls = 500000;
+  luabind::Lua lua;
+  lua << "function identity(sample) return sample end";
+
+  Sample sample{1.0, 2.0, 3.0, 4, true};
+  double metaTableNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    SampleTable in{{sample.x}, {sample.y}, {sample.z}, {sample.id}, {sample.valid}};
+    auto out = lua["identity"](in).as<SampleTable>();
+    Sample copy{out.f<"x"_f>(), out.f<"y"_f>(), out.f<"z"_f>(), out.f<"id"_f>(), out.f<"valid"_f>()};
+    luabind::bench::doNotOptimize(copy.id);
+  });
+  double structNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    auto copy = lua["identity"](sample).as<Sample>();
+    luabind::bench::doNotOptimize(copy.id);
+  });
+  PackedSample packed{1.0, 2.0, 3.0, 4, true};
+  double userdataNs = luabind::bench::nanosPerIteration(calls, [&]() {
+    auto copy = lua["identity"](packed).as<PackedSample>();
+    luabind::bench::doNotOptimize(copy.id);
+  });
+
+  std::printf("%28s %8.0f ns/round trip\n", "via meta::table", metaTableNs);
+  std::printf("%28s %8.0f ns/round trip\n", "struct as table", structNs);
+  std::printf("%28s %8.0f ns/round trip\n", "struct as userdata", userdataNs);
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench.hpp"
+#include "luabind/trace.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+
+/*
+ * Records a synthetic request mix to a trace, reports what recording costs, and replays
+ * the trace against a fresh state with per-function latency distributions.
+ *
+ * Run as "trace_replay <trace> <script>..." to replay a trace recorded elsewhere against
+ * a state set up by running the given scripts. Calls into C++ functions the scripts
+ * expect but that this tool doesn't bind show up as failures.
+ */
+using namespace luabind::meta::literals;
+
+static const char *const SERVICE = R"(
+    local sessions = {}
+    function login(user, roles)
+        sessions[user] = { roles = roles, hits = 0 }
+        return true
+    end
+    function request(user, path, query)
+        local session = sessions[user]
+        if not session then return 401 end
+        session.hits = session.hits + 1
+        local score = 0
+        for key, value in pairs(query) do score = score + #key + weight(value) end
+        return score % 2 == 0 and 200 or 404
+    end
+    function report(user)
+        local session = sessions[user]
+        return session and session.hits or 0
+    end
+)";
+
+static void setUp(luabind::Lua &aLua) {
+  aLua << SERVICE;
+  aLua["weight"] = [](double aValue) { return aValue*0.5; };
+}
+
+static void workload(luabind::Lua &aLua, int aRequests) {
+  std::mt19937 random(7);
+  std::uniform_int_distribution<int> users(0, 99);
+  for (int user = 0; user < 100; ++user) {
+    aLua["login"](user, std::vector<std::string>{"reader", user%10 ? "writer" : "admin"});
+  }
+  using Query = luabind::meta::table<luabind::meta::field<"page"_f, int>, luabind::meta::field<"size"_f, int>>;
+  for (int i = 0; i < aRequests; ++i) {
+    int user = users(random);
+    if (i%50==0) {
+      int hits = aLua["report"](user);
+      luabind::bench::doNotOptimize(hits);
+    } else {
+      int status = aLua["request"](user, "/items", Query{{i%7}, {20}});
+      luabind::bench::doNotOptimize(status);
+    }
+  }
+}
+
+int main(int aArgc, char **aArgv) {
+  if (aArgc >= 2) {
+    luabind::Lua lua;
+    for (int i = 2; i < aArgc; ++i) {
+      lua.runFile(aArgv[i]);
+    }
+    std::printf("%s", luabind::replayTrace(lua, aArgv[1]).format().c_str());
+    return 0;
+  }
+
+  constexpr int requests = 200000;
+  auto path = (std::filesystem::temp_directory_path()/"luabind_bench.trace").string();
+  double plainSeconds = luabind::bench::timeSeconds([&]() {
+    luabind::Lua lua;
+    setUp(lua);
+    workload(lua, requests);
+  });
+  std::size_t records = 0;
+  double recordingSeconds = luabind::bench::timeSeconds([&]() {
+    luabind::Lua lua;
+    setUp(lua);
+    luabind::TraceRecorder recorder(lua, path);
+    workload(lua, requests);
+    records = recorder.recordCount();
+  });
+
+  luabind::Lua fresh;
+  setUp(fresh);
+  auto report = luabind::replayTrace(fresh, path);
+  std::printf("%d requests: %.0f ns/request plain, %.0f ns/request recording (%zu records, %.1f bytes each)\n",
+              requests, plainSeconds*1e9/requests, recordingSeconds*1e9/requests, records,
+              static_cast<double>(std::filesystem::file_size(path))/static_cast<double>(records));
+  std::printf("%s", report.format().c_str());
+  std::filesystem::remove(path);
+  return 0;
+}
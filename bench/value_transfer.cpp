@@ -0,0 +1,51 @@
+#include "bench.hpp"
+#include "luabind/serialize.hpp"
+
+#include <string>
+#include <vector>
+
+/*
+ * Moving a table from one state to another through a ValueBuffer, which encodes it
+ * straight off the stack, against converting it to a C++ container with fromLua and
+ * back with toLua. Both directions are timed together.
+ */
+int main() {
+  constexpr std::size_t iterations = 2000;
+  luabind::Lua source;
+  luabind::Lua destination;
+  source << R"(
+      numbers = {}
+      names = {}
+      for i = 1, 5000 do
+          numbers[i] = i * 0.5
+          names[i] = "name" .. i
+      end
+  )";
+
+  std::printf("%24s %12s\n", "method", "us per copy");
+  luabind::ValueBuffer buffer;
+  double bufferNumbers = luabind::bench::nanosPerIteration(iterations, [&]() {
+    buffer.clear();
+    buffer.writeGlobal(source, "numbers");
+    buffer.readGlobal(destination, "numbers");
+  })/1e3;
+  std::printf("%24s %12.2f\n", "numbers: ValueBuffer", bufferNumbers);
+  double convertNumbers = luabind::bench::nanosPerIteration(iterations, [&]() {
+    std::vector<double> numbers = source["numbers"];
+    destination["numbers"] = numbers;
+  })/1e3;
+  std::printf("%24s %12.2f\n", "numbers: fromLua/toLua", convertNumbers);
+
+  double bufferNames = luabind::bench::nanosPerIteration(iterations, [&]() {
+    buffer.clear();
+    buffer.writeGlobal(source, "names");
+    buffer.readGlobal(destination, "names");
+  })/1e3;
+  std::printf("%24s %12.2f\n", "names: ValueBuffer", bufferNames);
+  double convertNames = luabind::bench::nanosPerIteration(iterations, [&]() {
+    std::vector<std::string> names = source["names"];
+    destination["names"] = names;
+  })/1e3;
+  std::printf("%24s %12.2f\n", "names: fromLua/toLua", convertNames);
+  return 0;
+}
@@ -5,17 +5,16 @@
 #include "luabind/luabind.hpp"
 #include "lauxlib.h"
 
-static const struct luaL_Reg functions [] = {
-        { "say_hello", luabind::adapt([](){ return "hello world!"; })},
-        {NULL, NULL}
-};
+using namespace luabind::meta::literals;
+
+using MyModule = luabind::module<"mymodule"_f,
+    luabind::def<"say_hello"_f, []() { return "hello world!"; }>,
+    luabind::def<"add"_f, [](int a, int b) { return a + b; }>>;
 
 extern "C" {
 
 int luaopen_mymodule(lua_State *L) {
-    luaL_newlib(L, functions);
-    lua_setglobal(L, "mymodule");
-    return 1;
+    return MyModule::openGlobal(L);
 }
 
 }
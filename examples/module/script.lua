@@ -4,3 +4,6 @@ require "mymodule"
 
 print("Testing say_hello()")
 assert("hello world!" == mymodule.say_hello())
+
+print("Testing add()")
+assert(3 == mymodule.add(1, 2))
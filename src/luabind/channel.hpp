@@ -0,0 +1,440 @@
+#ifndef LUABIND_CHANNEL_HPP
+#define LUABIND_CHANNEL_HPP
+
+#include "luabind/serialize.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace luabind::detail {
+inline constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+/*
+ * MpmcRing is a bounded lock-free queue for any number of producers and consumers
+ * (Dmitry Vyukov's array-based design). Each slot carries a sequence number that tells
+ * a producer whether the slot is free for the current lap of the ring and a consumer
+ * whether it holds a value for the current lap, so the only contended operations are
+ * one compare-and-swap on the head or tail index per push or pop.
+ */
+template <typename T>
+class MpmcRing {
+  public:
+  explicit MpmcRing(std::size_t aCapacity)
+      : fMask(std::bit_ceil(std::max<std::size_t>(aCapacity, 2)) - 1), fSlots(new Slot[fMask + 1]) {
+    for (std::size_t i = 0; i <= fMask; ++i) {
+      fSlots[i].fSequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] std::size_t capacity() const {
+    return fMask + 1;
+  }
+
+  /*
+   * Moves aValue into the ring and returns true, or returns false if the ring is full
+   */
+  bool tryPush(T &aValue) {
+    auto pos = fTail.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = fSlots[pos & fMask];
+      auto sequence = slot.fSequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+      if (diff==0) {
+        if (fTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.fValue = std::move(aValue);
+          slot.fSequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = fTail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*
+   * Moves the oldest value into aValue and returns true, or returns false if the ring is empty
+   */
+  bool tryPop(T &aValue) {
+    auto pos = fHead.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = fSlots[pos & fMask];
+      auto sequence = slot.fSequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+      if (diff==0) {
+        if (fHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          aValue = std::move(slot.fValue);
+          slot.fSequence.store(pos + fMask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = fHead.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  private:
+  struct Slot {
+    std::atomic<std::size_t> fSequence;
+    T fValue;
+  };
+
+  const std::size_t fMask;
+  std::unique_ptr<Slot[]> fSlots;
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> fHead{0};
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> fTail{0};
+};
+
+/*
+ * ChannelState is the shared part of a Channel: a ring of serialized messages, plus
+ * event counters that blocked senders and receivers sleep on (with C++20 atomic wait)
+ * once spinning has not helped. The counters are only notified when someone is waiting,
+ * so an uncontended send or receive never makes a system call.
+ */
+class ChannelState {
+  public:
+  explicit ChannelState(std::size_t aCapacity) : fRing(aCapacity) {}
+
+  [[nodiscard]] std::size_t capacity() const {
+    return fRing.capacity();
+  }
+
+  [[nodiscard]] bool closed() const {
+    return fClosed.load(std::memory_order_acquire);
+  }
+
+  /*
+   * Moves aMessage into the channel and returns true, or returns false if it is full.
+   * Throws if the channel is closed.
+   */
+  bool trySend(std::string &aMessage) {
+    if (closed()) {
+      throw RuntimeError("Send on a closed channel");
+    }
+    if (!fRing.tryPush(aMessage)) {
+      return false;
+    }
+    signal(fPushes, fReceiversWaiting);
+    return true;
+  }
+
+  /*
+   * Returns true with the oldest message in aMessage, or false if the channel is empty
+   */
+  bool tryReceive(std::string &aMessage) {
+    if (!fRing.tryPop(aMessage)) {
+      return false;
+    }
+    signal(fPops, fSendersWaiting);
+    return true;
+  }
+
+  void send(std::string &aMessage) {
+    blockUntil(fPops, fSendersWaiting, [&]() { return trySend(aMessage); });
+  }
+
+  /*
+   * Blocks until a message arrives and returns true, or returns false once the channel
+   * is closed and empty
+   */
+  bool receive(std::string &aMessage) {
+    bool received = false;
+    blockUntil(fPushes, fReceiversWaiting, [&]() {
+      received = tryReceive(aMessage);
+      return received || closed();
+    });
+    return received || tryReceive(aMessage);
+  }
+
+  /*
+   * Rejects further sends and wakes everyone up. Messages already in the channel can
+   * still be received.
+   */
+  void close() {
+    fClosed.store(true, std::memory_order_release);
+    fPushes.fetch_add(1);
+    fPushes.notify_all();
+    fPops.fetch_add(1);
+    fPops.notify_all();
+  }
+
+  private:
+  static inline constexpr int SPIN_COUNT = 64;
+
+  static void signal(std::atomic<std::uint32_t> &aEvents, std::atomic<std::uint32_t> &aWaiting) {
+    aEvents.fetch_add(1);
+    if (aWaiting.load()!=0) {
+      aEvents.notify_one();
+    }
+  }
+
+  /*
+   * Retries aAttempt until it returns true, sleeping on aEvents between attempts. The
+   * counter is read before each attempt, so an event that arrives between a failed
+   * attempt and going to sleep makes the wait return immediately.
+   */
+  template <typename Attempt>
+  static void blockUntil(std::atomic<std::uint32_t> &aEvents, std::atomic<std::uint32_t> &aWaiting, Attempt &&aAttempt) {
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+      if (aAttempt()) {
+        return;
+      }
+    }
+    while (true) {
+      auto seen = aEvents.load();
+      if (aAttempt()) {
+        return;
+      }
+      aWaiting.fetch_add(1);
+      aEvents.wait(seen);
+      aWaiting.fetch_sub(1);
+    }
+  }
+
+  MpmcRing<std::string> fRing;
+  std::atomic<bool> fClosed{false};
+  alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> fPushes{0};
+  std::atomic<std::uint32_t> fReceiversWaiting{0};
+  alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> fPops{0};
+  std::atomic<std::uint32_t> fSendersWaiting{0};
+};
+}
+
+namespace luabind::detail::channel {
+inline constexpr const char *METATABLE_NAME = "luabind.Channel";
+
+using Handle = std::shared_ptr<ChannelState>;
+
+inline ChannelState &checkChannel(lua_State *aState) {
+  return **static_cast<Handle *>(luaL_checkudata(aState, 1, METATABLE_NAME));
+}
+
+/*
+ * Outcome of one attempt to send or receive from a Lua function. The attempts catch
+ * C++ exceptions and report FAILED with the message pushed, so that lua_error is only
+ * called once no C++ objects are left to destroy.
+ */
+enum class Attempt {
+  DONE,
+  WOULD_BLOCK,
+  FAILED
+};
+
+inline std::unordered_map<const void *, serialize::Id> &scratchIds() {
+  thread_local std::unordered_map<const void *, serialize::Id> ids;
+  return ids;
+}
+
+/*
+ * Sends the value at index 2. If aMayYield, a full channel is reported instead of
+ * waited for.
+ */
+inline Attempt sendFrom(lua_State *aState, ChannelState &aChannel, bool aMayYield) {
+  try {
+    std::string message;
+    serialize::writeValue(aState, 2, message, scratchIds());
+    if (aMayYield) {
+      return aChannel.trySend(message) ? Attempt::DONE : Attempt::WOULD_BLOCK;
+    }
+    aChannel.send(message);
+    return Attempt::DONE;
+  } catch (std::exception const &e) {
+    lua_pushstring(aState, e.what());
+    return Attempt::FAILED;
+  }
+}
+
+/*
+ * Pushes the received value, or nil if the channel is closed and empty. If aMayYield,
+ * an empty channel is reported instead of waited for.
+ */
+inline Attempt receiveInto(lua_State *aState, ChannelState &aChannel, bool aMayYield) {
+  try {
+    std::string message;
+    bool received;
+    if (aMayYield) {
+      received = aChannel.tryReceive(message);
+      if (!received && !aChannel.closed()) {
+        return Attempt::WOULD_BLOCK;
+      }
+    } else {
+      received = aChannel.receive(message);
+    }
+    if (!received) {
+      lua_pushnil(aState);
+      return Attempt::DONE;
+    }
+    serialize::Reader reader(message);
+    serialize::readValue(aState, reader);
+    return Attempt::DONE;
+  } catch (std::exception const &e) {
+    lua_pushstring(aState, e.what());
+    return Attempt::FAILED;
+  }
+}
+
+/*
+ * Inside a coroutine, send and recv don't block the thread: they yield the channel to
+ * whatever resumes the coroutine (a scheduler can use it to tell what the coroutine is
+ * waiting on) and try again when resumed.
+ */
+inline int sendContinuation(lua_State *aState, int, lua_KContext) {
+  lua_settop(aState, 2); // Drop whatever the coroutine was resumed with
+  auto attempt = sendFrom(aState, checkChannel(aState), lua_isyieldable(aState));
+  if (attempt==Attempt::FAILED) {
+    return lua_error(aState);
+  }
+  if (attempt==Attempt::WOULD_BLOCK) {
+    lua_pushvalue(aState, 1);
+    return lua_yieldk(aState, 1, 0, &sendContinuation);
+  }
+  return 0;
+}
+
+inline int send(lua_State *aState) {
+  checkChannel(aState);
+  // recv returns nil for a closed channel, so nil can't be a message
+  luaL_argcheck(aState, !lua_isnoneornil(aState, 2), 2, "channel messages can't be nil");
+  return sendContinuation(aState, LUA_OK, 0);
+}
+
+inline int receiveContinuation(lua_State *aState, int, lua_KContext) {
+  lua_settop(aState, 1);
+  auto attempt = receiveInto(aState, checkChannel(aState), lua_isyieldable(aState));
+  if (attempt==Attempt::FAILED) {
+    return lua_error(aState);
+  }
+  if (attempt==Attempt::WOULD_BLOCK) {
+    lua_pushvalue(aState, 1);
+    return lua_yieldk(aState, 1, 0, &receiveContinuation);
+  }
+  return 1;
+}
+
+inline int receive(lua_State *aState) {
+  return receiveContinuation(aState, LUA_OK, 0);
+}
+
+/*
+ * Returns true and the value, or false (and "closed" once the channel is closed and
+ * empty) without waiting
+ */
+inline int tryReceive(lua_State *aState) {
+  lua_settop(aState, 1);
+  auto &channel = checkChannel(aState);
+  lua_pushboolean(aState, true);
+  auto attempt = receiveInto(aState, channel, true);
+  if (attempt==Attempt::FAILED) {
+    return lua_error(aState);
+  }
+  if (attempt==Attempt::WOULD_BLOCK) {
+    lua_pushboolean(aState, false);
+    return 1;
+  }
+  if (lua_isnil(aState, -1) && channel.closed()) {
+    lua_pushboolean(aState, false);
+    lua_pushstring(aState, "closed");
+    return 2;
+  }
+  return 2;
+}
+
+inline int close(lua_State *aState) {
+  checkChannel(aState).close();
+  return 0;
+}
+
+inline int collect(lua_State *aState) {
+  static_cast<Handle *>(lua_touserdata(aState, 1))->~Handle();
+  return 0;
+}
+
+inline void push(lua_State *aState, Handle const &aHandle) {
+  new(lua_newuserdatauv(aState, sizeof(Handle), 0)) Handle(aHandle);
+  if (luaL_newmetatable(aState, METATABLE_NAME)) {
+    static const luaL_Reg methods[] = {
+        {"send", &send},
+        {"recv", &receive},
+        {"try_recv", &tryReceive},
+        {"close", &close},
+        {nullptr, nullptr}
+    };
+    luaL_newlib(aState, methods);
+    lua_setfield(aState, -2, "__index");
+    lua_pushcfunction(aState, &collect);
+    lua_setfield(aState, -2, "__gc");
+  }
+  lua_setmetatable(aState, -2);
+}
+}
+
+namespace luabind {
+/*
+ * A Channel carries values between Lua states, typically running on different threads.
+ * It is a bounded lock-free queue of values serialized as by ValueBuffer (so it accepts
+ * booleans, numbers, strings and tables of those), shared by every state it is installed
+ * in:
+ *
+ *   luabind::Channel jobs(1024);
+ *   jobs.installGlobal(producer, "jobs");   // on the producer's thread: jobs:send({ id = 1 })
+ *   jobs.installGlobal(consumer, "jobs");   // on the consumer's thread: local job = jobs:recv()
+ *
+ * In Lua, a channel has the methods:
+ * - send(value): waits while the channel is full; errors if the channel is closed, or if
+ *   value is nil (which recv returns for a closed channel).
+ * - recv(): waits for a value; returns nil once the channel is closed and empty.
+ * - try_recv(): returns true and a value, or false if there is none (false, "closed"
+ *   once the channel is closed and empty).
+ * - close(): rejects further sends and wakes up everyone waiting.
+ *
+ * Called from the main thread of a state, send and recv block the OS thread. Called from
+ * a coroutine they yield the channel instead, and try again when the coroutine is resumed,
+ * so a coroutine scheduler keeps running its other coroutines.
+ *
+ * Capacity is rounded up to a power of two.
+ */
+class Channel {
+  public:
+  explicit Channel(std::size_t aCapacity) : fState(std::make_shared<detail::ChannelState>(aCapacity)) {}
+
+  [[nodiscard]] std::size_t capacity() const {
+    return fState->capacity();
+  }
+
+  void close() {
+    fState->close();
+  }
+
+  [[nodiscard]] bool closed() const {
+    return fState->closed();
+  }
+
+  /*
+   * Pushes a handle to the channel onto aState's stack
+   */
+  void push(lua_State *aState) const {
+    detail::channel::push(aState, fState);
+  }
+
+  void installGlobal(Lua &aLua, const std::string_view aGlobalName) const {
+    push(aLua.state());
+    lua_setglobal(aLua.state(), aGlobalName.data());
+  }
+
+  private:
+  std::shared_ptr<detail::ChannelState> fState;
+};
+}
+
+#endif //LUABIND_CHANNEL_HPP
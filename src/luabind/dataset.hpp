@@ -0,0 +1,755 @@
+#ifndef LUABIND_DATASET_HPP
+#define LUABIND_DATASET_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace luabind::detail::dataset {
+/*
+ * A dataset is one flat, position-independent byte string, so that it can be shared by
+ * any number of states and threads, and mapped straight from a file.
+ *
+ * Every value is a 16-byte Cell. Scalars are stored inline; strings and tables are
+ * offsets into the byte string. A table is a TableNode header followed by its sequence
+ * (the values of keys 1..n, in order) and then its other fields as key/value cell pairs,
+ * sorted (integers by value, then strings bytewise) for binary search. Identical strings
+ * are stored once, and a table referenced from several places is stored once, so shared
+ * subtables (and even cycles) keep their identity.
+ *
+ * Numbers are in native byte order: files are only portable between machines of the
+ * same architecture.
+ */
+inline constexpr std::string_view MAGIC = "LBDS";
+inline constexpr std::uint32_t FORMAT_VERSION = 1;
+
+enum class CellType : std::uint8_t {
+  NIL,
+  BOOLEAN_FALSE,
+  BOOLEAN_TRUE,
+  INTEGER,
+  FLOAT,
+  STRING,
+  TABLE
+};
+
+struct Cell {
+  CellType fType;
+  std::uint8_t fReserved[3];
+  std::uint32_t fLength;   // Of a string
+  std::uint64_t fPayload;  // Integer, float bits, or offset of string bytes or a TableNode
+};
+static_assert(sizeof(Cell)==16);
+
+struct TableNode {
+  std::uint32_t fSequenceCount;
+  std::uint32_t fFieldCount;
+};
+
+inline constexpr std::size_t ROOT_OFFSET = 8; // After the magic and version
+
+/*
+ * Read access to the bytes of a dataset. Every read is bounds checked, since the bytes
+ * may come from a file; a failed check reports false rather than throwing, because the
+ * callers are Lua C functions.
+ */
+class View {
+  public:
+  View(const char *aData, std::size_t aSize) : fData(aData), fSize(aSize) {}
+
+  [[nodiscard]] const char *data() const {
+    return fData;
+  }
+
+  bool cell(std::uint64_t aOffset, Cell &aCell) const {
+    return read(aOffset, aCell);
+  }
+
+  bool node(std::uint64_t aOffset, TableNode &aNode) const {
+    return read(aOffset, aNode) && contains(aOffset + sizeof(TableNode),
+                                            (aNode.fSequenceCount + 2*static_cast<std::uint64_t>(aNode.fFieldCount))*sizeof(Cell));
+  }
+
+  bool string(Cell const &aCell, std::string_view &aString) const {
+    if (!contains(aCell.fPayload, aCell.fLength)) {
+      return false;
+    }
+    aString = {fData + aCell.fPayload, aCell.fLength};
+    return true;
+  }
+
+  /*
+   * Offsets of the i-th sequence cell and of the i-th field's key cell (its value follows)
+   */
+  static std::uint64_t sequenceCell(std::uint64_t aNode, std::uint64_t aIndex) {
+    return aNode + sizeof(TableNode) + aIndex*sizeof(Cell);
+  }
+
+  static std::uint64_t fieldCell(std::uint64_t aNode, TableNode const &aHeader, std::uint64_t aIndex) {
+    return sequenceCell(aNode, aHeader.fSequenceCount) + 2*aIndex*sizeof(Cell);
+  }
+
+  private:
+  [[nodiscard]] bool contains(std::uint64_t aOffset, std::uint64_t aLength) const {
+    return aOffset <= fSize && aLength <= fSize - aOffset;
+  }
+
+  template <typename T>
+  bool read(std::uint64_t aOffset, T &aOut) const {
+    if (!contains(aOffset, sizeof(T))) {
+      return false;
+    }
+    std::memcpy(&aOut, fData + aOffset, sizeof(T));
+    return true;
+  }
+
+  const char *fData;
+  std::size_t fSize;
+};
+
+/*
+ * Orders field keys: integers by value, then strings bytewise
+ */
+inline int compareKeys(bool aIsIntegerA, lua_Integer aIntegerA, std::string_view aStringA,
+                       bool aIsIntegerB, lua_Integer aIntegerB, std::string_view aStringB) {
+  if (aIsIntegerA!=aIsIntegerB) {
+    return aIsIntegerA ? -1 : 1;
+  }
+  if (aIsIntegerA) {
+    return aIntegerA < aIntegerB ? -1 : (aIntegerA > aIntegerB ? 1 : 0);
+  }
+  return aStringA.compare(aStringB);
+}
+
+/*
+ * Serializes a Lua table (and everything it references) into the dataset format
+ */
+class Builder {
+  public:
+  explicit Builder(lua_State *aState) : fState(aState) {
+    fOut.append(MAGIC);
+    fOut.append(reinterpret_cast<const char *>(&FORMAT_VERSION), sizeof(FORMAT_VERSION));
+    fOut.append(sizeof(Cell), '\0');
+  }
+
+  std::string build(int aIdx) {
+    Cell root = makeCell(lua_absindex(fState, aIdx));
+    std::memcpy(fOut.data() + ROOT_OFFSET, &root, sizeof(root));
+    return std::move(fOut);
+  }
+
+  private:
+  Cell makeCell(int aIdx) {
+    using namespace std::string_literals;
+    Cell cell{};
+    switch (lua_type(fState, aIdx)) {
+      case LUA_TNIL:cell.fType = CellType::NIL;
+        break;
+      case LUA_TBOOLEAN:cell.fType = lua_toboolean(fState, aIdx) ? CellType::BOOLEAN_TRUE : CellType::BOOLEAN_FALSE;
+        break;
+      case LUA_TNUMBER:
+        if (lua_isinteger(fState, aIdx)) {
+          cell.fType = CellType::INTEGER;
+          cell.fPayload = static_cast<std::uint64_t>(lua_tointeger(fState, aIdx));
+        } else {
+          cell.fType = CellType::FLOAT;
+          lua_Number number = lua_tonumber(fState, aIdx);
+          std::memcpy(&cell.fPayload, &number, sizeof(number));
+        }
+        break;
+      case LUA_TSTRING: {
+        std::size_t length;
+        const char *data = lua_tolstring(fState, aIdx, &length);
+        if (length > UINT32_MAX) {
+          throw RuntimeError("Dataset strings are limited to 4GB");
+        }
+        cell.fType = CellType::STRING;
+        cell.fLength = static_cast<std::uint32_t>(length);
+        cell.fPayload = internString({data, length});
+        break;
+      }
+      case LUA_TTABLE:cell.fType = CellType::TABLE;
+        cell.fPayload = writeTable(aIdx);
+        break;
+      default:throw RuntimeError("Cannot store a "s + luaL_typename(fState, aIdx) + " value in a dataset"s);
+    }
+    return cell;
+  }
+
+  std::uint64_t internString(std::string_view aString) {
+    auto it = fStrings.find(std::string{aString});
+    if (it!=fStrings.end()) {
+      return it->second;
+    }
+    std::uint64_t offset = fOut.size();
+    fOut.append(aString);
+    fStrings.emplace(aString, offset);
+    return offset;
+  }
+
+  std::uint64_t writeTable(int aIdx) {
+    using namespace std::string_literals;
+    auto [it, inserted] = fTables.emplace(lua_topointer(fState, aIdx), 0);
+    if (!inserted) {
+      return it->second;
+    }
+    luaL_checkstack(fState, 4, "dataset: tables too deeply nested");
+
+    // The sequence part holds keys 1..n up to the first hole; keys after it are fields
+    std::size_t sequenceCount = 0;
+    while (lua_rawgeti(fState, aIdx, static_cast<lua_Integer>(sequenceCount + 1))!=LUA_TNIL) {
+      lua_pop(fState, 1);
+      ++sequenceCount;
+    }
+    lua_pop(fState, 1);
+
+    struct Field {
+      bool fIsInteger;
+      lua_Integer fInteger;
+      std::string fString;
+      int fValueRef;
+    };
+    std::vector<Field> fields;
+    auto releaseRefs = makeScopeGuard([&]() {
+      for (auto const &field : fields) {
+        luaL_unref(fState, LUA_REGISTRYINDEX, field.fValueRef);
+      }
+    });
+    lua_pushnil(fState);
+    while (lua_next(fState, aIdx)) {
+      int keyIdx = lua_gettop(fState) - 1;
+      Field field{};
+      if (lua_isinteger(fState, keyIdx)) {
+        field.fIsInteger = true;
+        field.fInteger = lua_tointeger(fState, keyIdx);
+        if (field.fInteger >= 1 && static_cast<std::size_t>(field.fInteger) <= sequenceCount) {
+          lua_pop(fState, 1);
+          continue;
+        }
+      } else if (lua_type(fState, keyIdx)==LUA_TSTRING) {
+        std::size_t length;
+        const char *data = lua_tolstring(fState, keyIdx, &length);
+        field.fString.assign(data, length);
+      } else {
+        throw RuntimeError("Dataset keys must be strings or integers, not "s + luaL_typename(fState, keyIdx));
+      }
+      field.fValueRef = luaL_ref(fState, LUA_REGISTRYINDEX);
+      fields.push_back(std::move(field));
+    }
+    std::sort(fields.begin(), fields.end(), [](Field const &aA, Field const &aB) {
+      return compareKeys(aA.fIsInteger, aA.fInteger, aA.fString, aB.fIsInteger, aB.fInteger, aB.fString) < 0;
+    });
+    if (sequenceCount > UINT32_MAX || fields.size() > UINT32_MAX) {
+      throw RuntimeError("Dataset tables are limited to 2^32 entries");
+    }
+
+    // Reserve the node before writing the children, so references back to it resolve
+    fOut.append((8 - fOut.size()%8)%8, '\0');
+    std::uint64_t node = fOut.size();
+    it->second = node;
+    TableNode header{static_cast<std::uint32_t>(sequenceCount), static_cast<std::uint32_t>(fields.size())};
+    fOut.append(sizeof(TableNode) + (sequenceCount + 2*fields.size())*sizeof(Cell), '\0');
+    std::memcpy(fOut.data() + node, &header, sizeof(header));
+
+    for (std::size_t i = 0; i < sequenceCount; ++i) {
+      lua_rawgeti(fState, aIdx, static_cast<lua_Integer>(i + 1));
+      Cell value = makeCell(lua_gettop(fState));
+      lua_pop(fState, 1);
+      std::memcpy(fOut.data() + View::sequenceCell(node, i), &value, sizeof(value));
+    }
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+      Cell key{};
+      if (fields[i].fIsInteger) {
+        key.fType = CellType::INTEGER;
+        key.fPayload = static_cast<std::uint64_t>(fields[i].fInteger);
+      } else {
+        key.fType = CellType::STRING;
+        key.fLength = static_cast<std::uint32_t>(fields[i].fString.size());
+        key.fPayload = internString(fields[i].fString);
+      }
+      lua_rawgeti(fState, LUA_REGISTRYINDEX, fields[i].fValueRef);
+      Cell value = makeCell(lua_gettop(fState));
+      lua_pop(fState, 1);
+      auto offset = View::fieldCell(node, header, i);
+      std::memcpy(fOut.data() + offset, &key, sizeof(key));
+      std::memcpy(fOut.data() + offset + sizeof(Cell), &value, sizeof(value));
+    }
+    return node;
+  }
+
+  lua_State *fState;
+  std::string fOut;
+  std::unordered_map<std::string, std::uint64_t> fStrings;
+  std::unordered_map<const void *, std::uint64_t> fTables;
+};
+
+/*
+ * Owner of the bytes of a dataset: either a string in memory or a mapped file
+ */
+class Storage {
+  public:
+  explicit Storage(std::string aBytes) : fBytes(std::move(aBytes)), fContents(fBytes) {}
+
+  explicit Storage(std::unique_ptr<MappedFile> aFile) : fFile(std::move(aFile)), fContents(fFile->contents()) {}
+
+  Storage(Storage const &) = delete;
+
+  Storage &operator=(Storage const &) = delete;
+
+  [[nodiscard]] View view() const {
+    return {fContents.data(), fContents.size()};
+  }
+
+  [[nodiscard]] std::string_view bytes() const {
+    return fContents;
+  }
+
+  private:
+  std::string fBytes;
+  std::unique_ptr<MappedFile> fFile;
+  std::string_view fContents;
+};
+
+/*
+ * The userdata behind every table of a dataset seen from Lua. Handles are plain data:
+ * the storage is kept alive by an owner userdata (holding a shared_ptr) that every handle
+ * references as its user value, so only the one owner per state needs a finalizer.
+ */
+struct Handle {
+  const Storage *fStorage;
+  std::uint64_t fNode;
+};
+
+using Owner = std::shared_ptr<const Storage>;
+
+inline constexpr const char *METATABLE_NAME = "luabind.Dataset";
+inline constexpr const char *OWNER_METATABLE_NAME = "luabind.DatasetOwner";
+
+/*
+ * Registry key (by address) of each state's cache of table handles. The cache maps a
+ * node's address to its userdata and has weak values, so a table read repeatedly is
+ * one allocation, and the same table always compares equal to itself.
+ */
+inline const char CACHE_KEY = 0;
+
+/*
+ * For __index and __len, which Lua only calls with a handle since the metatable is
+ * locked; functions a script can call directly use checkHandle.
+ */
+inline Handle &toHandle(lua_State *aState) {
+  return *static_cast<Handle *>(lua_touserdata(aState, 1));
+}
+
+inline Handle &checkHandle(lua_State *aState) {
+  return *static_cast<Handle *>(luaL_checkudata(aState, 1, METATABLE_NAME));
+}
+
+inline int index(lua_State *aState);
+
+inline int length(lua_State *aState);
+
+inline int pairs(lua_State *aState);
+
+inline int readOnly(lua_State *aState) {
+  return luaL_error(aState, "dataset tables are read-only");
+}
+
+inline int collectOwner(lua_State *aState) {
+  static_cast<Owner *>(lua_touserdata(aState, 1))->~Owner();
+  return 0;
+}
+
+/*
+ * Pushes the cached handle for aKey and returns true, or pushes the cache and returns false
+ */
+inline bool pushCachedHandle(lua_State *aState, const void *aKey) {
+  luaL_checkstack(aState, 4, "dataset");
+  if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &CACHE_KEY)==LUA_TNIL) {
+    lua_pop(aState, 1);
+    lua_newtable(aState);
+    lua_createtable(aState, 0, 1);
+    lua_pushstring(aState, "v");
+    lua_setfield(aState, -2, "__mode");
+    lua_setmetatable(aState, -2);
+    lua_pushvalue(aState, -1);
+    lua_rawsetp(aState, LUA_REGISTRYINDEX, &CACHE_KEY);
+  }
+  if (lua_rawgetp(aState, -1, aKey)!=LUA_TNIL) {
+    lua_remove(aState, -2);
+    return true;
+  }
+  lua_pop(aState, 1);
+  return false;
+}
+
+/*
+ * With the cache and the owner on top of the stack, replaces them with a new handle
+ */
+inline void newHandle(lua_State *aState, const Storage *aStorage, std::uint64_t aNode, const void *aKey) {
+  new(lua_newuserdatauv(aState, sizeof(Handle), 1)) Handle{aStorage, aNode};
+  if (luaL_newmetatable(aState, METATABLE_NAME)) {
+    static const luaL_Reg metamethods[] = {
+        {"__index", &index},
+        {"__newindex", &readOnly},
+        {"__len", &length},
+        {"__pairs", &pairs},
+        {nullptr, nullptr}
+    };
+    luaL_setfuncs(aState, metamethods, 0);
+    lua_pushstring(aState, "dataset");
+    lua_setfield(aState, -2, "__metatable");
+  }
+  lua_setmetatable(aState, -2);
+  lua_insert(aState, -2);
+  lua_setiuservalue(aState, -2, 1);
+  lua_pushvalue(aState, -1);
+  lua_rawsetp(aState, -3, aKey);
+  lua_remove(aState, -2);
+}
+
+/*
+ * Pushes the handle of a table reached from the handle at aFromIdx
+ */
+inline void pushTable(lua_State *aState, Handle const &aFrom, int aFromIdx, std::uint64_t aNode) {
+  const void *key = aFrom.fStorage->view().data() + aNode;
+  if (pushCachedHandle(aState, key)) {
+    return;
+  }
+  lua_getiuservalue(aState, aFromIdx, 1);
+  newHandle(aState, aFrom.fStorage, aNode, key);
+}
+
+/*
+ * Pushes the value of aCell, read from the handle at aFromIdx, or returns false if it is
+ * malformed
+ */
+inline bool pushCell(lua_State *aState, Handle const &aFrom, int aFromIdx, Cell const &aCell) {
+  switch (aCell.fType) {
+    case CellType::NIL:lua_pushnil(aState);
+      return true;
+    case CellType::BOOLEAN_FALSE:lua_pushboolean(aState, false);
+      return true;
+    case CellType::BOOLEAN_TRUE:lua_pushboolean(aState, true);
+      return true;
+    case CellType::INTEGER:lua_pushinteger(aState, static_cast<lua_Integer>(aCell.fPayload));
+      return true;
+    case CellType::FLOAT: {
+      lua_Number number;
+      std::memcpy(&number, &aCell.fPayload, sizeof(number));
+      lua_pushnumber(aState, number);
+      return true;
+    }
+    case CellType::STRING: {
+      std::string_view string;
+      if (!aFrom.fStorage->view().string(aCell, string)) {
+        return false;
+      }
+      lua_pushlstring(aState, string.data(), string.size());
+      return true;
+    }
+    case CellType::TABLE:pushTable(aState, aFrom, aFromIdx, aCell.fPayload);
+      return true;
+    default:return false;
+  }
+}
+
+/*
+ * Pushes the root value of aStorage
+ */
+inline bool pushRoot(lua_State *aState, Owner const &aStorage) {
+  Cell root;
+  if (!aStorage->view().cell(ROOT_OFFSET, root)) {
+    return false;
+  }
+  if (root.fType!=CellType::TABLE) {
+    return pushCell(aState, Handle{aStorage.get(), 0}, 0, root);
+  }
+  const void *key = aStorage->view().data() + root.fPayload;
+  if (pushCachedHandle(aState, key)) {
+    return true;
+  }
+  new(lua_newuserdatauv(aState, sizeof(Owner), 0)) Owner{aStorage};
+  if (luaL_newmetatable(aState, OWNER_METATABLE_NAME)) {
+    lua_pushcfunction(aState, &collectOwner);
+    lua_setfield(aState, -2, "__gc");
+  }
+  lua_setmetatable(aState, -2);
+  newHandle(aState, aStorage.get(), root.fPayload, key);
+  return true;
+}
+
+/*
+ * Finds the field with the key at aKeyIdx by binary search. Returns its index, or
+ * aHeader.fFieldCount if there is none. Sets aMalformed on out-of-bounds data.
+ */
+inline std::uint64_t findField(lua_State *aState, View const &aView, std::uint64_t aNode, TableNode const &aHeader,
+                               int aKeyIdx, bool &aMalformed) {
+  bool isInteger = lua_isinteger(aState, aKeyIdx);
+  lua_Integer integer = 0;
+  std::string_view string;
+  if (isInteger) {
+    integer = lua_tointeger(aState, aKeyIdx);
+  } else if (lua_type(aState, aKeyIdx)==LUA_TNUMBER) {
+    // Like a table, a float key with an integral value finds the integer key
+    int exact;
+    integer = lua_tointegerx(aState, aKeyIdx, &exact);
+    if (!exact) {
+      return aHeader.fFieldCount;
+    }
+    isInteger = true;
+  } else if (lua_type(aState, aKeyIdx)==LUA_TSTRING) {
+    std::size_t length;
+    const char *data = lua_tolstring(aState, aKeyIdx, &length);
+    string = {data, length};
+  } else {
+    return aHeader.fFieldCount;
+  }
+
+  std::uint64_t low = 0;
+  std::uint64_t high = aHeader.fFieldCount;
+  while (low < high) {
+    std::uint64_t mid = low + (high - low)/2;
+    Cell key;
+    std::string_view keyString;
+    if (!aView.cell(View::fieldCell(aNode, aHeader, mid), key)
+        || (key.fType==CellType::STRING && !aView.string(key, keyString))) {
+      aMalformed = true;
+      return aHeader.fFieldCount;
+    }
+    int order = compareKeys(key.fType==CellType::INTEGER, static_cast<lua_Integer>(key.fPayload), keyString,
+                            isInteger, integer, string);
+    if (order==0) {
+      return mid;
+    }
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return aHeader.fFieldCount;
+}
+
+/*
+ * Resolves the key at aKeyIdx to the offset of its value cell, or 0 if absent
+ */
+inline std::uint64_t findValue(lua_State *aState, Handle const &aHandle, TableNode const &aHeader, int aKeyIdx,
+                               bool &aMalformed) {
+  int isInteger = 0;
+  auto key = lua_type(aState, aKeyIdx)==LUA_TNUMBER ? lua_tointegerx(aState, aKeyIdx, &isInteger) : 0;
+  if (isInteger) {
+    if (key >= 1 && static_cast<std::uint64_t>(key) <= aHeader.fSequenceCount) {
+      return View::sequenceCell(aHandle.fNode, static_cast<std::uint64_t>(key - 1));
+    }
+  }
+  View view = aHandle.fStorage->view();
+  auto field = findField(aState, view, aHandle.fNode, aHeader, aKeyIdx, aMalformed);
+  return field==aHeader.fFieldCount ? 0 : View::fieldCell(aHandle.fNode, aHeader, field) + sizeof(Cell);
+}
+
+inline int index(lua_State *aState) {
+  auto &handle = toHandle(aState);
+  View view = handle.fStorage->view();
+  TableNode header;
+  bool malformed = !view.node(handle.fNode, header);
+  std::uint64_t offset = malformed ? 0 : findValue(aState, handle, header, 2, malformed);
+  Cell cell;
+  if (!malformed && offset==0) {
+    lua_pushnil(aState);
+    return 1;
+  }
+  if (malformed || !view.cell(offset, cell) || !pushCell(aState, handle, 1, cell)) {
+    return luaL_error(aState, "malformed dataset");
+  }
+  return 1;
+}
+
+inline int length(lua_State *aState) {
+  auto &handle = toHandle(aState);
+  TableNode header;
+  if (!handle.fStorage->view().node(handle.fNode, header)) {
+    return luaL_error(aState, "malformed dataset");
+  }
+  lua_pushinteger(aState, header.fSequenceCount);
+  return 1;
+}
+
+/*
+ * The iterator behind __pairs: sequence entries in order, then the other fields in key
+ * order. Stateless, like next(): the position is recovered from the previous key.
+ */
+inline int next(lua_State *aState) {
+  auto &handle = checkHandle(aState);
+  lua_settop(aState, 2);
+  View view = handle.fStorage->view();
+  TableNode header;
+  bool malformed = !view.node(handle.fNode, header);
+  std::uint64_t position = 0; // Entries are numbered sequence first, then fields
+  if (!malformed && !lua_isnil(aState, 2)) {
+    if (lua_isinteger(aState, 2) && lua_tointeger(aState, 2) >= 1
+        && static_cast<std::uint64_t>(lua_tointeger(aState, 2)) <= header.fSequenceCount) {
+      position = static_cast<std::uint64_t>(lua_tointeger(aState, 2));
+    } else {
+      auto field = findField(aState, view, handle.fNode, header, 2, malformed);
+      if (!malformed && field==header.fFieldCount) {
+        return luaL_error(aState, "invalid key to 'next'");
+      }
+      position = header.fSequenceCount + field + 1;
+    }
+  }
+  if (malformed) {
+    return luaL_error(aState, "malformed dataset");
+  }
+
+  Cell key;
+  Cell value;
+  if (position < header.fSequenceCount) {
+    lua_pushinteger(aState, static_cast<lua_Integer>(position + 1));
+    if (!view.cell(View::sequenceCell(handle.fNode, position), value) || !pushCell(aState, handle, 1, value)) {
+      return luaL_error(aState, "malformed dataset");
+    }
+    return 2;
+  }
+  std::uint64_t field = position - header.fSequenceCount;
+  if (field >= header.fFieldCount) {
+    lua_pushnil(aState);
+    return 1;
+  }
+  auto offset = View::fieldCell(handle.fNode, header, field);
+  if (!view.cell(offset, key) || !view.cell(offset + sizeof(Cell), value)
+      || !pushCell(aState, handle, 1, key) || !pushCell(aState, handle, 1, value)) {
+    return luaL_error(aState, "malformed dataset");
+  }
+  return 2;
+}
+
+inline int pairs(lua_State *aState) {
+  checkHandle(aState);
+  lua_pushcfunction(aState, &next);
+  lua_pushvalue(aState, 1);
+  lua_pushnil(aState);
+  return 3;
+}
+}
+
+namespace luabind {
+/*
+ * A Dataset is a read-only tree of tables built once and shared by any number of states,
+ * on any threads, without copying: every state sees it through userdata that reads the
+ * one immutable byte buffer (or memory-mapped file) directly, so memory use doesn't grow
+ * with the number of states.
+ *
+ *   auto dataset = luabind::Dataset::fromValue(std::map<std::string, std::vector<int>>{...});
+ *   // or Dataset::fromLua(lua, "reference"), or Dataset::load("reference.lbds")
+ *   dataset.installGlobal(worker, "reference");
+ *
+ * From Lua, dataset tables behave like read-only tables: indexing, # and pairs work
+ * (ipairs too, through __index), and assignment raises an error. Values are nil,
+ * booleans, numbers, strings and tables; keys are strings or integers. Strings are copied
+ * into the state when read. Because they are userdata, dataset tables are not accepted
+ * by functions that require real tables, such as table.concat or next.
+ */
+class Dataset {
+  public:
+  /*
+   * Builds a dataset from the value at aIdx of aState's stack
+   */
+  static Dataset fromStack(lua_State *aState, int aIdx) {
+    int top = lua_gettop(aState);
+    auto guard = detail::makeScopeGuard([aState, top]() { lua_settop(aState, top); });
+    return fromBytes(detail::dataset::Builder(aState).build(aIdx));
+  }
+
+  static Dataset fromLua(Lua &aLua, const std::string_view aGlobalName) {
+    lua_getglobal(aLua.state(), aGlobalName.data());
+    auto guard = detail::makeScopeGuard([&aLua]() { lua_pop(aLua.state(), 1); });
+    return fromStack(aLua.state(), -1);
+  }
+
+  /*
+   * Builds a dataset from any C++ value that luabind can convert to Lua
+   */
+  template <typename T>
+  static Dataset fromValue(T const &aValue) {
+    Lua builder;
+    detail::toLua(builder.state(), aValue);
+    return fromStack(builder.state(), -1);
+  }
+
+  /*
+   * Adopts bytes previously produced by bytes() or save()
+   */
+  static Dataset fromBytes(std::string aBytes) {
+    validate(aBytes.data(), aBytes.size());
+    return Dataset{std::make_shared<detail::dataset::Storage>(std::move(aBytes))};
+  }
+
+  /*
+   * Opens a file written by save(). Where mmap is available the file is mapped rather
+   * than read, so the pages are shared with every other process mapping it too.
+   */
+  static Dataset load(std::string const &aPath) {
+    auto storage = std::make_shared<detail::dataset::Storage>(std::make_unique<detail::MappedFile>(aPath));
+    auto bytes = storage->bytes();
+    validate(bytes.data(), bytes.size());
+    return Dataset{std::move(storage)};
+  }
+
+  void save(std::string const &aPath) const {
+    using namespace std::string_literals;
+    std::ofstream file(aPath, std::ios::binary | std::ios::trunc);
+    auto bytes = this->bytes();
+    if (!file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+      throw FileError("Cannot write dataset "s + aPath);
+    }
+  }
+
+  [[nodiscard]] std::string_view bytes() const {
+    return fStorage->bytes();
+  }
+
+  /*
+   * Pushes the root value onto aState's stack
+   */
+  void push(lua_State *aState) const {
+    if (!detail::dataset::pushRoot(aState, fStorage)) {
+      throw RuntimeError("Malformed dataset");
+    }
+  }
+
+  void installGlobal(Lua &aLua, const std::string_view aGlobalName) const {
+    push(aLua.state());
+    lua_setglobal(aLua.state(), aGlobalName.data());
+  }
+
+  private:
+  explicit Dataset(std::shared_ptr<const detail::dataset::Storage> aStorage)
+      : fStorage(std::move(aStorage)) {}
+
+  static void validate(const char *aData, std::size_t aSize) {
+    std::uint32_t version = 0;
+    if (aSize < detail::dataset::ROOT_OFFSET + sizeof(detail::dataset::Cell)
+        || std::string_view(aData, detail::dataset::MAGIC.size())!=detail::dataset::MAGIC) {
+      throw RuntimeError("Not a luabind dataset");
+    }
+    std::memcpy(&version, aData + detail::dataset::MAGIC.size(), sizeof(version));
+    if (version!=detail::dataset::FORMAT_VERSION) {
+      throw RuntimeError("Unsupported dataset format version " + std::to_string(version));
+    }
+  }
+
+  std::shared_ptr<const detail::dataset::Storage> fStorage;
+};
+}
+
+#endif //LUABIND_DATASET_HPP
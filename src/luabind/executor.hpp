@@ -0,0 +1,278 @@
+#ifndef LUABIND_EXECUTOR_HPP
+#define LUABIND_EXECUTOR_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace luabind::detail::executor {
+inline constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+/*
+ * A call queued on a StateExecutor. Tasks are the nodes of the queue itself, so queuing
+ * one allocates nothing beyond the task.
+ */
+class Task {
+  public:
+  virtual ~Task() = default;
+
+  virtual void run(Lua &aLua) = 0;
+
+  Task *fNext = nullptr;
+};
+
+/*
+ * A task fulfilling a promise with the result (or exception) of aFunction(lua)
+ */
+template <typename Function>
+class PromisedTask final : public Task {
+  public:
+  using Result = std::invoke_result_t<Function &, Lua &>;
+
+  explicit PromisedTask(Function aFunction) : fFunction(std::move(aFunction)) {}
+
+  std::future<Result> future() {
+    return fPromise.get_future();
+  }
+
+  void run(Lua &aLua) override {
+    try {
+      if constexpr (std::is_void_v<Result>) {
+        fFunction(aLua);
+        fPromise.set_value();
+      } else {
+        fPromise.set_value(fFunction(aLua));
+      }
+    } catch (...) {
+      fPromise.set_exception(std::current_exception());
+    }
+  }
+
+  private:
+  Function fFunction;
+  std::promise<Result> fPromise;
+};
+
+/*
+ * TaskQueue is an unbounded lock-free queue for many producers and one consumer.
+ * Producers push onto a linked stack with one compare-and-swap; the consumer takes the
+ * whole stack with one exchange and reverses it into submission order, so draining a
+ * batch of any size costs it a single atomic operation.
+ */
+class TaskQueue {
+  public:
+  /*
+   * Returns true if the queue was empty, in which case the consumer may need waking
+   */
+  bool push(Task *aTask) {
+    auto *head = fHead.load(std::memory_order_relaxed);
+    do {
+      aTask->fNext = head;
+    } while (!fHead.compare_exchange_weak(head, aTask));
+    return head==nullptr;
+  }
+
+  /*
+   * Removes every queued task and returns them as a list, oldest first, adding their
+   * number to aCount
+   */
+  Task *takeAll(std::uint64_t &aCount) {
+    if (fHead.load(std::memory_order_relaxed)==nullptr) {
+      return nullptr;
+    }
+    auto *task = fHead.exchange(nullptr);
+    Task *ordered = nullptr;
+    while (task!=nullptr) {
+      auto *next = task->fNext;
+      task->fNext = ordered;
+      ordered = task;
+      task = next;
+      ++aCount;
+    }
+    return ordered;
+  }
+
+  private:
+  alignas(CACHE_LINE_SIZE) std::atomic<Task *> fHead{nullptr};
+};
+}
+
+namespace luabind {
+struct ExecutorStats {
+  std::uint64_t fCalls = 0;
+  std::uint64_t fBatches = 0; // Times the executor found the queue non-empty and drained it
+
+  [[nodiscard]] double meanBatchSize() const {
+    return fBatches==0 ? 0.0 : static_cast<double>(fCalls)/static_cast<double>(fBatches);
+  }
+};
+
+/*
+ * A StateExecutor owns one luabind::Lua on a thread of its own and runs calls into it
+ * on behalf of any number of threads, one at a time, in the order they were submitted.
+ * It is for state that can't be replicated into a StatePool: every thread sees the same
+ * globals and tables, and none of them needs a lock.
+ *
+ *   luabind::StateExecutor executor([](luabind::Lua &aLua) { aLua << "hits = 0  function hit(n) hits = hits + n return hits end"; });
+ *   std::future<int> total = executor.call<int>("hit", 5);                 // from any thread
+ *   auto keys = executor.submit([](luabind::Lua &aLua) { return aLua["hits"].as<int>(); });
+ *
+ * Submitting is lock-free: a call is pushed onto a queue with one compare-and-swap, and
+ * the executor thread takes everything queued so far with one exchange and runs it as a
+ * batch. The thread spins briefly and then sleeps when there is nothing to do, and is
+ * only woken by a submission that finds the queue empty, so a busy executor costs its
+ * callers no system calls. Results and exceptions (including Lua errors) are delivered
+ * through the returned futures.
+ *
+ * The initializer runs on the executor thread before any call; if it throws, the
+ * constructor rethrows. The destructor runs every call already submitted and then stops
+ * the thread; nothing may be submitted once it has started. Calls must not wait for
+ * futures of the same executor, which would deadlock.
+ */
+class StateExecutor {
+  public:
+  using Initializer = std::function<void(Lua &)>;
+
+  explicit StateExecutor(Initializer aInit = {}) {
+    std::promise<void> ready;
+    auto started = ready.get_future();
+    fThread = std::thread([this, &aInit, &ready]() { threadMain(aInit, ready); });
+    try {
+      started.get();
+    } catch (...) {
+      fThread.join();
+      throw;
+    }
+  }
+
+  StateExecutor(StateExecutor const &) = delete;
+
+  StateExecutor &operator=(StateExecutor const &) = delete;
+
+  ~StateExecutor() {
+    fStopping.store(true);
+    fEvents.fetch_add(1);
+    fEvents.notify_one();
+    fThread.join();
+  }
+
+  /*
+   * Queues aFunction(lua) and returns a future for its result
+   */
+  template <typename Function>
+  auto submit(Function aFunction) {
+    auto *task = new detail::executor::PromisedTask<Function>(std::move(aFunction));
+    auto future = task->future();
+    if (fQueue.push(task)) {
+      fEvents.fetch_add(1);
+      if (fSleeping.load()) {
+        fEvents.notify_one();
+      }
+    }
+    return future;
+  }
+
+  /*
+   * Queues a call of the global function aFunctionName with copies of aArgs, converting
+   * its result to Result. Use submit() for calls whose results are ignored.
+   */
+  template <typename Result, typename ...Args>
+  std::future<Result> call(std::string aFunctionName, Args ...aArgs) {
+    static_assert(!std::is_void_v<Result>, "Use submit() for calls without a result");
+    return submit([name = std::move(aFunctionName), args = std::make_tuple(std::move(aArgs)...)](Lua &aLua) {
+      return std::apply([&](auto const &... aArgs) { return aLua[name](aArgs...).template as<Result>(); }, args);
+    });
+  }
+
+  /*
+   * Counters, including the batch that is running
+   */
+  [[nodiscard]] ExecutorStats stats() const {
+    return {fCalls.load(std::memory_order_relaxed), fBatches.load(std::memory_order_relaxed)};
+  }
+
+  private:
+  static inline constexpr int SPIN_COUNT = 64;
+
+  void threadMain(Initializer const &aInit, std::promise<void> &aReady) {
+    std::optional<Lua> lua;
+    try {
+      lua.emplace();
+      if (aInit) {
+        aInit(*lua);
+      }
+    } catch (...) {
+      aReady.set_exception(std::current_exception());
+      return;
+    }
+    aReady.set_value();
+
+    while (auto *task = nextBatch()) {
+      while (task!=nullptr) {
+        auto *next = task->fNext;
+        task->run(*lua);
+        delete task;
+        task = next;
+      }
+    }
+  }
+
+  /*
+   * Waits for queued tasks and takes them all, or returns nullptr once stopping with
+   * nothing left to run. The event counter is read before each look at the queue, so a
+   * submission between an empty look and going to sleep makes the wait return at once.
+   */
+  detail::executor::Task *nextBatch() {
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+      if (auto *batch = takeBatch()) {
+        return batch;
+      }
+    }
+    while (true) {
+      auto seen = fEvents.load();
+      if (auto *batch = takeBatch()) {
+        return batch;
+      }
+      if (fStopping.load()) {
+        return nullptr;
+      }
+      fSleeping.store(true);
+      fEvents.wait(seen);
+      fSleeping.store(false);
+    }
+  }
+
+  /*
+   * Takes the queued tasks, counting them before any has run
+   */
+  detail::executor::Task *takeBatch() {
+    std::uint64_t count = 0;
+    auto *batch = fQueue.takeAll(count);
+    if (batch!=nullptr) {
+      fCalls.fetch_add(count, std::memory_order_relaxed);
+      fBatches.fetch_add(1, std::memory_order_relaxed);
+    }
+    return batch;
+  }
+
+  detail::executor::TaskQueue fQueue;
+  alignas(detail::executor::CACHE_LINE_SIZE) std::atomic<std::uint32_t> fEvents{0};
+  std::atomic<bool> fSleeping{false};
+  std::atomic<bool> fStopping{false};
+  alignas(detail::executor::CACHE_LINE_SIZE) std::atomic<std::uint64_t> fCalls{0};
+  std::atomic<std::uint64_t> fBatches{0};
+  std::thread fThread;
+};
+}
+
+#endif //LUABIND_EXECUTOR_HPP
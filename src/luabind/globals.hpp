@@ -0,0 +1,274 @@
+#ifndef LUABIND_GLOBALS_HPP
+#define LUABIND_GLOBALS_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace luabind::detail::globals {
+/*
+ * A C++ value bound to a global name. Both operations run inside a Lua C function, so
+ * they report failure by pushing an error message and returning false rather than
+ * throwing or raising: the caller raises once the C++ frames are gone.
+ */
+class Variable {
+  public:
+  virtual ~Variable() = default;
+
+  virtual bool push(lua_State *aState) = 0;
+
+  virtual bool assign(lua_State *aState, int aIdx) = 0;
+};
+
+template <typename T>
+class PointerVariable final : public Variable {
+  public:
+  explicit PointerVariable(T *aVariable) : fVariable(aVariable) {}
+
+  bool push(lua_State *aState) override {
+    toLua(aState, *fVariable);
+    return true;
+  }
+
+  bool assign(lua_State *aState, int aIdx) override {
+    if constexpr (std::is_const_v<T>) {
+      lua_pushstring(aState, "read-only");
+      return false;
+    } else {
+      auto value = tryFromLua<T>(aState, aIdx);
+      if (!value) {
+        lua_pushstring(aState, value.reason());
+        return false;
+      }
+      *fVariable = std::move(*value);
+      return true;
+    }
+  }
+
+  private:
+  T *fVariable;
+};
+
+/*
+ * A value read and written through callables. Setter is std::nullptr_t for read-only
+ * properties; otherwise it takes the value as its only argument.
+ */
+template <typename Getter, typename Setter>
+class AccessorVariable final : public Variable {
+  public:
+  AccessorVariable(Getter aGetter, Setter aSetter) : fGetter(std::move(aGetter)), fSetter(std::move(aSetter)) {}
+
+  bool push(lua_State *aState) override {
+    try {
+      toLua(aState, fGetter());
+      return true;
+    } catch (std::exception &e) {
+      lua_pushstring(aState, e.what());
+      return false;
+    }
+  }
+
+  bool assign(lua_State *aState, int aIdx) override {
+    if constexpr (std::is_same_v<Setter, std::nullptr_t>) {
+      lua_pushstring(aState, "read-only");
+      return false;
+    } else {
+      using Value = std::decay_t<std::tuple_element_t<0, typename traits::function_traits<Setter>::ArgumentTypes>>;
+      auto value = tryFromLua<Value>(aState, aIdx);
+      if (!value) {
+        lua_pushstring(aState, value.reason());
+        return false;
+      }
+      try {
+        fSetter(std::move(*value));
+        return true;
+      } catch (std::exception &e) {
+        lua_pushstring(aState, e.what());
+        return false;
+      }
+    }
+  }
+
+  private:
+  Getter fGetter;
+  Setter fSetter;
+};
+
+inline constexpr const char *VARIABLE_METATABLE_NAME = "luabind.BoundVariable";
+
+/*
+ * Key (by address) under which the metatable of the globals table holds the table of
+ * bound variables (name -> userdata owning a Variable)
+ */
+inline const char VARIABLES_KEY = 0;
+
+using VariableHandle = std::unique_ptr<Variable>;
+
+inline int collectVariable(lua_State *aState) {
+  static_cast<VariableHandle *>(lua_touserdata(aState, 1))->~VariableHandle();
+  return 0;
+}
+
+/*
+ * Raises "bound variable 'name': <message on top of the stack>"
+ */
+inline int raiseVariableError(lua_State *aState) {
+  lua_pushfstring(aState, "bound variable '%s': %s", lua_tostring(aState, 2), lua_tostring(aState, -1));
+  return lua_error(aState);
+}
+
+/*
+ * __index and __newindex of the globals table. They only run for names with no raw
+ * global, which bound names never have. Other names go to whatever metamethods the
+ * globals table had before (upvalue 2), so binding variables composes with strict-mode
+ * scripts or other lazily resolved globals.
+ */
+inline int index(lua_State *aState) {
+  lua_settop(aState, 2);
+  lua_pushvalue(aState, 2);
+  if (lua_rawget(aState, lua_upvalueindex(1))==LUA_TUSERDATA) {
+    auto &variable = **static_cast<VariableHandle *>(lua_touserdata(aState, -1));
+    return variable.push(aState) ? 1 : raiseVariableError(aState);
+  }
+  lua_pop(aState, 1);
+  switch (lua_type(aState, lua_upvalueindex(2))) {
+    case LUA_TNIL:lua_pushnil(aState);
+      return 1;
+    case LUA_TFUNCTION:lua_pushvalue(aState, lua_upvalueindex(2));
+      lua_insert(aState, 1);
+      lua_call(aState, 2, 1);
+      return 1;
+    default:lua_gettable(aState, lua_upvalueindex(2));
+      return 1;
+  }
+}
+
+inline int newIndex(lua_State *aState) {
+  lua_settop(aState, 3);
+  lua_pushvalue(aState, 2);
+  if (lua_rawget(aState, lua_upvalueindex(1))==LUA_TUSERDATA) {
+    auto &variable = **static_cast<VariableHandle *>(lua_touserdata(aState, -1));
+    return variable.assign(aState, 3) ? 0 : raiseVariableError(aState);
+  }
+  lua_pop(aState, 1);
+  switch (lua_type(aState, lua_upvalueindex(2))) {
+    case LUA_TNIL:lua_rawset(aState, 1);
+      return 0;
+    case LUA_TFUNCTION:lua_pushvalue(aState, lua_upvalueindex(2));
+      lua_insert(aState, 1);
+      lua_call(aState, 3, 0);
+      return 0;
+    default:lua_settable(aState, lua_upvalueindex(2));
+      return 0;
+  }
+}
+
+/*
+ * Pushes the table of bound variables, installing the metamethods on the globals table
+ * the first time
+ */
+inline void pushVariables(lua_State *aState) {
+  lua_pushglobaltable(aState);
+  if (!lua_getmetatable(aState, -1)) {
+    lua_newtable(aState);
+    lua_pushvalue(aState, -1);
+    lua_setmetatable(aState, -3);
+  }
+  if (lua_rawgetp(aState, -1, &VARIABLES_KEY)==LUA_TTABLE) {
+    lua_replace(aState, -3);
+    lua_pop(aState, 1);
+    return;
+  }
+  lua_pop(aState, 1);
+  int metatableIdx = lua_gettop(aState);
+  lua_newtable(aState);
+  int variablesIdx = lua_gettop(aState);
+
+  auto chain = [&](const char *aEvent, lua_CFunction aFunction) {
+    lua_pushvalue(aState, variablesIdx);
+    lua_getfield(aState, metatableIdx, aEvent);
+    lua_pushcclosure(aState, aFunction, 2);
+    lua_setfield(aState, metatableIdx, aEvent);
+  };
+  chain("__index", &index);
+  chain("__newindex", &newIndex);
+  lua_pushvalue(aState, variablesIdx);
+  lua_rawsetp(aState, metatableIdx, &VARIABLES_KEY);
+
+  lua_replace(aState, -3);
+  lua_pop(aState, 1);
+}
+
+inline void bind(lua_State *aState, const std::string_view aName, VariableHandle aVariable) {
+  pushVariables(aState);
+  lua_pushlstring(aState, aName.data(), aName.size());
+  new(lua_newuserdatauv(aState, sizeof(VariableHandle), 0)) VariableHandle(std::move(aVariable));
+  if (luaL_newmetatable(aState, VARIABLE_METATABLE_NAME)) {
+    lua_pushcfunction(aState, &collectVariable);
+    lua_setfield(aState, -2, "__gc");
+  }
+  lua_setmetatable(aState, -2);
+  lua_rawset(aState, -3);
+  lua_pop(aState, 1);
+
+  // A raw global of the same name would shadow the binding
+  lua_pushglobaltable(aState);
+  lua_pushlstring(aState, aName.data(), aName.size());
+  lua_pushnil(aState);
+  lua_rawset(aState, -3);
+  lua_pop(aState, 1);
+}
+}
+
+namespace luabind {
+/*
+ * Binds the global aName to the C++ variable at aVariable, which must outlive aLua (or be
+ * unbound first). Lua reads the variable's current value every time the global is read,
+ * and assignments to the global convert and write straight into the variable, so values
+ * C++ keeps changing never need to be pushed again. A pointer to const makes the global
+ * read-only.
+ *
+ *   double threshold = 0.5;
+ *   luabind::bindVariable(lua, "threshold", &threshold);
+ *   threshold = 0.7;                  // scripts now see 0.7
+ *   lua << "threshold = 0.9";         // and this sets the C++ variable
+ *
+ * Bound globals are served by __index/__newindex on the globals table, which only run for
+ * names with no ordinary global; any metamethods the table already had still handle all
+ * other names. Each access is a C function call and a conversion, a little slower than an
+ * ordinary global, and pairs(_G) does not list bound names.
+ */
+template <typename T>
+void bindVariable(Lua &aLua, const std::string_view aName, T *aVariable) {
+  detail::globals::bind(aLua.state(), aName, std::make_unique<detail::globals::PointerVariable<T>>(aVariable));
+}
+
+/*
+ * Binds the global aName to a getter and a setter (taking the new value). Without a
+ * setter the global is read-only. Exceptions thrown by either become Lua errors.
+ */
+template <typename Getter, typename Setter = std::nullptr_t>
+void bindProperty(Lua &aLua, const std::string_view aName, Getter aGetter, Setter aSetter = nullptr) {
+  detail::globals::bind(aLua.state(), aName,
+                        std::make_unique<detail::globals::AccessorVariable<Getter, Setter>>(std::move(aGetter),
+                                                                                            std::move(aSetter)));
+}
+
+/*
+ * Removes the binding of aName, leaving the global nil
+ */
+inline void unbindVariable(Lua &aLua, const std::string_view aName) {
+  lua_State *state = aLua.state();
+  detail::globals::pushVariables(state);
+  lua_pushlstring(state, aName.data(), aName.size());
+  lua_pushnil(state);
+  lua_rawset(state, -3);
+  lua_pop(state, 1);
+}
+}
+
+#endif //LUABIND_GLOBALS_HPP
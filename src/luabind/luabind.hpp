@@ -3,17 +3,46 @@
 
 #include "lua.hpp"
 
+#include <atomic>
 #include <concepts>
 #include <optional>
+#include <variant>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 #include <string>
+#include <string_view>
 #include <array>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <iterator>
+#include <unordered_map>
 #include <ranges>
+#include <span>
+#include <charconv>
 #include <algorithm>
+#include <functional>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LUABIND_HAS_MMAP 1
+#else
+#include <fstream>
+#include <iterator>
+#endif
 
 namespace luabind::detail::traits {
 /*
@@ -104,17 +133,50 @@ constexpr bool is_callable_v = std::is_function_v<std::remove_pointer_t<T>> ||
     std::is_member_function_pointer_v<T> ||
     has_call_operator<T>;
 
+/*
+ * A stateless callable is a class type with no data members that can be created on demand,
+ * e.g. a captureless lambda. Every instance behaves the same, so there is nothing to store:
+ * a generated lua_CFunction can construct one in place and call it.
+ */
+template <typename T>
+constexpr bool is_stateless_v = std::is_class_v<T> && std::is_empty_v<T> && std::is_default_constructible_v<T>;
+
 template <typename>
 struct is_vector : std::false_type {
 };
 
-template <typename T>
-struct is_vector<std::vector<T>> : std::true_type {
+template <typename T, typename Allocator>
+struct is_vector<std::vector<T, Allocator>> : std::true_type {
 };
 
 template <typename T>
 constexpr bool is_vector_v = is_vector<T>::value;
 
+/*
+ * std::string and strings with other allocators, such as std::pmr::string
+ */
+template <typename>
+struct is_string : std::false_type {
+};
+
+template <typename Allocator>
+struct is_string<std::basic_string<char, std::char_traits<char>, Allocator>> : std::true_type {
+};
+
+template <typename T>
+constexpr bool is_string_v = is_string<T>::value;
+
+/*
+ * Containers using std::pmr::polymorphic_allocator, which conversions construct with the
+ * current conversion resource
+ */
+template <typename T>
+constexpr bool is_pmr_container_v = false;
+
+template <typename T> requires requires { typename T::allocator_type; typename T::value_type; }
+constexpr bool is_pmr_container_v<T> =
+    std::is_same_v<typename T::allocator_type, std::pmr::polymorphic_allocator<typename T::value_type>>;
+
 template <typename>
 struct is_tuple : std::false_type {
 };
@@ -125,6 +187,34 @@ struct is_tuple<std::tuple<Args...>> : std::true_type {
 
 template <typename T>
 constexpr bool is_tuple_v = is_tuple<T>::value;
+
+template <typename>
+struct is_optional : std::false_type {
+};
+
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {
+};
+
+template <typename T>
+constexpr bool is_optional_v = is_optional<T>::value;
+
+template <typename>
+struct is_variant : std::false_type {
+};
+
+template <typename ...Args>
+struct is_variant<std::variant<Args...>> : std::true_type {
+};
+
+template <typename T>
+constexpr bool is_variant_v = is_variant<T>::value;
+
+/*
+ * Types that stand for nil
+ */
+template <typename T>
+constexpr bool is_nil_v = std::is_same_v<T, std::monostate> || std::is_same_v<T, std::nullptr_t>;
 }
 
 namespace luabind::meta {
@@ -196,7 +286,7 @@ struct table {
 };
 
 namespace literals {
-constexpr DiscriminatorContainer operator ""_f(const char *aStr, const unsigned int aSize) {
+constexpr DiscriminatorContainer operator ""_f(const char *aStr, const std::size_t aSize) {
   DiscriminatorContainer res{};
   std::ranges::copy_n(aStr, std::min(aSize, res.max_size()), res.begin());
   return res;
@@ -215,6 +305,72 @@ template <typename T>
 constexpr bool is_table_v = is_table<T>::value;
 }
 
+namespace luabind::detail {
+/*
+ * The set of candidate callables behind a luabind::overload. Overloaded itself is not
+ * callable from C++: it only exists to be adapted into a single lua_CFunction that picks a
+ * candidate based on the Lua arguments it receives.
+ */
+template <typename ...Callables>
+struct Overloaded {
+  std::tuple<Callables...> fCallables;
+};
+
+/*
+ * A callable wrapped by luabind::scratch
+ */
+template <typename Callable>
+struct Scratch {
+  Callable fCallable;
+};
+
+/*
+ * A view handed to luabind::lazy. The view and the position reached in it are shared by
+ * every copy, so the elements are produced once however many times it is pushed.
+ */
+template <std::ranges::view V>
+struct LazyRange {
+  struct State {
+    V fView;
+    std::optional<std::ranges::iterator_t<V>> fPosition; // Unset until the first element is asked for
+  };
+
+  std::shared_ptr<State> fState;
+};
+}
+
+namespace luabind::detail::traits {
+template <typename>
+struct is_overloaded : std::false_type {};
+
+template <typename ...Callables>
+struct is_overloaded<detail::Overloaded<Callables...>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_overloaded_v = is_overloaded<T>::value;
+
+template <typename>
+struct is_lazy_range : std::false_type {};
+
+template <typename V>
+struct is_lazy_range<detail::LazyRange<V>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_lazy_range_v = is_lazy_range<T>::value;
+
+template <typename>
+struct is_scratch : std::false_type {};
+
+template <typename Callable>
+struct is_scratch<detail::Scratch<Callable>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_scratch_v = is_scratch<T>::value;
+
+template <typename Callable>
+struct function_traits<detail::Scratch<Callable>> : function_traits<Callable> {};
+}
+
 namespace luabind {
 /*
  * luabind::adapt is a clever function that converts a callable argument
@@ -240,8 +396,124 @@ namespace luabind {
 template <typename Callable, typename UniqueType = decltype([]() {})>
 lua_CFunction adapt(const Callable &aFunc);
 
+/*
+ * For callables known at compile time (function pointers, or captureless lambdas passed as
+ * template arguments), adapt<&func>() returns a lua_CFunction that calls the callable
+ * directly. There is no gCallable to initialize, and the callable can be inlined.
+ *
+ * Stateless callables passed to adapt(aFunc) take the same direct path automatically.
+ */
+template <auto Callable>
+lua_CFunction adapt();
+
+/*
+ * luabind::overload combines several callables into one Lua function. When it is called,
+ * the first candidate whose arity matches the number of Lua arguments, and whose parameter
+ * types accept the Lua type of each argument, is invoked:
+ *
+ *   lua["describe"] = luabind::overload(
+ *       [](double aNumber) { ... },
+ *       [](std::string aString) { ... },
+ *       [](std::vector<int> aSequence) { ... });
+ *
+ * The acceptable Lua types for every candidate are computed at compile time, so dispatch is
+ * a few lua_type checks. Candidates are tried in order, so put more specific ones first.
+ */
+template <typename ...Callables>
+detail::Overloaded<Callables...> overload(Callables const &... aCallables) {
+  static_assert(sizeof...(Callables) > 0, "overload needs at least one candidate");
+  return {{aCallables...}};
+}
+
+/*
+ * luabind::scratch marks a callable whose arguments are short-lived. While it runs, the
+ * std::pmr containers among its arguments (std::pmr::vector, std::pmr::string, nested
+ * in any way) are allocated from a monotonic arena kept by the Lua state, and everything
+ * in the arena is released at once when the call returns. Converting arguments then
+ * costs no heap allocations once the arena has warmed up:
+ *
+ *   lua["tokens"] = luabind::scratch([](std::pmr::vector<std::pmr::string> const &aWords) {
+ *     return countDistinct(aWords);
+ *   });
+ *
+ * Arguments (and anything else allocated from scratchResource()) must not outlive the
+ * call: copy what needs to be kept into ordinary containers. Other argument types are
+ * converted as usual. The arena survives between calls, so it is reused rather than
+ * reallocated, and nested scratch calls share it.
+ */
+template <typename Callable>
+detail::Scratch<Callable> scratch(Callable const &aCallable) {
+  return {aCallable};
+}
+
+/*
+ * The memory resource of the scratch call running on this thread (see scratch), or the
+ * default resource outside of one
+ */
+inline std::pmr::memory_resource *scratchResource();
+
+/*
+ * Any other input range is pushed as a sequence table, built in one pass (and presized
+ * when the range knows its size). luabind::lazy pushes a range as an iterator function
+ * instead, which produces the next element only when Lua asks for it, so a pipeline of
+ * any length never holds more than one element in Lua:
+ *
+ *   lua["readings"] = luabind::lazy(std::views::iota(0, 1000000)
+ *                                   | std::views::transform([](int i) { return sample(i); }));
+ *   lua << "for value in readings do total = total + value end";
+ *
+ * The function returns nil at the end of the range. Like std::views::all, lazy keeps a
+ * reference to an lvalue container, which must then outlive the iteration, and takes
+ * ownership of an rvalue one.
+ */
+template <std::ranges::viewable_range R> requires std::ranges::input_range<R>
+detail::LazyRange<std::views::all_t<R>> lazy(R &&aRange) {
+  using State = typename detail::LazyRange<std::views::all_t<R>>::State;
+  return {std::make_shared<State>(std::views::all(std::forward<R>(aRange)))};
+}
+
+/*
+ * One frame of the Lua call stack at the point an error was raised, as captured by the
+ * FRAMES error handler mode (see Lua::setErrorHandlerMode).
+ */
+struct StackFrame {
+  std::string fSource;
+  std::string fFunction;
+  int fLine;
+};
+
 struct RuntimeError : std::runtime_error {
   explicit RuntimeError(std::string const &aSubMsg) : std::runtime_error("Lua runtime error: " + aSubMsg) {}
+
+  RuntimeError(std::string const &aSubMsg, std::vector<StackFrame> aFrames)
+      : std::runtime_error("Lua runtime error: " + aSubMsg), fFrames(std::move(aFrames)) {}
+
+  /*
+   * The Lua call stack at the point of the error, innermost frame first. Empty unless the
+   * state's error handler mode is FRAMES.
+   */
+  [[nodiscard]] std::vector<StackFrame> const &frames() const {
+    return fFrames;
+  }
+
+  /*
+   * Formats frames() like Lua's own "stack traceback:" listing. The formatting is only done
+   * when asked for, so capturing frames stays cheap for errors that are expected and handled.
+   */
+  [[nodiscard]] std::string traceback() const {
+    std::string ret = "stack traceback:";
+    for (auto const &frame : fFrames) {
+      ret += "\n\t" + frame.fSource;
+      if (frame.fLine > 0) {
+        ret += ":" + std::to_string(frame.fLine);
+      }
+      ret += ": in " + (frame.fFunction.empty() ? std::string("?") : "function '" + frame.fFunction + "'");
+    }
+    return ret;
+  }
+
+  private:
+  std::vector<StackFrame> fFrames;
 };
 
 struct MemoryError : std::runtime_error {
@@ -263,166 +535,1089 @@ struct FileError : std::runtime_error {
 struct IncorrectType : std::runtime_error {
   explicit IncorrectType(std::string const &aSubMsg) : std::runtime_error("Incorrect type: " + aSubMsg) {}
 };
-}
 
-namespace luabind::detail {
 /*
- * luabind::detail::toLua receives a lua_State and a value in the
- * C++ domain. It then uses the Lua C API to push that value with the
- * right type onto the Lua stack. Lua uses this odd way to pass values
- * back and forth--instead of an opaque pointer like PyObject*, Lua
- * makes you push and pop values from a stack. Odd ergonomics.
- * Because aVal is an input, we can usually deduce its type without requiring
- * the caller to explicitly pass the type as a template argument.
+ * A CallObserver installed with Lua::setCallObserver sees every call C++ makes into a Lua
+ * function through the state (lua["f"](...) and Environment calls) and every call Lua
+ * makes into an adapted C++ function. The trace recorder in luabind/trace.hpp is one.
+ *
+ * Each Starting call is paired with a Finished call once the function returns or fails;
+ * calls nest when callbacks call back into Lua. Observers run in the middle of calls, so
+ * they must leave the stack as they found it and must not throw.
  */
-template <typename T>
-void toLua(lua_State *aState, T const &aVal);
+class CallObserver {
+  public:
+  virtual ~CallObserver() = default;
 
-/*
- * luabind::detail::fromLua receives a lua_State, and based on the template
- * type T will pop a value off the Lua stack and return it in the C++ domain.
- * Callers must provide the type T because it is not associated with an input
- * argument.
- */
-template <typename T>
-T fromLua(lua_State *aState);
+  /*
+   * C++ is calling the Lua function aName. Its aArgCount arguments are on top of the stack.
+   */
+  virtual void callStarting(lua_State *aState, std::string_view aName, int aArgCount) = 0;
 
-template <typename T>
-void setTableElement(lua_State *aState, T const &aVal, int aIdx) {
-  // First push the Lua-domain converted aVal onto the stack
-  toLua(aState, aVal);
+  virtual void callFinished(lua_State *aState, bool aSucceeded) = 0;
 
-  // idx -1 on the stack is the converted aVal, -2 is the table
-  lua_seti(aState, -2, aIdx);
-}
+  /*
+   * Lua called an adapted C++ function. Its arguments are the whole stack, and
+   * lua_getstack level 0 is the call.
+   */
+  virtual void callbackStarting(lua_State *aState) = 0;
 
-template <typename T>
-T getTableElement(lua_State *aState, int aIdx) {
-  lua_geti(aState, -1, aIdx);
-  return fromLua<T>(aState);
+  virtual void callbackFinished(lua_State *aState, bool aSucceeded) = 0;
+};
 }
 
+namespace luabind {
 /*
- * setTableElementsFromTuple uses a fold-expression along with a compile-time
- * index_sequence to expand a single syntactic call to setTableElement
- * to N calls, one for each tuple element.
+ * A string constant pushed from a per-state cache. lua_pushlstring hashes the string and
+ * looks it up in Lua's string table on every push; an InternedString creates the Lua
+ * string once per state, keeps it in the registry under its own address, and pushes it
+ * with a single lua_rawgetp from then on. toLua pushes InternedStrings this way, so
+ * callbacks can return them (by reference) like any other string.
+ *
+ * The address is the key, so InternedStrings must have static storage duration: use the
+ * interned<"..."_f> literals, intern(), or a static variable of your own.
  */
-template <typename ...Args, std::size_t... I>
-void setTableElementsFromTuple(lua_State *aState, const std::tuple<Args...> &aVal, std::index_sequence<I...>) {
-  (setTableElement(aState, std::get<I>(aVal), I + 1), ...);
-}
+class InternedString {
+  public:
+  constexpr explicit InternedString(const std::string_view aValue) : fValue(aValue) {}
 
-template <typename T>
-void toLuaTuple(lua_State *aState, const T &aVal) {
-  lua_createtable(aState, std::tuple_size_v<std::decay_t<T>>, 0);
-  setTableElementsFromTuple(aState, aVal, std::make_index_sequence<std::tuple_size_v<std::decay_t<T>>>());
+  InternedString(InternedString const &) = delete;
+
+  InternedString &operator=(InternedString const &) = delete;
+
+  void push(lua_State *aState) const {
+    if (lua_rawgetp(aState, LUA_REGISTRYINDEX, this)==LUA_TSTRING) {
+      return;
+    }
+    lua_pop(aState, 1);
+    lua_pushlstring(aState, fValue.data(), fValue.size());
+    lua_pushvalue(aState, -1);
+    lua_rawsetp(aState, LUA_REGISTRYINDEX, this);
+  }
+
+  [[nodiscard]] constexpr std::string_view view() const {
+    return fValue;
+  }
+
+  private:
+  std::string_view fValue;
+};
+
+namespace detail {
+template <meta::DiscriminatorContainer Value>
+struct InternedLiteral {
+  static constexpr meta::DiscriminatorContainer fChars = Value;
+  static constexpr InternedString fString{
+      std::string_view(fChars.data(), static_cast<std::size_t>(std::ranges::find(fChars, '\0') - fChars.begin()))};
+};
 }
 
 /*
- * getTableElementsAsTuple uses a pack expansion along with a compile-time
- * index_sequence to expand a single syntactic call to getTableElement
- * to N calls, one for each tuple element.
+ * The InternedString for a compile-time literal, one per distinct literal in the program:
  *
- * T is assumed to be a tuple type, and we use a pack expansion within
- * an initializer list to construct the return tuple in-place.
-*/
-template <typename T, std::size_t... I>
-T getTableElementsAsTuple(lua_State *aState, std::index_sequence<I...>) {
-  return {getTableElement<std::tuple_element_t<I, T>>(aState, I + 1) ...};
-}
-
-template <typename T>
-T fromLuaTuple(lua_State *aState) {
-  constexpr std::size_t tupleSize = std::tuple_size_v<T>;
-  return getTableElementsAsTuple<T>(aState, std::make_index_sequence<tupleSize>());
-}
+ *   using namespace luabind::meta::literals;
+ *   lua["status"] = [](int aCode) -> luabind::InternedString const & {
+ *     return aCode==0 ? luabind::interned<"ok"_f> : luabind::interned<"failed"_f>;
+ *   };
+ *
+ * Like table field names, literals are limited to meta::MAX_FIELD_SIZE characters.
+ */
+template <meta::DiscriminatorContainer Value>
+inline constexpr InternedString const &interned = detail::InternedLiteral<Value>::fString;
 
-template <typename T, size_t ...I>
-T getTableElementsAsTable(lua_State *aState, std::index_sequence<I...>) {
-  // Avoid another template function with an immediately invoked lambda to satisfy pack expansion
-  return {{[aState]() {
-    lua_getfield(aState, -1, std::tuple_element_t<I, typename T::Fields>::fDiscriminator.data());
-    return fromLua<typename std::tuple_element_t<I, typename T::Fields>::T>(aState);
-  }()}...};
+/*
+ * The InternedString for a string only known at run time. Equal strings give the same
+ * InternedString. Interned strings are never freed, so this is meant for bounded sets of
+ * names (keys read from a configuration, say), looked up once and kept.
+ */
+inline InternedString const &intern(const std::string_view aValue) {
+  struct Entry {
+    std::string fChars;
+    InternedString fString{fChars};
+  };
+  static std::mutex mutex;
+  static std::unordered_map<std::string_view, std::unique_ptr<Entry>> entries;
+  std::lock_guard lock(mutex);
+  auto found = entries.find(aValue);
+  if (found==entries.end()) {
+    auto entry = std::make_unique<Entry>(std::string(aValue));
+    std::string_view key = entry->fChars;
+    found = entries.emplace(key, std::move(entry)).first;
+  }
+  return found->second->fString;
 }
 
-template <typename T, size_t ...I>
-void setTableElementsAsTable(lua_State *aState, const T &aTable, std::index_sequence<I...>) {
-  // Avoid another template function with an immediately invoked lambda to satisfy fold expression
-  ([aState, &aTable]() {
-    toLua(aState, std::get<I>(aTable.fFields).fValue);
-
-    // idx -1 on the stack is the converted aVal, -2 is the table
-    lua_setfield(aState, -2, std::tuple_element_t<I, typename T::Fields>::fDiscriminator.data());
-  }(), ...);
+/*
+ * Specialize EnumStrings to convert an enum to and from Lua strings:
+ *
+ *   template <>
+ *   struct luabind::EnumStrings<Color> {
+ *     static constexpr std::array<std::pair<Color, std::string_view>, 3> fNames{{
+ *         {Color::RED, "red"}, {Color::GREEN, "green"}, {Color::BLUE, "blue"}}};
+ *   };
+ *
+ * Enumerators are pushed as interned strings. When the enumerators are listed in order
+ * with underlying values 0, 1, 2..., finding an enumerator's string is an array index;
+ * otherwise it is a search of fNames. Values with no name (combinations of flags, say)
+ * are pushed as their underlying integer, and integers are accepted back.
+ */
+template <typename E>
+struct EnumStrings;
 }
 
+namespace luabind::detail::traits {
 template <typename T>
-T fromLuaTable(lua_State *aState) {
-  static_assert(traits::is_table_v<T>);
+constexpr bool is_named_enum_v = false;
 
-  // For each field according to the index_sequence, deserialize that element by indexing into the lua tuple
-  // using the field name, and calling fromLua using the field type
-  return getTableElementsAsTable<T>(aState, std::make_index_sequence<std::tuple_size_v<typename T::Fields>>());
+template <typename T> requires std::is_enum_v<T>
+constexpr bool is_named_enum_v<T> = requires { EnumStrings<T>::fNames; };
 }
 
-template <typename T>
-void toLuaTable(lua_State *aState, const T &aVal) {
-  static_assert(traits::is_table_v<T>);
+namespace luabind::detail::enums {
+template <typename E>
+struct Names {
+  static constexpr auto &ENTRIES = EnumStrings<E>::fNames;
+  static constexpr std::size_t COUNT = std::size(ENTRIES);
 
-  // For each field according to the index_sequence, serialize that element by calling toLua based on
-  // the field type
-  lua_createtable(aState, std::tuple_size_v<std::decay_t<typename T::Fields>>, 0);
-  setTableElementsAsTable(aState, aVal, std::make_index_sequence<std::tuple_size_v<typename T::Fields>>());
-}
+  static constexpr bool DENSE = []() {
+    for (std::size_t i = 0; i < COUNT; ++i) {
+      if (static_cast<std::make_unsigned_t<std::underlying_type_t<E>>>(ENTRIES[i].first)!=i) {
+        return false;
+      }
+    }
+    return true;
+  }();
 
-enum class ScopeTrigger {
-  SUCCESS,
-  FAILURE,
-  ALWAYS
-};
+  template <std::size_t ...I>
+  static constexpr std::array<InternedString, COUNT> makeStrings(std::index_sequence<I...>) {
+    return {InternedString(ENTRIES[I].second)...};
+  }
 
-template <ScopeTrigger Trigger, std::invocable T>
-class ScopeGuard {
-  public:
-  [[nodiscard]] explicit ScopeGuard(T aInvocable) : fInvocable{aInvocable} {}
+  static constexpr std::array<InternedString, COUNT> STRINGS = makeStrings(std::make_index_sequence<COUNT>());
 
-  ~ScopeGuard() {
-    if constexpr (Trigger==ScopeTrigger::SUCCESS) {
-      if (!std::uncaught_exceptions()) {
-        fInvocable();
-      }
-    } else if constexpr (Trigger==ScopeTrigger::FAILURE) {
-      if (std::uncaught_exceptions()) {
-        fInvocable();
+  static void push(lua_State *aState, E aValue) {
+    if constexpr (DENSE) {
+      auto index = static_cast<std::make_unsigned_t<std::underlying_type_t<E>>>(aValue);
+      if (index < COUNT) {
+        STRINGS[index].push(aState);
+        return;
       }
-    } else if constexpr (Trigger==ScopeTrigger::ALWAYS) {
-      fInvocable();
     } else {
-      static_assert(detail::traits::always_false_v<T>, "Unhandled scope trigger");
+      for (std::size_t i = 0; i < COUNT; ++i) {
+        if (ENTRIES[i].first==aValue) {
+          STRINGS[i].push(aState);
+          return;
+        }
+      }
     }
+    lua_pushinteger(aState, static_cast<lua_Integer>(static_cast<std::underlying_type_t<E>>(aValue)));
   }
 
-  private:
-  T fInvocable;
+  static std::optional<E> find(const std::string_view aName) {
+    for (std::size_t i = 0; i < COUNT; ++i) {
+      if (ENTRIES[i].second==aName) {
+        return ENTRIES[i].first;
+      }
+    }
+    return std::nullopt;
+  }
 };
-
-/*
- * CTAD does not support partial explicit template specification
- * which is needed to specify the non-type template parameter
- * trigger. However, this is permitted in a normal function,
- * so we can get a nice API by writing a construction wrapper
- * around ScopeGuard
- */
-template <ScopeTrigger Trigger = ScopeTrigger::ALWAYS, std::invocable T>
-auto makeScopeGuard(T aInvocable) {
-  return ScopeGuard<Trigger, T>(aInvocable);
 }
 
+namespace luabind {
 /*
- * Given a value aVal with deduced type T, push the correctly
- * typed value onto the Lua stack. We use "if constexpr" to do
- * compile-time dispatch in a readable way here, in combination
+ * Specialize StructFields to convert an aggregate struct to and from a Lua table with one
+ * field per member, directly from and into the members:
+ *
+ *   struct Point { double x; double y; };
+ *
+ *   template <>
+ *   struct luabind::StructFields<Point> {
+ *     static constexpr std::array<std::string_view, 2> fNames{"x", "y"};
+ *   };
+ *
+ * There is one name per member, in declaration order; the number of members is counted at
+ * compile time and must match. Field names are interned (see InternedString).
+ *
+ * A trivially copyable struct can instead travel as a userdata holding a copy of it, by
+ * adding "static constexpr bool fAsUserdata = true;". Pushing it is then one allocation
+ * and a memcpy whatever the number of members, and scripts read and assign its members
+ * as fields (p.x = 1) through generated accessors. Plain tables with the same fields are
+ * still accepted when converting from Lua.
+ */
+template <typename T>
+struct StructFields;
+
+/*
+ * A ByteBuffer is a growable byte string that scripts append to in place, for building
+ * large outputs without a Lua string per piece and without copying the result out:
+ *
+ *   luabind::ByteBuffer page;
+ *   page.reserve(1 << 20);
+ *   lua["render"](page, model);   -- function render(out, model) out:append("<p>", model.n, "</p>") end
+ *   std::string html = page.take();
+ *
+ * In Lua, a buffer is a userdata with the methods:
+ * - append(...): appends strings, numbers (integers in full, floats in their shortest
+ *   round-trip form) and the contents of other buffers, and returns the buffer.
+ * - append_number(x, decimals): appends x with a fixed number of decimals.
+ * - reserve(n): makes room for n bytes in total.
+ * - clear(): empties the buffer, keeping its memory.
+ * #buffer is its length in bytes, and tostring(buffer) copies it into a Lua string.
+ *
+ * Copies of a ByteBuffer, in C++ or Lua, share the same bytes, so buffers created by
+ * scripts (through a callback returning luabind::ByteBuffer{}) can be returned or passed
+ * to C++ too. Like the state, a buffer must only be used from one thread at a time.
+ */
+class ByteBuffer {
+  public:
+  ByteBuffer() : fBytes(std::make_shared<std::string>()) {}
+
+  [[nodiscard]] std::size_t size() const {
+    return fBytes->size();
+  }
+
+  void reserve(std::size_t aCapacity) {
+    fBytes->reserve(aCapacity);
+  }
+
+  void append(const std::string_view aBytes) {
+    fBytes->append(aBytes);
+  }
+
+  void clear() {
+    fBytes->clear();
+  }
+
+  /*
+   * The contents, valid until the buffer is next changed
+   */
+  [[nodiscard]] std::string_view view() const {
+    return *fBytes;
+  }
+
+  [[nodiscard]] std::span<const std::byte> span() const {
+    return std::as_bytes(std::span<const char>(fBytes->data(), fBytes->size()));
+  }
+
+  /*
+   * Moves the contents out, leaving the buffer empty
+   */
+  std::string take() {
+    return std::exchange(*fBytes, std::string());
+  }
+
+  /*
+   * The storage shared by every copy of the buffer
+   */
+  [[nodiscard]] std::string &bytes() const {
+    return *fBytes;
+  }
+
+  private:
+  std::shared_ptr<std::string> fBytes;
+};
+}
+
+namespace luabind::detail::traits {
+template <typename T>
+constexpr bool is_reflected_struct_v = false;
+
+template <typename T> requires std::is_aggregate_v<T>
+constexpr bool is_reflected_struct_v<T> = requires { StructFields<T>::fNames; };
+
+template <typename T>
+constexpr bool is_userdata_struct_v = false;
+
+template <typename T> requires is_reflected_struct_v<T>
+constexpr bool is_userdata_struct_v<T> = [] {
+  if constexpr (requires { StructFields<T>::fAsUserdata; }) {
+    return static_cast<bool>(StructFields<T>::fAsUserdata);
+  } else {
+    return false;
+  }
+}();
+}
+
+namespace luabind::detail::aggregate {
+inline constexpr std::size_t MAX_MEMBERS = 16;
+
+/*
+ * Converts to anything, so T{AnyMember{}, ...} compiles exactly when T has at least that
+ * many members. Each AnyMember initializes a whole member (a member that is itself an
+ * aggregate included), as brace elision only kicks in when no conversion exists.
+ */
+struct AnyMember {
+  template <typename T>
+  operator T() const; // NOLINT(google-explicit-constructor)
+};
+
+template <typename T, std::size_t ...I>
+constexpr bool initializableWith(std::index_sequence<I...>) {
+  return requires { T{(static_cast<void>(I), AnyMember{})...}; };
+}
+
+/*
+ * The number of members of the aggregate T
+ */
+template <typename T, std::size_t N = 0>
+constexpr std::size_t memberCount() {
+  if constexpr (N < MAX_MEMBERS && initializableWith<T>(std::make_index_sequence<N + 1>())) {
+    return memberCount<T, N + 1>();
+  } else {
+    return N;
+  }
+}
+
+/*
+ * A tuple of references to the N members of aValue, by structured binding
+ */
+template <std::size_t N, typename T>
+constexpr auto tie(T &aValue) {
+  if constexpr (N==1) {
+    auto &[m1] = aValue;
+    return std::tie(m1);
+  } else if constexpr (N==2) {
+    auto &[m1, m2] = aValue;
+    return std::tie(m1, m2);
+  } else if constexpr (N==3) {
+    auto &[m1, m2, m3] = aValue;
+    return std::tie(m1, m2, m3);
+  } else if constexpr (N==4) {
+    auto &[m1, m2, m3, m4] = aValue;
+    return std::tie(m1, m2, m3, m4);
+  } else if constexpr (N==5) {
+    auto &[m1, m2, m3, m4, m5] = aValue;
+    return std::tie(m1, m2, m3, m4, m5);
+  } else if constexpr (N==6) {
+    auto &[m1, m2, m3, m4, m5, m6] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6);
+  } else if constexpr (N==7) {
+    auto &[m1, m2, m3, m4, m5, m6, m7] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7);
+  } else if constexpr (N==8) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8);
+  } else if constexpr (N==9) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9);
+  } else if constexpr (N==10) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10);
+  } else if constexpr (N==11) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11);
+  } else if constexpr (N==12) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12);
+  } else if constexpr (N==13) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13);
+  } else if constexpr (N==14) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14);
+  } else if constexpr (N==15) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15);
+  } else if constexpr (N==16) {
+    auto &[m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15, m16] = aValue;
+    return std::tie(m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15, m16);
+  } else {
+    static_assert(traits::always_false_v<T>, "Structs with more than MAX_MEMBERS members are not supported");
+  }
+}
+
+template <typename T>
+struct Fields {
+  static constexpr auto &NAMES = StructFields<T>::fNames;
+  static constexpr std::size_t COUNT = std::size(NAMES);
+  static_assert(COUNT==memberCount<T>(), "StructFields must name every member of the struct, in order");
+  static_assert(!traits::is_userdata_struct_v<T> || std::is_trivially_copyable_v<T>,
+                "Only trivially copyable structs can be stored as userdata");
+
+  using Members = decltype(tie<COUNT>(std::declval<T &>()));
+  template <std::size_t I>
+  using Member = std::remove_cvref_t<std::tuple_element_t<I, Members>>;
+
+  template <std::size_t ...I>
+  static constexpr std::array<InternedString, COUNT> makeKeys(std::index_sequence<I...>) {
+    return {InternedString(NAMES[I])...};
+  }
+
+  static constexpr std::array<InternedString, COUNT> KEYS = makeKeys(std::make_index_sequence<COUNT>());
+
+  /*
+   * The index of the member named aName, or COUNT
+   */
+  static std::size_t find(const std::string_view aName) {
+    for (std::size_t i = 0; i < COUNT; ++i) {
+      if (NAMES[i]==aName) {
+        return i;
+      }
+    }
+    return COUNT;
+  }
+};
+
+/*
+ * Registry key (by address) of the metatable of T userdata
+ */
+template <typename T>
+inline const char METATABLE_KEY = 0;
+}
+
+namespace luabind::detail {
+/*
+ * luabind::detail::toLua receives a lua_State and a value in the
+ * C++ domain. It then uses the Lua C API to push that value with the
+ * right type onto the Lua stack. Lua uses this odd way to pass values
+ * back and forth--instead of an opaque pointer like PyObject*, Lua
+ * makes you push and pop values from a stack. Odd ergonomics.
+ * Because aVal is an input, we can usually deduce its type without requiring
+ * the caller to explicitly pass the type as a template argument.
+ */
+template <typename T>
+void toLua(lua_State *aState, T const &aVal);
+
+/*
+ * luabind::detail::fromLua receives a lua_State, and based on the template
+ * type T will pop a value off the Lua stack and return it in the C++ domain.
+ * Callers must provide the type T because it is not associated with an input
+ * argument.
+ */
+template <typename T>
+T fromLua(lua_State *aState);
+
+/*
+ * The reason a conversion failed. Reasons are always string literals, so reporting a
+ * failure never allocates.
+ */
+struct ConversionFailure {
+  const char *fReason;
+};
+
+/*
+ * Converted<T> is the expected-style result of a conversion that may fail: either a T,
+ * or the reason the Lua value couldn't be converted to one. Lua-to-C++ calls check these
+ * instead of catching IncorrectType, so a script passing a bad argument costs a branch
+ * rather than a throw.
+ */
+template <typename T>
+class Converted {
+  public:
+  Converted(T aValue) : fValue(std::move(aValue)) {} // NOLINT(google-explicit-constructor)
+
+  Converted(ConversionFailure aFailure) : fReason(aFailure.fReason) {} // NOLINT(google-explicit-constructor)
+
+  explicit operator bool() const {
+    return fValue.has_value();
+  }
+
+  T &operator*() {
+    return *fValue;
+  }
+
+  [[nodiscard]] const char *reason() const {
+    return fReason;
+  }
+
+  [[nodiscard]] ConversionFailure failure() const {
+    return {fReason};
+  }
+
+  private:
+  std::optional<T> fValue;
+  const char *fReason = nullptr;
+};
+
+/*
+ * luabind::detail::tryFromLua converts the value at stack index aIdx to T. Unlike fromLua
+ * it neither pops the value nor throws: a value of the wrong type yields a failed Converted.
+ * fromLua is implemented on top of it.
+ */
+template <typename T>
+Converted<T> tryFromLua(lua_State *aState, int aIdx);
+
+template <typename V, std::size_t ...I>
+Converted<V> tryFromLuaVariant(lua_State *aState, int aIdx, std::index_sequence<I...>);
+
+template <typename T>
+void setTableElement(lua_State *aState, T const &aVal, int aIdx) {
+  // First push the Lua-domain converted aVal onto the stack
+  toLua(aState, aVal);
+
+  // idx -1 on the stack is the converted aVal, -2 is the table
+  lua_seti(aState, -2, aIdx);
+}
+
+template <typename T>
+Converted<T> tryGetTableElement(lua_State *aState, int aTableIdx, lua_Integer aKey) {
+  lua_geti(aState, aTableIdx, aKey);
+  auto converted = tryFromLua<T>(aState, -1);
+  lua_pop(aState, 1);
+  return converted;
+}
+
+template <typename T>
+Converted<T> tryGetTableField(lua_State *aState, int aTableIdx, const char *aKey) {
+  lua_getfield(aState, aTableIdx, aKey);
+  auto converted = tryFromLua<T>(aState, -1);
+  lua_pop(aState, 1);
+  return converted;
+}
+
+/*
+ * tryConvertEach builds a tuple by calling aGetElement once per element, with the element
+ * index as a std::integral_constant. The fold expression short-circuits, so conversion
+ * stops at the first element that fails.
+ */
+template <typename Tuple, typename Getter, std::size_t ...I>
+Converted<Tuple> tryConvertEach(Getter &&aGetElement, std::index_sequence<I...>) {
+  std::tuple<std::optional<std::tuple_element_t<I, Tuple>>...> elements;
+  ConversionFailure failure{nullptr};
+  bool converted = ([&]() {
+    auto element = aGetElement(std::integral_constant<std::size_t, I>());
+    if (!element) {
+      failure = element.failure();
+      return false;
+    }
+    std::get<I>(elements).emplace(std::move(*element));
+    return true;
+  }() && ...);
+  if (!converted) {
+    return failure;
+  }
+  return Tuple{std::move(*std::get<I>(elements))...};
+}
+
+/*
+ * setTableElementsFromTuple uses a fold-expression along with a compile-time
+ * index_sequence to expand a single syntactic call to setTableElement
+ * to N calls, one for each tuple element.
+ */
+template <typename ...Args, std::size_t... I>
+void setTableElementsFromTuple(lua_State *aState, const std::tuple<Args...> &aVal, std::index_sequence<I...>) {
+  (setTableElement(aState, std::get<I>(aVal), I + 1), ...);
+}
+
+template <typename T>
+void toLuaTuple(lua_State *aState, const T &aVal) {
+  lua_createtable(aState, std::tuple_size_v<std::decay_t<T>>, 0);
+  setTableElementsFromTuple(aState, aVal, std::make_index_sequence<std::tuple_size_v<std::decay_t<T>>>());
+}
+
+/*
+ * Tuples are stored as sequences, so element I of the tuple is read from key I + 1.
+ * aIdx must be an absolute stack index, since reading elements pushes onto the stack.
+ */
+template <typename T>
+Converted<T> tryFromLuaTuple(lua_State *aState, int aIdx) {
+  if (!lua_istable(aState, aIdx)) {
+    return ConversionFailure{"Runtime type cannot be converted to a tuple"};
+  }
+  return tryConvertEach<T>([aState, aIdx](auto aI) {
+    return tryGetTableElement<std::tuple_element_t<decltype(aI)::value, T>>(aState, aIdx, decltype(aI)::value + 1);
+  }, std::make_index_sequence<std::tuple_size_v<T>>());
+}
+
+template <typename T, size_t ...I>
+void setTableElementsAsTable(lua_State *aState, const T &aTable, std::index_sequence<I...>) {
+  // Avoid another template function with an immediately invoked lambda to satisfy fold expression
+  ([aState, &aTable]() {
+    interned<std::tuple_element_t<I, typename T::Fields>::fDiscriminator>.push(aState);
+    toLua(aState, std::get<I>(aTable.fFields).fValue);
+
+    // idx -1 on the stack is the converted aVal, -2 the field name and -3 the new table
+    lua_rawset(aState, -3);
+  }(), ...);
+}
+
+template <typename T>
+Converted<T> tryFromLuaTable(lua_State *aState, int aIdx) {
+  static_assert(traits::is_table_v<T>);
+  using Fields = typename T::Fields;
+  if (!lua_istable(aState, aIdx)) {
+    return ConversionFailure{"Runtime type cannot be converted to a table"};
+  }
+
+  // For each field according to the index_sequence, deserialize that element by indexing into the lua table
+  // using the field name, and converting using the field type
+  auto fields = tryConvertEach<Fields>([aState, aIdx](auto aI) -> Converted<std::tuple_element_t<decltype(aI)::value, Fields>> {
+    using Field = std::tuple_element_t<decltype(aI)::value, Fields>;
+    auto value = tryGetTableField<typename Field::T>(aState, aIdx, Field::fDiscriminator.data());
+    if (!value) {
+      return value.failure();
+    }
+    return Field{std::move(*value)};
+  }, std::make_index_sequence<std::tuple_size_v<Fields>>());
+  if (!fields) {
+    return fields.failure();
+  }
+  return std::make_from_tuple<T>(std::move(*fields));
+}
+
+template <typename T>
+void toLuaTable(lua_State *aState, const T &aVal) {
+  static_assert(traits::is_table_v<T>);
+
+  // For each field according to the index_sequence, serialize that element by calling toLua based on
+  // the field type
+  lua_createtable(aState, std::tuple_size_v<std::decay_t<typename T::Fields>>, 0);
+  setTableElementsAsTable(aState, aVal, std::make_index_sequence<std::tuple_size_v<typename T::Fields>>());
+}
+
+enum class ScopeTrigger {
+  SUCCESS,
+  FAILURE,
+  ALWAYS
+};
+
+template <ScopeTrigger Trigger, std::invocable T>
+class ScopeGuard {
+  public:
+  [[nodiscard]] explicit ScopeGuard(T aInvocable) : fInvocable{aInvocable} {}
+
+  ~ScopeGuard() {
+    if constexpr (Trigger==ScopeTrigger::SUCCESS) {
+      if (!std::uncaught_exceptions()) {
+        fInvocable();
+      }
+    } else if constexpr (Trigger==ScopeTrigger::FAILURE) {
+      if (std::uncaught_exceptions()) {
+        fInvocable();
+      }
+    } else if constexpr (Trigger==ScopeTrigger::ALWAYS) {
+      fInvocable();
+    } else {
+      static_assert(detail::traits::always_false_v<T>, "Unhandled scope trigger");
+    }
+  }
+
+  private:
+  T fInvocable;
+};
+
+/*
+ * CTAD does not support partial explicit template specification
+ * which is needed to specify the non-type template parameter
+ * trigger. However, this is permitted in a normal function,
+ * so we can get a nice API by writing a construction wrapper
+ * around ScopeGuard
+ */
+template <ScopeTrigger Trigger = ScopeTrigger::ALWAYS, std::invocable T>
+auto makeScopeGuard(T aInvocable) {
+  return ScopeGuard<Trigger, T>(aInvocable);
+}
+
+/*
+ * The resource of the innermost scratch call on this thread, or nullptr
+ */
+inline thread_local std::pmr::memory_resource *tScratchResource = nullptr;
+
+inline std::pmr::memory_resource *conversionResource() {
+  return tScratchResource!=nullptr ? tScratchResource : std::pmr::get_default_resource();
+}
+
+/*
+ * An empty container of type C. Pmr containers allocate from the conversion resource.
+ */
+template <typename C>
+C makeContainer() {
+  if constexpr (traits::is_pmr_container_v<C>) {
+    return C(typename C::allocator_type(conversionResource()));
+  } else {
+    return C();
+  }
+}
+
+inline constexpr const char *LAZY_RANGE_METATABLE_NAME = "luabind.LazyRange";
+
+inline int collectLazyRange(lua_State *aState) {
+  static_cast<std::shared_ptr<void> *>(lua_touserdata(aState, 1))->~shared_ptr();
+  return 0;
+}
+
+/*
+ * The iterator function of a lazy range: pushes the next element, or nil past the end
+ */
+template <typename V>
+int nextLazyElement(lua_State *aState) {
+  auto &state = *static_cast<typename LazyRange<V>::State *>(
+      static_cast<std::shared_ptr<void> *>(lua_touserdata(aState, lua_upvalueindex(1)))->get());
+  try {
+    if (!state.fPosition) {
+      state.fPosition.emplace(std::ranges::begin(state.fView));
+    }
+    auto &position = *state.fPosition;
+    if (position==std::ranges::end(state.fView)) {
+      lua_pushnil(aState);
+      return 1;
+    }
+    toLua(aState, *position);
+    ++position;
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushstring(aState, e.what());
+  }
+  return lua_error(aState);
+}
+
+template <typename V>
+void pushLazyRange(lua_State *aState, LazyRange<V> const &aRange) {
+  // The closure owns the state through a type-erased pointer, so one metatable serves every V
+  new(lua_newuserdatauv(aState, sizeof(std::shared_ptr<void>), 0)) std::shared_ptr<void>(aRange.fState);
+  if (luaL_newmetatable(aState, LAZY_RANGE_METATABLE_NAME)) {
+    lua_pushcfunction(aState, &collectLazyRange);
+    lua_setfield(aState, -2, "__gc");
+  }
+  lua_setmetatable(aState, -2);
+  lua_pushcclosure(aState, &nextLazyElement<V>, 1);
+}
+
+/*
+ * Views that can only be iterated when non-const (filter_view, say) are iterated through
+ * a copy, which is cheap for a view
+ */
+template <typename R>
+constexpr bool is_pushable_range_v = std::ranges::input_range<R const>
+    || (std::ranges::view<R> && std::copy_constructible<R> && std::ranges::input_range<R>);
+
+template <typename T, std::size_t ...I>
+void setStructFields(lua_State *aState, T const &aValue, std::index_sequence<I...>) {
+  auto members = aggregate::tie<sizeof...(I)>(aValue);
+  ((aggregate::Fields<T>::KEYS[I].push(aState), toLua(aState, std::get<I>(members)), lua_rawset(aState, -3)), ...);
+}
+
+template <typename T, std::size_t ...I>
+Converted<T> tryFromLuaStructTable(lua_State *aState, int aIdx, std::index_sequence<I...>) {
+  using Fields = aggregate::Fields<T>;
+  auto members = tryConvertEach<std::tuple<typename Fields::template Member<I>...>>([aState, aIdx](auto aI) {
+    Fields::KEYS[decltype(aI)::value].push(aState);
+    lua_gettable(aState, aIdx);
+    auto member = tryFromLua<typename Fields::template Member<decltype(aI)::value>>(aState, -1);
+    lua_pop(aState, 1);
+    return member;
+  }, std::index_sequence<I...>());
+  if (!members) {
+    return members.failure();
+  }
+  return std::apply([](auto &&... aMembers) { return T{std::move(aMembers)...}; }, std::move(*members));
+}
+
+template <typename T, std::size_t ...I>
+void pushMember(lua_State *aState, T const &aValue, std::size_t aIndex, std::index_sequence<I...>) {
+  auto members = aggregate::tie<sizeof...(I)>(aValue);
+  static_cast<void>(((aIndex==I && (toLua(aState, std::get<I>(members)), true)) || ...));
+}
+
+/*
+ * Returns the reason the value at aValueIdx can't be assigned to member aIndex, or nullptr
+ * once it has been
+ */
+template <typename T, std::size_t ...I>
+const char *assignMember(lua_State *aState, T &aValue, std::size_t aIndex, int aValueIdx, std::index_sequence<I...>) {
+  auto members = aggregate::tie<sizeof...(I)>(aValue);
+  const char *failure = nullptr;
+  static_cast<void>(((aIndex==I && ([&]() {
+    auto member = tryFromLua<typename aggregate::Fields<T>::template Member<I>>(aState, aValueIdx);
+    if (member) {
+      std::get<I>(members) = std::move(*member);
+    } else {
+      failure = member.reason();
+    }
+  }(), true)) || ...));
+  return failure;
+}
+
+/*
+ * The index of the member named by the key at aIdx, or Fields<T>::COUNT
+ */
+template <typename T>
+std::size_t memberIndex(lua_State *aState, int aIdx) {
+  if (lua_type(aState, aIdx)!=LUA_TSTRING) {
+    return aggregate::Fields<T>::COUNT;
+  }
+  std::size_t length = 0;
+  const char *name = lua_tolstring(aState, aIdx, &length);
+  return aggregate::Fields<T>::find({name, length});
+}
+
+template <typename T>
+int structIndex(lua_State *aState) {
+  auto const &value = *static_cast<T const *>(lua_touserdata(aState, 1));
+  auto index = memberIndex<T>(aState, 2);
+  if (index==aggregate::Fields<T>::COUNT) {
+    lua_pushnil(aState);
+    return 1;
+  }
+  pushMember(aState, value, index, std::make_index_sequence<aggregate::Fields<T>::COUNT>());
+  return 1;
+}
+
+template <typename T>
+int structNewIndex(lua_State *aState) {
+  auto &value = *static_cast<T *>(lua_touserdata(aState, 1));
+  auto index = memberIndex<T>(aState, 2);
+  if (index==aggregate::Fields<T>::COUNT) {
+    lua_pushfstring(aState, "struct has no field '%s'", luaL_tolstring(aState, 2, nullptr));
+  } else if (auto failure = assignMember(aState, value, index, 3,
+                                         std::make_index_sequence<aggregate::Fields<T>::COUNT>())) {
+    lua_pushfstring(aState, "field '%s': %s", lua_tostring(aState, 2), failure);
+  } else {
+    return 0;
+  }
+  return lua_error(aState);
+}
+
+template <typename T>
+void pushStructMetatable(lua_State *aState) {
+  if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &aggregate::METATABLE_KEY<T>)!=LUA_TNIL) {
+    return;
+  }
+  lua_pop(aState, 1);
+  lua_createtable(aState, 0, 2);
+  lua_pushcfunction(aState, &structIndex<T>);
+  lua_setfield(aState, -2, "__index");
+  lua_pushcfunction(aState, &structNewIndex<T>);
+  lua_setfield(aState, -2, "__newindex");
+  lua_pushvalue(aState, -1);
+  lua_rawsetp(aState, LUA_REGISTRYINDEX, &aggregate::METATABLE_KEY<T>);
+}
+
+template <typename T>
+void pushStruct(lua_State *aState, T const &aValue) {
+  if constexpr (traits::is_userdata_struct_v<T>) {
+    std::memcpy(lua_newuserdatauv(aState, sizeof(T), 0), &aValue, sizeof(T));
+    pushStructMetatable<T>(aState);
+    lua_setmetatable(aState, -2);
+  } else {
+    lua_createtable(aState, 0, static_cast<int>(aggregate::Fields<T>::COUNT));
+    setStructFields(aState, aValue, std::make_index_sequence<aggregate::Fields<T>::COUNT>());
+  }
+}
+
+template <typename T>
+Converted<T> tryFromLuaStruct(lua_State *aState, int aIdx) {
+  if constexpr (traits::is_userdata_struct_v<T>) {
+    if (lua_type(aState, aIdx)==LUA_TUSERDATA && lua_getmetatable(aState, aIdx)) {
+      lua_rawgetp(aState, LUA_REGISTRYINDEX, &aggregate::METATABLE_KEY<T>);
+      bool matches = lua_rawequal(aState, -1, -2);
+      lua_pop(aState, 2);
+      if (matches) {
+        return *static_cast<T const *>(lua_touserdata(aState, aIdx));
+      }
+    }
+  }
+  if (!lua_istable(aState, aIdx)) {
+    return ConversionFailure{"Runtime type cannot be converted to a struct"};
+  }
+  return tryFromLuaStructTable<T>(aState, lua_absindex(aState, aIdx),
+                                  std::make_index_sequence<aggregate::Fields<T>::COUNT>());
+}
+
+/*
+ * Registry key (by address) of the metatable of ByteBuffer userdata
+ */
+inline const char BYTE_BUFFER_METATABLE_KEY = 0;
+
+/*
+ * The ByteBuffer at aIdx, or nullptr if the value isn't one
+ */
+inline ByteBuffer *toByteBuffer(lua_State *aState, int aIdx) {
+  if (lua_type(aState, aIdx)!=LUA_TUSERDATA || !lua_getmetatable(aState, aIdx)) {
+    return nullptr;
+  }
+  lua_rawgetp(aState, LUA_REGISTRYINDEX, &BYTE_BUFFER_METATABLE_KEY);
+  bool matches = lua_rawequal(aState, -1, -2);
+  lua_pop(aState, 2);
+  return matches ? static_cast<ByteBuffer *>(lua_touserdata(aState, aIdx)) : nullptr;
+}
+
+inline std::string &checkByteBuffer(lua_State *aState) {
+  auto *buffer = toByteBuffer(aState, 1);
+  if (buffer==nullptr) {
+    luaL_typeerror(aState, 1, "buffer");
+  }
+  return buffer->bytes();
+}
+
+/*
+ * Appends the number at aIdx to aBytes: in full if it is an integer, otherwise with
+ * aDecimals decimals, or in its shortest round-trip form for a negative aDecimals
+ */
+inline void appendNumber(std::string &aBytes, lua_State *aState, int aIdx, int aDecimals) {
+  char digits[64];
+  std::to_chars_result result{};
+  if (aDecimals < 0 && lua_isinteger(aState, aIdx)) {
+    result = std::to_chars(std::begin(digits), std::end(digits), lua_tointeger(aState, aIdx));
+  } else if (aDecimals < 0) {
+    result = std::to_chars(std::begin(digits), std::end(digits), lua_tonumber(aState, aIdx));
+  } else {
+    result = std::to_chars(std::begin(digits), std::end(digits), lua_tonumber(aState, aIdx), std::chars_format::fixed,
+                           aDecimals);
+  }
+  // Only fixed notation of a huge number overflows; fall back to the shortest form then
+  if (result.ec!=std::errc()) {
+    result = std::to_chars(std::begin(digits), std::end(digits), lua_tonumber(aState, aIdx));
+  }
+  aBytes.append(digits, result.ptr);
+}
+
+/*
+ * Appending runs in a Lua C function, so the exceptions std::string can throw are caught
+ * and raised as Lua errors once they are gone
+ */
+inline int appendToByteBuffer(lua_State *aState) {
+  auto &bytes = checkByteBuffer(aState);
+  int top = lua_gettop(aState);
+  int badArgument = 0;
+  bool failed = false;
+  try {
+    for (int i = 2; i <= top && badArgument==0; ++i) {
+      switch (lua_type(aState, i)) {
+        case LUA_TSTRING: {
+          std::size_t length = 0;
+          const char *data = lua_tolstring(aState, i, &length);
+          bytes.append(data, length);
+          break;
+        }
+        case LUA_TNUMBER:appendNumber(bytes, aState, i, -1);
+          break;
+        default:
+          if (auto *other = toByteBuffer(aState, i)) {
+            bytes.append(other->bytes());
+          } else {
+            badArgument = i;
+          }
+      }
+    }
+  } catch (std::exception &e) {
+    lua_pushstring(aState, e.what());
+    failed = true;
+  }
+  if (failed) {
+    return lua_error(aState);
+  }
+  if (badArgument!=0) {
+    return luaL_typeerror(aState, badArgument, "string, number or buffer");
+  }
+  lua_settop(aState, 1);
+  return 1;
+}
+
+inline int appendNumberToByteBuffer(lua_State *aState) {
+  auto &bytes = checkByteBuffer(aState);
+  luaL_checknumber(aState, 2);
+  auto decimals = static_cast<int>(luaL_checkinteger(aState, 3));
+  luaL_argcheck(aState, decimals >= 0 && decimals <= 17, 3, "decimals must be between 0 and 17");
+  bool failed = false;
+  try {
+    appendNumber(bytes, aState, 2, decimals);
+  } catch (std::exception &e) {
+    lua_pushstring(aState, e.what());
+    failed = true;
+  }
+  if (failed) {
+    return lua_error(aState);
+  }
+  lua_settop(aState, 1);
+  return 1;
+}
+
+inline int reserveByteBuffer(lua_State *aState) {
+  auto &bytes = checkByteBuffer(aState);
+  auto capacity = luaL_checkinteger(aState, 2);
+  luaL_argcheck(aState, capacity >= 0, 2, "negative capacity");
+  bool failed = false;
+  try {
+    bytes.reserve(static_cast<std::size_t>(capacity));
+  } catch (std::exception &e) {
+    lua_pushstring(aState, e.what());
+    failed = true;
+  }
+  if (failed) {
+    return lua_error(aState);
+  }
+  lua_settop(aState, 1);
+  return 1;
+}
+
+inline int clearByteBuffer(lua_State *aState) {
+  checkByteBuffer(aState).clear();
+  lua_settop(aState, 1);
+  return 1;
+}
+
+inline int byteBufferLength(lua_State *aState) {
+  lua_pushinteger(aState, static_cast<lua_Integer>(checkByteBuffer(aState).size()));
+  return 1;
+}
+
+inline int byteBufferToString(lua_State *aState) {
+  auto &bytes = checkByteBuffer(aState);
+  lua_pushlstring(aState, bytes.data(), bytes.size());
+  return 1;
+}
+
+inline int collectByteBuffer(lua_State *aState) {
+  static_cast<ByteBuffer *>(lua_touserdata(aState, 1))->~ByteBuffer();
+  return 0;
+}
+
+inline void pushByteBuffer(lua_State *aState, ByteBuffer const &aBuffer) {
+  new(lua_newuserdatauv(aState, sizeof(ByteBuffer), 0)) ByteBuffer(aBuffer);
+  if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &BYTE_BUFFER_METATABLE_KEY)!=LUA_TTABLE) {
+    lua_pop(aState, 1);
+    static const luaL_Reg methods[] = {
+        {"append", &appendToByteBuffer},
+        {"append_number", &appendNumberToByteBuffer},
+        {"reserve", &reserveByteBuffer},
+        {"clear", &clearByteBuffer},
+        {nullptr, nullptr}
+    };
+    lua_createtable(aState, 0, 4);
+    luaL_newlib(aState, methods);
+    lua_setfield(aState, -2, "__index");
+    lua_pushcfunction(aState, &byteBufferLength);
+    lua_setfield(aState, -2, "__len");
+    lua_pushcfunction(aState, &byteBufferToString);
+    lua_setfield(aState, -2, "__tostring");
+    lua_pushcfunction(aState, &collectByteBuffer);
+    lua_setfield(aState, -2, "__gc");
+    lua_pushvalue(aState, -1);
+    lua_rawsetp(aState, LUA_REGISTRYINDEX, &BYTE_BUFFER_METATABLE_KEY);
+  }
+  lua_setmetatable(aState, -2);
+}
+
+template <typename R>
+void pushElements(lua_State *aState, R &&aRange) {
+  if constexpr (std::ranges::sized_range<R>) {
+    lua_createtable(aState, static_cast<int>(std::ranges::size(aRange)), 0);
+  } else {
+    lua_newtable(aState);
+  }
+  lua_Integer index = 0;
+  for (auto &&element : aRange) {
+    toLua(aState, element);
+    lua_rawseti(aState, -2, ++index);
+  }
+}
+
+template <typename R>
+void pushRange(lua_State *aState, R const &aRange) {
+  if constexpr (std::ranges::input_range<R const>) {
+    pushElements(aState, aRange);
+  } else {
+    R copy = aRange;
+    pushElements(aState, copy);
+  }
+}
+
+/*
+ * Given a value aVal with deduced type T, push the correctly
+ * typed value onto the Lua stack. We use "if constexpr" to do
+ * compile-time dispatch in a readable way here, in combination
  * with the traits we wrote above. Another approach would be to
  * write multiple specializations of toLua using SFINAE. However,
  * here we have better control over the compile errors.
@@ -441,10 +1636,18 @@ void toLua(lua_State *aState, T const &aVal) {
     lua_pushboolean(aState, aVal);
   } else if constexpr (std::is_arithmetic_v<std::decay_t<T>>) {
     lua_pushnumber(aState, aVal);
-  } else if constexpr (std::is_same_v<std::decay_t<T>, std::string>) {
+  } else if constexpr (traits::is_string_v<std::decay_t<T>>) {
     lua_pushlstring(aState, aVal.c_str(), aVal.length());
   } else if constexpr (std::is_same_v<std::decay_t<T>, char *> || std::is_same_v<std::decay_t<T>, const char *>) {
     lua_pushstring(aState, aVal);
+  } else if constexpr (std::is_same_v<std::decay_t<T>, std::string_view>) {
+    lua_pushlstring(aState, aVal.data(), aVal.size());
+  } else if constexpr (std::is_same_v<std::decay_t<T>, InternedString>) {
+    aVal.push(aState);
+  } else if constexpr (std::is_same_v<std::decay_t<T>, ByteBuffer>) {
+    pushByteBuffer(aState, aVal);
+  } else if constexpr (traits::is_named_enum_v<std::decay_t<T>>) {
+    enums::Names<std::decay_t<T>>::push(aState, aVal);
   } else if constexpr (traits::is_vector_v<std::decay_t<T>>) {
     lua_createtable(aState, aVal.size(), 0);
     for (int i = 0; i < aVal.size(); ++i) {
@@ -452,117 +1655,1020 @@ void toLua(lua_State *aState, T const &aVal) {
     }
   } else if constexpr (traits::is_tuple_v<std::decay_t<T>>) {
     toLuaTuple(aState, aVal);
-  } else if constexpr (traits::is_callable_v<std::decay_t<T>>) {
+  } else if constexpr (traits::is_callable_v<std::decay_t<T>> || traits::is_overloaded_v<std::decay_t<T>>
+      || traits::is_scratch_v<std::decay_t<T>>) {
     lua_pushcfunction(aState, adapt(aVal));
   } else if constexpr (traits::is_table_v<std::decay_t<T>>) {
     toLuaTable(aState, aVal);
+  } else if constexpr (traits::is_nil_v<std::decay_t<T>>) {
+    lua_pushnil(aState);
+  } else if constexpr (traits::is_optional_v<std::decay_t<T>>) {
+    if (aVal) {
+      toLua(aState, *aVal);
+    } else {
+      lua_pushnil(aState);
+    }
+  } else if constexpr (traits::is_variant_v<std::decay_t<T>>) {
+    std::visit([aState](auto const &aAlternative) { toLua(aState, aAlternative); }, aVal);
+  } else if constexpr (traits::is_reflected_struct_v<std::decay_t<T>>) {
+    pushStruct(aState, aVal);
+  } else if constexpr (traits::is_lazy_range_v<std::decay_t<T>>) {
+    pushLazyRange(aState, aVal);
+  } else if constexpr (is_pushable_range_v<std::decay_t<T>>) {
+    pushRange(aState, aVal);
   } else {
     static_assert(traits::always_false_v<T>, "Unsupported type");
   }
 }
 
 /*
- * Given an explicit template parameter T, pop the correctly
- * typed value from the Lua stack and return it into the C++ domain.
- * We use "if constexpr" to do compile-time dispatch in a readable way here,
- * in combination with the traits we wrote above. Another approach would be to
- * write multiple specializations of fromLua using SFINAE. However,
- * here we have better control over the compile errors.
+ * Given an explicit template parameter T, convert the value at aIdx
+ * on the Lua stack into the C++ domain, if it has a compatible type.
+ * We use "if constexpr" to do compile-time dispatch in a readable way here,
+ * in combination with the traits we wrote above. Another approach would be to
+ * write multiple specializations of tryFromLua using SFINAE. However,
+ * here we have better control over the compile errors.
+ */
+template <typename T>
+Converted<T> tryFromLua(lua_State *aState, int aIdx) {
+  if constexpr (std::is_same_v<std::decay_t<T>, bool>) {
+    if (!lua_isboolean(aState, aIdx)) {
+      return ConversionFailure{"Runtime type cannot be converted to bool"};
+    }
+    return static_cast<bool>(lua_toboolean(aState, aIdx));
+  } else if constexpr (std::is_arithmetic_v<std::decay_t<T>>) {
+    int isNumber = 0;
+    lua_Number number = lua_tonumberx(aState, aIdx, &isNumber);
+    if (!isNumber) {
+      return ConversionFailure{"Runtime type cannot be converted to an arithmetic type"};
+    }
+    return static_cast<T>(number);
+  } else if constexpr (traits::is_string_v<std::decay_t<T>>) {
+    // lua_isstring returns true for numbers, oddly, so check the type exactly
+    if (lua_type(aState, aIdx)!=LUA_TSTRING) {
+      return ConversionFailure{"Runtime type cannot be converted to a string"};
+    }
+    std::size_t length = 0;
+    const char *data = lua_tolstring(aState, aIdx, &length);
+    auto ret = makeContainer<std::decay_t<T>>();
+    ret.assign(data, length);
+    return ret;
+    // We don't support const char* for memory safety reasons
+  } else if constexpr (std::is_same_v<std::decay_t<T>, ByteBuffer>) {
+    if (auto *buffer = toByteBuffer(aState, aIdx)) {
+      return *buffer;
+    }
+    return ConversionFailure{"Runtime type cannot be converted to a buffer"};
+  } else if constexpr (traits::is_named_enum_v<std::decay_t<T>>) {
+    using E = std::decay_t<T>;
+    if (lua_type(aState, aIdx)==LUA_TSTRING) {
+      std::size_t length = 0;
+      const char *data = lua_tolstring(aState, aIdx, &length);
+      if (auto value = enums::Names<E>::find({data, length})) {
+        return *value;
+      }
+      return ConversionFailure{"Runtime string is not the name of an enumerator"};
+    }
+    int isInteger = 0;
+    lua_Integer integer = lua_tointegerx(aState, aIdx, &isInteger);
+    if (!isInteger) {
+      return ConversionFailure{"Runtime type cannot be converted to an enum"};
+    }
+    return static_cast<E>(integer);
+  } else if constexpr (traits::is_vector_v<std::decay_t<T>>) {
+    if (!lua_istable(aState, aIdx)) {
+      return ConversionFailure{"Runtime type cannot be converted to a vector"};
+    }
+    int tableIdx = lua_absindex(aState, aIdx);
+    auto length = lua_rawlen(aState, tableIdx);
+    auto retVec = makeContainer<std::decay_t<T>>();
+    retVec.reserve(length);
+    for (lua_Unsigned i = 0; i < length; ++i) {
+      auto element = tryGetTableElement<typename T::value_type>(aState, tableIdx, static_cast<lua_Integer>(i + 1));
+      if (!element) {
+        return element.failure();
+      }
+      retVec.emplace_back(std::move(*element));
+    }
+    return retVec;
+  } else if constexpr (traits::is_tuple_v<std::decay_t<T>>) {
+    return tryFromLuaTuple<std::decay_t<T>>(aState, lua_absindex(aState, aIdx));
+  } else if constexpr (traits::is_callable_v<std::decay_t<T>>) {
+    static_assert(detail::traits::always_false_v<T>,
+                  "Unable to create a function object from Lua, use the GetGlobalHelper/CallHelper instead");
+  } else if constexpr (traits::is_table_v<std::decay_t<T>>) {
+    return tryFromLuaTable<std::decay_t<T>>(aState, lua_absindex(aState, aIdx));
+  } else if constexpr (traits::is_nil_v<std::decay_t<T>>) {
+    if (!lua_isnoneornil(aState, aIdx)) {
+      return ConversionFailure{"Runtime type cannot be converted to nil"};
+    }
+    return T{};
+  } else if constexpr (traits::is_optional_v<std::decay_t<T>>) {
+    // nil (or a missing argument) is empty; any other value must convert to the contained type
+    if (lua_isnoneornil(aState, aIdx)) {
+      return T{};
+    }
+    auto value = tryFromLua<typename std::decay_t<T>::value_type>(aState, aIdx);
+    if (!value) {
+      return value.failure();
+    }
+    return T{std::move(*value)};
+  } else if constexpr (traits::is_variant_v<std::decay_t<T>>) {
+    return tryFromLuaVariant<std::decay_t<T>>(aState, aIdx,
+                                              std::make_index_sequence<std::variant_size_v<std::decay_t<T>>>());
+  } else if constexpr (traits::is_reflected_struct_v<std::decay_t<T>>) {
+    return tryFromLuaStruct<std::decay_t<T>>(aState, aIdx);
+  } else {
+    static_assert(detail::traits::always_false_v<T>, "Unsupported type");
+  }
+}
+
+/*
+ * Given an explicit template parameter T, pop the correctly
+ * typed value from the Lua stack and return it into the C++ domain.
+ * If the value has the wrong type, IncorrectType is thrown and the
+ * value is left on the stack.
+ */
+template <typename T>
+T fromLua(lua_State *aState) {
+  auto converted = tryFromLua<T>(aState, -1);
+  if (!converted) {
+    throw IncorrectType(converted.reason());
+  }
+  lua_pop(aState, 1);
+  return std::move(*converted);
+}
+
+/*
+ * A bit set of Lua types (bit N set for lua_type N), describing which Lua values
+ * fromLua<T> can be expected to convert. Types we can't classify accept anything and
+ * leave the decision to fromLua.
+ */
+using LuaTypeMask = unsigned;
+
+inline constexpr LuaTypeMask ANY_LUA_TYPE = (1u << LUA_NUMTYPES) - 1;
+
+constexpr LuaTypeMask luaTypeBit(int aLuaType) {
+  return aLuaType < 0 ? 0 : 1u << aLuaType;
+}
+
+template <typename T>
+constexpr LuaTypeMask luaTypeMask() {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    return luaTypeBit(LUA_TBOOLEAN);
+  } else if constexpr (std::is_arithmetic_v<U>) {
+    return luaTypeBit(LUA_TNUMBER);
+  } else if constexpr (traits::is_string_v<U>) {
+    return luaTypeBit(LUA_TSTRING);
+  } else if constexpr (traits::is_named_enum_v<U>) {
+    return luaTypeBit(LUA_TSTRING) | luaTypeBit(LUA_TNUMBER);
+  } else if constexpr (traits::is_userdata_struct_v<U>) {
+    return luaTypeBit(LUA_TTABLE) | luaTypeBit(LUA_TUSERDATA);
+  } else if constexpr (std::is_same_v<U, ByteBuffer>) {
+    return luaTypeBit(LUA_TUSERDATA);
+  } else if constexpr (traits::is_reflected_struct_v<U>) {
+    return luaTypeBit(LUA_TTABLE);
+  } else if constexpr (traits::is_vector_v<U> || traits::is_tuple_v<U> || traits::is_table_v<U>) {
+    return luaTypeBit(LUA_TTABLE);
+  } else if constexpr (traits::is_nil_v<U>) {
+    return luaTypeBit(LUA_TNIL);
+  } else if constexpr (traits::is_optional_v<U>) {
+    return luaTypeBit(LUA_TNIL) | luaTypeMask<typename U::value_type>();
+  } else if constexpr (traits::is_variant_v<U>) {
+    return []<typename ...Alternatives>(std::variant<Alternatives...> *) {
+      return (luaTypeMask<Alternatives>() | ...);
+    }(static_cast<U *>(nullptr));
+  } else {
+    return ANY_LUA_TYPE;
+  }
+}
+
+/*
+ * Converts to the first alternative of the variant V whose Lua types (per luaTypeMask,
+ * computed at compile time) include the value's type and that converts successfully, so
+ * a value is normally converted exactly once, by the alternative made for its type.
+ * Integral alternatives only take numbers with an exact integer value, so that 1.5 goes
+ * on to a floating-point alternative instead of being truncated.
+ */
+template <typename V, std::size_t ...I>
+Converted<V> tryFromLuaVariant(lua_State *aState, int aIdx, std::index_sequence<I...>) {
+  static constexpr std::array<LuaTypeMask, sizeof...(I)> masks{luaTypeMask<std::variant_alternative_t<I, V>>()...};
+  // A missing argument converts like nil
+  LuaTypeMask type = luaTypeBit(std::max(lua_type(aState, aIdx), LUA_TNIL));
+  std::optional<V> result;
+  ([&]() {
+    using Alternative = std::variant_alternative_t<I, V>;
+    if (!(masks[I] & type)) {
+      return false;
+    }
+    if constexpr (std::is_integral_v<Alternative> && !std::is_same_v<Alternative, bool>) {
+      int isInteger = 0;
+      lua_tointegerx(aState, aIdx, &isInteger);
+      if (!isInteger) {
+        return false;
+      }
+    }
+    auto value = tryFromLua<Alternative>(aState, aIdx);
+    if (!value) {
+      return false;
+    }
+    result.emplace(std::in_place_index<I>, std::move(*value));
+    return true;
+  }() || ...);
+  if (!result) {
+    return ConversionFailure{"Runtime type cannot be converted to any alternative of the variant"};
+  }
+  return std::move(*result);
+}
+
+inline constexpr std::size_t MAX_OVERLOAD_ARITY = 8;
+
+/*
+ * The compile-time description of one overload candidate: how many arguments it takes,
+ * and which Lua types each argument position accepts.
+ */
+struct OverloadSignature {
+  int fArity;
+  std::array<LuaTypeMask, MAX_OVERLOAD_ARITY> fTypeMasks;
+
+  bool accepts(int aArgCount, std::array<LuaTypeMask, MAX_OVERLOAD_ARITY> const &aArgTypes) const {
+    if (aArgCount!=fArity) {
+      return false;
+    }
+    for (int i = 0; i < fArity; ++i) {
+      if (!(aArgTypes[i] & fTypeMasks[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+template <typename ...Args>
+constexpr OverloadSignature makeOverloadSignature(std::tuple<Args...> *) {
+  static_assert(sizeof...(Args) <= MAX_OVERLOAD_ARITY, "Too many arguments for an overload candidate");
+  return {sizeof...(Args), {luaTypeMask<Args>()...}};
+}
+
+template <typename>
+struct OverloadSignatures;
+
+template <typename ...Callables>
+struct OverloadSignatures<Overloaded<Callables...>> {
+  static inline constexpr std::array<OverloadSignature, sizeof...(Callables)> fSignatures{
+      makeOverloadSignature(static_cast<typename traits::function_traits<Callables>::ArgumentTypes *>(nullptr))...
+  };
+};
+
+template <typename Callable>
+int callFromLua(lua_State *aState, Callable &&aCallable);
+
+/*
+ * Raises a Lua error listing the argument types nothing matched. The message is built on
+ * the Lua stack so no C++ object is alive when lua_error unwinds.
+ */
+inline int noMatchingOverload(lua_State *aState) {
+  int argCount = lua_gettop(aState);
+  lua_pushliteral(aState, "No overload accepts argument types (");
+  for (int i = 1; i <= argCount; ++i) {
+    lua_pushstring(aState, luaL_typename(aState, i));
+    if (i < argCount) {
+      lua_pushliteral(aState, ", ");
+    }
+  }
+  lua_pushliteral(aState, ")");
+  lua_concat(aState, lua_gettop(aState) - argCount);
+  return lua_error(aState);
+}
+
+template <typename OverloadedT, std::size_t ...I>
+int callOverloaded(lua_State *aState, OverloadedT &aOverloaded, std::index_sequence<I...>) {
+  constexpr auto const &signatures = OverloadSignatures<std::remove_const_t<OverloadedT>>::fSignatures;
+  int argCount = lua_gettop(aState);
+  std::array<LuaTypeMask, MAX_OVERLOAD_ARITY> argTypes{};
+  for (int i = 0; i < std::min<int>(argCount, MAX_OVERLOAD_ARITY); ++i) {
+    argTypes[i] = luaTypeBit(lua_type(aState, i + 1));
+  }
+
+  // Short-circuiting fold: call the first candidate that accepts the arguments
+  int resultCount = 0;
+  bool matched = ((signatures[I].accepts(argCount, argTypes)
+      && (resultCount = callFromLua(aState, std::get<I>(aOverloaded.fCallables)), true)) || ...);
+  if (!matched) {
+    return noMatchingOverload(aState);
+  }
+  return resultCount;
+}
+
+/*
+ * A unique specialization of gCallable will be generated for every call
+ * to luabind::adapt, and will store a reference to the provided callable.
+ */
+template <typename Callable, typename> std::optional<Callable> gCallable;
+
+template <typename>
+struct DecayedTuple;
+
+template <typename ...Args>
+struct DecayedTuple<std::tuple<Args...>> {
+  using type = std::tuple<std::decay_t<Args>...>;
+};
+
+/*
+ * Converts the Lua arguments of a call into a tuple holding a value for each parameter in
+ * ArgTypes. Argument I is read in place from stack index I + 1, and conversion stops at
+ * the first argument with the wrong type.
+ */
+template <typename ArgTypes>
+auto getArgsAsTuple(lua_State *aState) {
+  using Values = typename DecayedTuple<ArgTypes>::type;
+  return tryConvertEach<Values>([aState](auto aI) {
+    return tryFromLua<std::tuple_element_t<decltype(aI)::value, Values>>(aState, decltype(aI)::value + 1);
+  }, std::make_index_sequence<std::tuple_size_v<Values>>());
+}
+
+/*
+ * Like std::apply, except each stored argument is forwarded as its parameter type:
+ * by-value parameters are moved into, and reference parameters bind to the stored value.
+ */
+template <typename ArgTypes, typename Callable, typename Values, std::size_t ...I>
+decltype(auto) applyArgs(Callable &aCallable, Values &aValues, std::index_sequence<I...>) {
+  return std::invoke(aCallable, std::forward<std::tuple_element_t<I, ArgTypes>>(std::get<I>(aValues))...);
+}
+
+/*
+ * invokeFromLua does all of the C++ work of a call from Lua in its own stack frame:
+ * converting arguments, calling the callable, and pushing the result. It never lets an
+ * exception or a Lua error escape. On failure it pushes the error message and returns -1,
+ * by which time every C++ object it created has been destroyed.
+ */
+template <typename Callable>
+int invokeFromLua(lua_State *aState, Callable &aCallable) {
+  using RetType = typename detail::traits::function_traits<std::decay_t<Callable>>::ReturnType;
+  using ArgTypes = typename detail::traits::function_traits<std::decay_t<Callable>>::ArgumentTypes;
+  auto args = getArgsAsTuple<ArgTypes>(aState);
+  if (!args) {
+    lua_pushfstring(aState, "Incorrect type: %s", args.reason());
+    return -1;
+  }
+  auto indices = std::make_index_sequence<std::tuple_size_v<ArgTypes>>();
+  try {
+    if constexpr (std::is_same_v<RetType, void>) {
+      applyArgs<ArgTypes>(aCallable, *args, indices);
+      return 0;
+    } else {
+      toLua(aState, applyArgs<ArgTypes>(aCallable, *args, indices));
+      return 1;
+    }
+  } catch (std::exception &e) {
+    lua_pushstring(aState, e.what());
+    return -1;
+  }
+}
+
+/*
+ * Makes aResource the conversion resource of this thread for its lifetime (nullptr: the
+ * default resource)
  */
-template <typename T>
-T fromLua(lua_State *aState) {
-  int initialStackSize = lua_gettop(aState);
-  auto guard = makeScopeGuard([aState, initialStackSize]() {
-    int expectedStackSize = initialStackSize;
-    if (!std::uncaught_exceptions()) {
-      expectedStackSize--;
+class ResourceScope {
+  public:
+  explicit ResourceScope(std::pmr::memory_resource *aResource) : fPrevious(tScratchResource) {
+    tScratchResource = aResource;
+  }
+
+  ResourceScope(ResourceScope const &) = delete;
+
+  ResourceScope &operator=(ResourceScope const &) = delete;
+
+  ~ResourceScope() {
+    tScratchResource = fPrevious;
+  }
+
+  private:
+  std::pmr::memory_resource *fPrevious;
+};
+
+inline constexpr const char *SCRATCH_ARENA_METATABLE_NAME = "luabind.ScratchArena";
+
+/*
+ * Registry key (by address) of the ScratchArena userdata of a state
+ */
+inline const char SCRATCH_ARENA_KEY = 0;
+
+/*
+ * The arena behind luabind::scratch: a monotonic resource over a buffer the state keeps.
+ * Whatever doesn't fit in the buffer comes from the heap and is counted, and the next
+ * reset grows the buffer to hold it, so a steady workload soon stops reaching the heap.
+ */
+class ScratchArena {
+  public:
+  static constexpr std::size_t INITIAL_CAPACITY = 16*1024;
+  static constexpr std::size_t MAX_CAPACITY = 1024*1024; // Never grow the buffer past this
+
+  ScratchArena() {
+    allocateBuffer(INITIAL_CAPACITY);
+  }
+
+  ScratchArena(ScratchArena const &) = delete;
+
+  ScratchArena &operator=(ScratchArena const &) = delete;
+
+  /*
+   * The arena of aState, created the first time
+   */
+  static ScratchArena &of(lua_State *aState) {
+    if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &SCRATCH_ARENA_KEY)==LUA_TUSERDATA) {
+      auto *arena = static_cast<ScratchArena *>(lua_touserdata(aState, -1));
+      lua_pop(aState, 1);
+      return *arena;
     }
-    assert(lua_gettop(aState)==expectedStackSize);
-  });
-  auto popOnExit = makeScopeGuard<ScopeTrigger::SUCCESS>([aState]() { lua_pop(aState, 1); });
-  if constexpr (std::is_same_v<std::decay_t<T>, bool>) {
-    if (!lua_isboolean(aState, -1)) {
-      throw IncorrectType("Runtime type cannot be converted to bool");
+    lua_pop(aState, 1);
+    auto *arena = new(lua_newuserdatauv(aState, sizeof(ScratchArena), 0)) ScratchArena();
+    if (luaL_newmetatable(aState, SCRATCH_ARENA_METATABLE_NAME)) {
+      lua_pushcfunction(aState, &collect);
+      lua_setfield(aState, -2, "__gc");
     }
-    T ret = lua_toboolean(aState, -1);
-    return ret;
-  } else if constexpr (std::is_arithmetic_v<std::decay_t<T>>) {
-    if (!lua_isnumber(aState, -1)) {
-      throw IncorrectType("Runtime type cannot be converted to an arithmetic type");
+    lua_setmetatable(aState, -2);
+    lua_rawsetp(aState, LUA_REGISTRYINDEX, &SCRATCH_ARENA_KEY);
+    return *arena;
+  }
+
+  std::pmr::memory_resource &resource() {
+    return *fResource;
+  }
+
+  /*
+   * Frees everything allocated since the last reset
+   */
+  void reset() {
+    std::size_t wanted = std::min(fCapacity + fUpstream.fAllocated, MAX_CAPACITY);
+    fUpstream.fAllocated = 0;
+    if (wanted <= fCapacity) {
+      fResource->release();
+      return;
     }
-    T ret = lua_tonumber(aState, -1);
-    return ret;
-  } else if constexpr (std::is_same_v<std::decay_t<T>, std::string>) {
-    if (!lua_isstring(aState, -1) || lua_isnumber(aState, -1)) {
-      // lua_isstring returns true for numbers, oddly
-      throw IncorrectType("Runtime type cannot be converted to a string");
+    fResource.reset();
+    allocateBuffer(wanted);
+  }
+
+  std::size_t fDepth = 0; // Scratch calls on the state that haven't returned yet
+
+  private:
+  /*
+   * The upstream of the monotonic resource, counting the bytes that overflowed the buffer
+   */
+  class Upstream final : public std::pmr::memory_resource {
+    public:
+    std::size_t fAllocated = 0;
+
+    private:
+    void *do_allocate(std::size_t aBytes, std::size_t aAlignment) override {
+      fAllocated += aBytes;
+      return std::pmr::new_delete_resource()->allocate(aBytes, aAlignment);
     }
-    T ret = lua_tostring(aState, -1);
-    return ret;
-    // We don't support const char* for memory safety reasons
-  } else if constexpr (traits::is_vector_v<std::decay_t<T>>) {
-    if (!lua_istable(aState, -1)) {
-      throw IncorrectType("Runtime type cannot be converted to a vector");
+
+    void do_deallocate(void *aPointer, std::size_t aBytes, std::size_t aAlignment) override {
+      std::pmr::new_delete_resource()->deallocate(aPointer, aBytes, aAlignment);
     }
-    T retVec;
-    for (int i = 0; i < lua_rawlen(aState, -1); ++i) {
-      lua_geti(aState, -1, i + 1);
-      retVec.emplace_back(fromLua<typename T::value_type>(aState));
+
+    [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &aOther) const noexcept override {
+      return this==&aOther;
     }
-    return retVec;
-  } else if constexpr (traits::is_tuple_v<std::decay_t<T>>) {
-    auto newTuple = fromLuaTuple<std::decay_t<T>>(aState);
-    return newTuple;
-  } else if constexpr (traits::is_callable_v<std::decay_t<T>>) {
-    static_assert(detail::traits::always_false_v<T>,
-                  "Unable to create a function object from Lua, use the GetGlobalHelper/CallHelper instead");
-  } else if constexpr (traits::is_table_v<std::decay_t<T>>) {
-    auto newTable = fromLuaTable<std::decay_t<T>>(aState);
-    return newTable;
+  };
+
+  void allocateBuffer(std::size_t aCapacity) {
+    fBuffer = std::make_unique<std::byte[]>(aCapacity);
+    fCapacity = aCapacity;
+    fResource.emplace(fBuffer.get(), fCapacity, &fUpstream);
+  }
+
+  static int collect(lua_State *aState) {
+    static_cast<ScratchArena *>(lua_touserdata(aState, 1))->~ScratchArena();
+    return 0;
+  }
+
+  Upstream fUpstream;
+  std::unique_ptr<std::byte[]> fBuffer;
+  std::size_t fCapacity = 0;
+  std::optional<std::pmr::monotonic_buffer_resource> fResource;
+};
+
+/*
+ * Routes conversions to the arena of aState for its lifetime, resetting the arena when the
+ * outermost scratch call on the state ends
+ */
+class ScratchScope {
+  public:
+  explicit ScratchScope(lua_State *aState) : fArena(ScratchArena::of(aState)), fResource(&fArena.resource()) {
+    ++fArena.fDepth;
+  }
+
+  ScratchScope(ScratchScope const &) = delete;
+
+  ScratchScope &operator=(ScratchScope const &) = delete;
+
+  ~ScratchScope() {
+    if (--fArena.fDepth==0) {
+      fArena.reset();
+    }
+  }
+
+  private:
+  ScratchArena &fArena;
+  ResourceScope fResource;
+};
+
+/*
+ * The body shared by every generated lua_CFunction. Errors are raised with lua_error,
+ * which unwinds with longjmp (in a C build of Lua) and so must not skip any C++
+ * destructors: we only raise once invokeFromLua has returned.
+ */
+template <typename Callable>
+int callFromLua(lua_State *aState, Callable &&aCallable) {
+  if constexpr (traits::is_overloaded_v<std::decay_t<Callable>>) {
+    return callOverloaded(aState, aCallable, std::make_index_sequence<std::tuple_size_v<decltype(aCallable.fCallables)>>());
+  } else if constexpr (traits::is_scratch_v<std::decay_t<Callable>>) {
+    int resultCount;
+    {
+      ScratchScope scope(aState);
+      resultCount = invokeFromLua(aState, aCallable.fCallable);
+    }
+    if (resultCount < 0) {
+      return lua_error(aState);
+    }
+    return resultCount;
   } else {
-    static_assert(detail::traits::always_false_v<T>, "Unsupported type");
+    int resultCount;
+    if (tScratchResource==nullptr) {
+      resultCount = invokeFromLua(aState, aCallable);
+    } else {
+      // Called back from inside a scratch callable: this one may keep its arguments
+      ResourceScope heap(nullptr);
+      resultCount = invokeFromLua(aState, aCallable);
+    }
+    if (resultCount < 0) {
+      return lua_error(aState);
+    }
+    return resultCount;
   }
 }
 
 /*
- * A unique specialization of gCallable will be generated for every call
- * to luabind::adapt, and will store a reference to the provided callable.
+ * The number of states with a CallObserver installed. Adapted functions only look for an
+ * observer while it is nonzero, so unobserved calls pay for one relaxed load.
  */
-template <typename Callable, typename> std::optional<Callable> gCallable;
+inline std::atomic<int> gObservedStates{0};
 
 /*
- * We end up using std::apply to call a callable function stored in gCallable.
- * So we have this utility to return a tuple of type std::tuple<Args...>
- * after popping the correctly typed values off the Lua stack.
- *
- * Note the pack expansion, similar to getTableElementsAsTuple
+ * Registry key (by address) of the state's CallObserver, as a light userdata
  */
-template <typename ...Args>
-std::tuple<Args...> getArgsAsTuple(lua_State *aState, std::tuple<Args...>) {
-  // Args... may be empty if there are on args, which is ok despite style warning about the empty decl
-  return {detail::fromLua<Args>(aState) ...};
-};
+inline const char CALL_OBSERVER_KEY = 0;
+
+/*
+ * Called with the callable as a light userdata in front of the real arguments
+ */
+template <typename Callable>
+int observedBody(lua_State *aState) {
+  auto *callable = static_cast<Callable *>(lua_touserdata(aState, 1));
+  lua_remove(aState, 1);
+  return callFromLua(aState, *callable);
+}
+
+/*
+ * Runs the call in a protected call of its own, so the observer hears that it finished
+ * even if it raises, and then raises the error again
+ */
+template <typename Callable>
+int observedCallFromLua(lua_State *aState, CallObserver &aObserver, Callable &aCallable) {
+  aObserver.callbackStarting(aState);
+  int argCount = lua_gettop(aState);
+  lua_pushcfunction(aState, &observedBody<Callable>);
+  lua_pushlightuserdata(aState, const_cast<void *>(static_cast<const void *>(&aCallable)));
+  lua_rotate(aState, 1, 2);
+  int status = lua_pcall(aState, argCount + 1, LUA_MULTRET, 0);
+  aObserver.callbackFinished(aState, status==LUA_OK);
+  return status==LUA_OK ? lua_gettop(aState) : lua_error(aState);
+}
+
+/*
+ * The entry point of every generated lua_CFunction
+ */
+template <typename Callable>
+int enterFromLua(lua_State *aState, Callable &aCallable) {
+  if (gObservedStates.load(std::memory_order_relaxed)!=0) [[unlikely]] {
+    lua_rawgetp(aState, LUA_REGISTRYINDEX, &CALL_OBSERVER_KEY);
+    auto *observer = static_cast<CallObserver *>(lua_touserdata(aState, -1));
+    lua_pop(aState, 1);
+    if (observer!=nullptr) {
+      return observedCallFromLua(aState, *observer, aCallable);
+    }
+  }
+  return callFromLua(aState, aCallable);
+}
 
 template <typename Callable, typename UniqueType>
 int adapted(lua_State *aState) {
-  using RetType = typename detail::traits::function_traits<Callable>::ReturnType;
-  using ArgTypes = typename detail::traits::function_traits<Callable>::ArgumentTypes;
-  try {
-    if constexpr (std::is_same_v<RetType, void>) {
-      std::apply(*gCallable<Callable, UniqueType>, getArgsAsTuple(aState, ArgTypes()));
-      return 0;
-    } else {
-      toLua(aState, std::apply(*gCallable<Callable, UniqueType>, getArgsAsTuple(aState, ArgTypes())));
-      return 1;
+  return enterFromLua(aState, *gCallable<Callable, UniqueType>);
+}
+
+/*
+ * adaptedStatic is the lua_CFunction for a callable that is known at compile time,
+ * i.e. passed as a non-type template parameter: a function pointer, or a captureless
+ * lambda. There is nothing to store, so the callable is named directly in the body
+ * and the compiler is free to inline it into the Lua entry point.
+ */
+template <auto Callable>
+int adaptedStatic(lua_State *aState) {
+  static constexpr auto callable = Callable;
+  return enterFromLua(aState, callable);
+}
+
+/*
+ * adaptedStateless is the lua_CFunction for a stateless callable type (see
+ * traits::is_stateless_v). A fresh instance is constructed for each call, which costs
+ * nothing, and the call resolves statically just like adaptedStatic.
+ */
+template <typename Callable>
+int adaptedStateless(lua_State *aState) {
+  Callable callable{};
+  return enterFromLua(aState, callable);
+}
+}
+
+namespace luabind::detail {
+inline constexpr int MAX_CAPTURED_FRAMES = 32;
+inline constexpr std::size_t MAX_CAPTURED_NAME = 64;
+
+/*
+ * Fixed-size storage for the frames captured by the FRAMES error handler. It lives in a
+ * Lua userdata (an upvalue of the handler), so capturing allocates nothing and can't throw
+ * while Lua is in the middle of raising an error.
+ */
+struct CapturedFrames {
+  struct Frame {
+    char fSource[LUA_IDSIZE];
+    char fFunction[MAX_CAPTURED_NAME];
+    int fLine;
+  };
+
+  int fCount;
+  Frame fFrames[MAX_CAPTURED_FRAMES];
+
+  [[nodiscard]] std::vector<StackFrame> toStackFrames() const {
+    std::vector<StackFrame> ret;
+    ret.reserve(fCount);
+    for (int i = 0; i < fCount; ++i) {
+      ret.push_back({fFrames[i].fSource, fFrames[i].fFunction, fFrames[i].fLine});
     }
-  } catch (std::exception &e) {
-    luaL_error(aState, e.what());
-    return 0;
+    return ret;
+  }
+};
+
+/*
+ * Message handler for the FRAMES mode: records source, line and function name of every
+ * frame into the CapturedFrames upvalue and passes the error value through unchanged.
+ */
+inline int captureFramesHandler(lua_State *aState) {
+  auto *captured = static_cast<CapturedFrames *>(lua_touserdata(aState, lua_upvalueindex(1)));
+  captured->fCount = 0;
+  lua_Debug debug;
+  // Level 0 is this handler, level 1 is the function that raised the error
+  for (int level = 1; captured->fCount < MAX_CAPTURED_FRAMES && lua_getstack(aState, level, &debug); ++level) {
+    lua_getinfo(aState, "Sln", &debug);
+    auto &frame = captured->fFrames[captured->fCount++];
+    std::snprintf(frame.fSource, sizeof(frame.fSource), "%s", debug.short_src);
+    std::snprintf(frame.fFunction, sizeof(frame.fFunction), "%s", debug.name ? debug.name : "");
+    frame.fLine = debug.currentline;
+  }
+  return 1;
+}
+
+/*
+ * Message handler for the TRACEBACK mode: appends Lua's standard traceback to the message.
+ */
+inline int tracebackHandler(lua_State *aState) {
+  const char *message = lua_tostring(aState, 1);
+  if (message==nullptr) {
+    message = luaL_typename(aState, 1);
+  }
+  luaL_traceback(aState, aState, message, 1);
+  return 1;
+}
+
+/*
+ * Registry key (by address) of the metatable shared by every Environment of a state
+ */
+inline const char ENVIRONMENT_METATABLE_KEY = 0;
+
+/*
+ * Registry key (by address) of a weak-keyed table from each environment to its view
+ * cache
+ */
+inline const char ENVIRONMENT_VIEWS_KEY = 0;
+
+inline void pushReadOnlyView(lua_State *aState, int aIdx, int aCacheIdx);
+
+/*
+ * Environments see the global table, and every table reached from it, through read-only
+ * views: empty tables whose metamethods read through to the real table and reject
+ * assignments. Each environment caches its views in a weak-keyed table keyed by the real
+ * table, so it makes one view per table it uses, a view is never shared between
+ * environments, and a table the host replaces is seen at once.
+ *
+ * Pushes the view cache of the environment at aEnvironmentIdx, creating it on first use
+ */
+inline void pushViewCache(lua_State *aState, int aEnvironmentIdx) {
+  aEnvironmentIdx = lua_absindex(aState, aEnvironmentIdx);
+  if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &ENVIRONMENT_VIEWS_KEY)==LUA_TNIL) {
+    lua_pop(aState, 1);
+    lua_createtable(aState, 0, 0);
+    lua_createtable(aState, 0, 1);
+    lua_pushliteral(aState, "k");
+    lua_setfield(aState, -2, "__mode");
+    lua_setmetatable(aState, -2);
+    lua_pushvalue(aState, -1);
+    lua_rawsetp(aState, LUA_REGISTRYINDEX, &ENVIRONMENT_VIEWS_KEY);
+  }
+  lua_pushvalue(aState, aEnvironmentIdx);
+  if (lua_rawget(aState, -2)==LUA_TNIL) {
+    lua_pop(aState, 1);
+    lua_createtable(aState, 0, 0);
+    lua_getmetatable(aState, -2); // Caches are weak-keyed too
+    lua_setmetatable(aState, -2);
+    lua_pushvalue(aState, aEnvironmentIdx);
+    lua_pushvalue(aState, -2);
+    lua_rawset(aState, -4);
+  }
+  lua_remove(aState, -2);
+}
+
+/*
+ * Replaces the value on top of the stack with a view of it if it is a table, reusing the
+ * view in the cache at aCacheIdx
+ */
+inline void viewTop(lua_State *aState, int aCacheIdx) {
+  if (lua_type(aState, -1)!=LUA_TTABLE) {
+    return;
+  }
+  aCacheIdx = lua_absindex(aState, aCacheIdx);
+  lua_pushvalue(aState, -1);
+  if (lua_rawget(aState, aCacheIdx)==LUA_TTABLE) {
+    lua_replace(aState, -2);
+    return;
+  }
+  lua_pop(aState, 1);
+  pushReadOnlyView(aState, -1, aCacheIdx);
+  lua_pushvalue(aState, -2);
+  lua_pushvalue(aState, -2);
+  lua_rawset(aState, aCacheIdx);
+  lua_replace(aState, -2);
+}
+
+/*
+ * __index of views (upvalue 1: the real table; upvalue 2: the view cache)
+ */
+inline int readOnlyIndex(lua_State *aState) {
+  lua_settop(aState, 2);
+  lua_gettable(aState, lua_upvalueindex(1));
+  viewTop(aState, lua_upvalueindex(2));
+  return 1;
+}
+
+inline int rejectAssignment(lua_State *aState) {
+  return luaL_error(aState, "attempt to modify read-only table (field '%s')", luaL_tolstring(aState, 2, nullptr));
+}
+
+inline int readOnlyLength(lua_State *aState) {
+  lua_len(aState, lua_upvalueindex(1));
+  return 1;
+}
+
+/*
+ * The iterator returned by pairs() on a view (upvalues as for readOnlyIndex)
+ */
+inline int readOnlyNext(lua_State *aState) {
+  lua_settop(aState, 2);
+  if (!lua_next(aState, lua_upvalueindex(1))) {
+    lua_pushnil(aState);
+    return 1;
+  }
+  viewTop(aState, lua_upvalueindex(2));
+  return 2;
+}
+
+inline int readOnlyPairs(lua_State *aState) {
+  lua_pushvalue(aState, lua_upvalueindex(1));
+  lua_pushvalue(aState, lua_upvalueindex(2));
+  lua_pushcclosure(aState, &readOnlyNext, 2);
+  lua_pushvalue(aState, 1);
+  lua_pushnil(aState);
+  return 3;
+}
+
+inline void pushReadOnlyView(lua_State *aState, int aIdx, int aCacheIdx) {
+  aIdx = lua_absindex(aState, aIdx);
+  aCacheIdx = lua_absindex(aState, aCacheIdx);
+  lua_createtable(aState, 0, 0);
+  lua_createtable(aState, 0, 5);
+  auto setMethod = [&](const char *aEvent, lua_CFunction aFunction) {
+    lua_pushvalue(aState, aIdx);
+    lua_pushvalue(aState, aCacheIdx);
+    lua_pushcclosure(aState, aFunction, 2);
+    lua_setfield(aState, -2, aEvent);
+  };
+  setMethod("__index", &readOnlyIndex);
+  setMethod("__len", &readOnlyLength);
+  setMethod("__pairs", &readOnlyPairs);
+  lua_pushcfunction(aState, &rejectAssignment);
+  lua_setfield(aState, -2, "__newindex");
+  lua_pushboolean(aState, false);
+  lua_setfield(aState, -2, "__metatable");
+  lua_setmetatable(aState, -2);
+}
+
+/*
+ * __index of environments: the global of that name, tables as read-only views
+ */
+inline int environmentIndex(lua_State *aState) {
+  lua_settop(aState, 2);
+  lua_pushglobaltable(aState);
+  lua_pushvalue(aState, 2);
+  if (lua_gettable(aState, -2)!=LUA_TTABLE) {
+    return 1;
+  }
+  pushViewCache(aState, 1);
+  lua_insert(aState, -2);
+  viewTop(aState, -2);
+  return 1;
+}
+
+/*
+ * The chunk name for code loaded from a string. Lua names such chunks after their source
+ * but only ever shows the start of its first line, so we pass just that much: the messages
+ * are the same, and functions don't carry a copy of the whole script in their debug info
+ * (which lua_dump would write out once per function).
+ */
+inline std::string chunkName(const std::string_view aSource) {
+  std::size_t length = std::min<std::size_t>(aSource.size(), LUA_IDSIZE);
+  if (auto newline = aSource.find('\n'); newline < length) {
+    length = newline + 1; // Keep the newline, which is what makes Lua append "..."
+  }
+  return std::string{aSource.substr(0, length)};
+}
+
+/*
+ * The read-only contents of a file: memory-mapped where mmap is available, so the file is
+ * paged in on demand and never copied, and read into memory otherwise.
+ */
+class MappedFile {
+  public:
+  explicit MappedFile(std::string const &aPath) {
+    using namespace std::string_literals;
+#ifdef LUABIND_HAS_MMAP
+    int fd = open(aPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw FileError("cannot open "s + aPath);
+    }
+    struct stat info{};
+    if (fstat(fd, &info)!=0) {
+      ::close(fd);
+      throw FileError("cannot read "s + aPath);
+    }
+    fSize = static_cast<std::size_t>(info.st_size);
+    if (fSize > 0) {
+      void *mapping = mmap(nullptr, fSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping==MAP_FAILED) {
+        ::close(fd);
+        throw FileError("cannot map "s + aPath);
+      }
+      fData = static_cast<const char *>(mapping);
+    }
+    ::close(fd);
+#else
+    std::ifstream file(aPath, std::ios::binary);
+    if (!file) {
+      throw FileError("cannot open "s + aPath);
+    }
+    fContents.assign(std::istreambuf_iterator<char>(file), {});
+    fData = fContents.data();
+    fSize = fContents.size();
+#endif
+  }
+
+  MappedFile(MappedFile const &) = delete;
+
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  ~MappedFile() {
+#ifdef LUABIND_HAS_MMAP
+    if (fData!=nullptr) {
+      munmap(const_cast<char *>(fData), fSize);
+    }
+#endif
+  }
+
+  [[nodiscard]] std::string_view contents() const {
+    return {fData, fSize};
+  }
+
+  private:
+  const char *fData = nullptr;
+  std::size_t fSize = 0;
+#ifndef LUABIND_HAS_MMAP
+  std::string fContents;
+#endif
+};
+
+/*
+ * A lua_Reader over a prefix and a source held elsewhere, handed to lua_load in bounded
+ * pieces straight from their memory: nothing is copied or NUL-terminated.
+ */
+struct ChunkReader {
+  static constexpr std::size_t PIECE_SIZE = 64*1024;
+
+  std::string_view fPrefix;
+  std::string_view fSource;
+
+  static const char *read(lua_State *, void *aReader, std::size_t *aSize) {
+    auto &reader = *static_cast<ChunkReader *>(aReader);
+    auto &next = reader.fPrefix.empty() ? reader.fSource : reader.fPrefix;
+    *aSize = std::min(next.size(), PIECE_SIZE);
+    const char *piece = next.data();
+    next.remove_prefix(*aSize);
+    return *aSize==0 ? nullptr : piece;
+  }
+};
+
+/*
+ * The part of a script file's contents Lua should parse: like luaL_loadfile, this skips a
+ * first line starting with '#' (a Unix "#!" line), keeping its newline so that line
+ * numbers are unchanged
+ */
+inline std::string_view scriptSource(std::string_view aContents) {
+  if (aContents.starts_with('#')) {
+    aContents.remove_prefix(std::min(aContents.find('\n'), aContents.size()));
   }
+  return aContents;
+}
+
+inline bool isPrecompiled(const std::string_view aSource) {
+  return aSource.starts_with(LUA_SIGNATURE);
+}
+
+/*
+ * Loads aSource (after aPrefix, on the same line so line numbers are unchanged) as a
+ * chunk named aChunkName, leaving the function or the error message on the stack
+ */
+inline int loadChunk(lua_State *aState, const std::string_view aPrefix, const std::string_view aSource,
+                     const char *aChunkName) {
+  ChunkReader reader{aPrefix, aSource};
+  return lua_load(aState, &ChunkReader::read, &reader, aChunkName, nullptr);
 }
 }
 
-namespace luabind {
+namespace luabind {
+/*
+ * What to record about the Lua call stack when a Lua error is raised during a call from C++:
+ * - NONE:      nothing; the exception carries only the error message. No message handler
+ *              is installed, so this costs nothing.
+ * - FRAMES:    the source, line and function name of each frame, attached to the
+ *              RuntimeError as frames(). No strings are built unless traceback() is called.
+ * - TRACEBACK: Lua's standard string traceback (luaL_traceback), appended to the message.
+ */
+enum class ErrorHandlerMode {
+  NONE,
+  FRAMES,
+  TRACEBACK
+};
+
+/*
+ * Lua 5.4 has two garbage collection modes. The incremental collector interleaves small
+ * steps of a full mark-and-sweep with the program; the generational collector does frequent
+ * cheap collections of young objects and occasional full ones. Parameter values of 0 leave
+ * the current setting unchanged. See the Lua manual, section 2.5, for their meaning.
+ */
+enum class GcMode {
+  INCREMENTAL,
+  GENERATIONAL
+};
+
+struct IncrementalGcParams {
+  int fPause = 0;          // Percentage of memory growth between cycles
+  int fStepMultiplier = 0; // Collection speed relative to allocation, as a percentage
+  int fStepSize = 0;       // log2 of the bytes allocated between steps
+};
+
+struct GenerationalGcParams {
+  int fMinorMultiplier = 0; // Percentage of memory growth between minor collections
+  int fMajorMultiplier = 0; // Percentage of memory growth that triggers a major collection
+};
+
+class Environment;
+
+template <typename ...Values>
+class LuaRange;
+
 /*
  * Store globals in Lua, retrieve or call globals from Lua.
  * Globals can be primitives or functions.
@@ -583,21 +2689,188 @@ class Lua {
 
   Lua& operator=(Lua const&) = delete; // Copy constructor
 
-  Lua(Lua&& aOther) : fState(aOther.fState), fOwnsState(aOther.fOwnsState) { // Move constructor
+  Lua(Lua&& aOther) // Move constructor
+      : fState(aOther.fState), fOwnsState(aOther.fOwnsState), fErrorHandlerMode(aOther.fErrorHandlerMode),
+        fErrorHandlerRef(aOther.fErrorHandlerRef), fCapturedFrames(aOther.fCapturedFrames),
+        fCallObserver(std::exchange(aOther.fCallObserver, nullptr)) {
     aOther.fState = nullptr;
     aOther.fOwnsState = false;
+    aOther.fErrorHandlerRef = LUA_NOREF;
   }
 
   Lua& operator=(Lua&& aOther) { // Move assignment
     std::swap(this->fState, aOther.fState);
-    this->fOwnsState = aOther.fOwnsState;
+    std::swap(this->fOwnsState, aOther.fOwnsState);
+    std::swap(this->fErrorHandlerMode, aOther.fErrorHandlerMode);
+    std::swap(this->fErrorHandlerRef, aOther.fErrorHandlerRef);
+    std::swap(this->fCapturedFrames, aOther.fCapturedFrames);
+    std::swap(this->fCallObserver, aOther.fCallObserver);
     return *this;
   }
 
   ~Lua() {
+    if (fCallObserver != nullptr) {
+      detail::gObservedStates.fetch_sub(1, std::memory_order_relaxed);
+    }
     if (fOwnsState && fState != nullptr) {
       lua_close(fState);
+    } else if (fState != nullptr) {
+      // We don't own the state, so don't leave our handler pinned in its registry
+      luaL_unref(fState, LUA_REGISTRYINDEX, fErrorHandlerRef);
+      if (fCallObserver != nullptr) {
+        lua_pushnil(fState);
+        lua_rawsetp(fState, LUA_REGISTRYINDEX, &detail::CALL_OBSERVER_KEY);
+      }
+    }
+  }
+
+  /*
+   * The underlying state, for use with the Lua C API
+   */
+  [[nodiscard]] lua_State *state() const {
+    return fState;
+  }
+
+  /*
+   * Installs aObserver to see the calls made through this state (see CallObserver), or
+   * removes the current one when given nullptr. The observer must outlive the Lua or be
+   * removed first.
+   */
+  void setCallObserver(CallObserver *aObserver) {
+    if ((fCallObserver==nullptr)!=(aObserver==nullptr)) {
+      detail::gObservedStates.fetch_add(aObserver==nullptr ? -1 : 1, std::memory_order_relaxed);
+    }
+    fCallObserver = aObserver;
+    if (aObserver==nullptr) {
+      lua_pushnil(fState);
+    } else {
+      lua_pushlightuserdata(fState, aObserver);
+    }
+    lua_rawsetp(fState, LUA_REGISTRYINDEX, &detail::CALL_OBSERVER_KEY);
+  }
+
+  [[nodiscard]] CallObserver *callObserver() const {
+    return fCallObserver;
+  }
+
+  /*
+   * Selects what is recorded about the Lua call stack when a call from C++ into Lua fails
+   * (see ErrorHandlerMode). The message handler is created once here and kept in the
+   * registry, so each call only pays for pushing it.
+   */
+  void setErrorHandlerMode(ErrorHandlerMode aMode) {
+    luaL_unref(fState, LUA_REGISTRYINDEX, fErrorHandlerRef);
+    fErrorHandlerRef = LUA_NOREF;
+    fCapturedFrames = nullptr;
+    fErrorHandlerMode = aMode;
+    switch (aMode) {
+      case ErrorHandlerMode::NONE:return;
+      case ErrorHandlerMode::FRAMES: {
+        fCapturedFrames = static_cast<detail::CapturedFrames *>(lua_newuserdatauv(fState, sizeof(detail::CapturedFrames), 0));
+        fCapturedFrames->fCount = 0;
+        lua_pushcclosure(fState, &detail::captureFramesHandler, 1);
+        break;
+      }
+      case ErrorHandlerMode::TRACEBACK:lua_pushcfunction(fState, &detail::tracebackHandler);
+        break;
+    }
+    fErrorHandlerRef = luaL_ref(fState, LUA_REGISTRYINDEX);
+  }
+
+  [[nodiscard]] ErrorHandlerMode errorHandlerMode() const {
+    return fErrorHandlerMode;
+  }
+
+  /*
+   * Garbage collector control. Latency-sensitive code can pick a collector mode and tune
+   * it, stop the collector across a critical section with stopGcInScope(), and do the
+   * deferred work explicitly between requests with stepGc() or stepGcFor().
+   */
+  GcMode setIncrementalGc(IncrementalGcParams const &aParams = {}) {
+    int previous = lua_gc(fState, LUA_GCINC, aParams.fPause, aParams.fStepMultiplier, aParams.fStepSize);
+    return previous==LUA_GCGEN ? GcMode::GENERATIONAL : GcMode::INCREMENTAL;
+  }
+
+  GcMode setGenerationalGc(GenerationalGcParams const &aParams = {}) {
+    int previous = lua_gc(fState, LUA_GCGEN, aParams.fMinorMultiplier, aParams.fMajorMultiplier);
+    return previous==LUA_GCGEN ? GcMode::GENERATIONAL : GcMode::INCREMENTAL;
+  }
+
+  void stopGc() {
+    lua_gc(fState, LUA_GCSTOP);
+  }
+
+  void restartGc() {
+    lua_gc(fState, LUA_GCRESTART);
+  }
+
+  [[nodiscard]] bool isGcRunning() const {
+    return lua_gc(fState, LUA_GCISRUNNING);
+  }
+
+  /*
+   * Stops the collector until the returned guard is destroyed, then restarts it if it was
+   * running before. Allocation continues normally; the debt is paid when collection resumes
+   * (or earlier, by explicit steps).
+   */
+  class GcStopGuard {
+    public:
+    explicit GcStopGuard(lua_State *aState) : fState(aState), fWasRunning(lua_gc(aState, LUA_GCISRUNNING)) {
+      lua_gc(fState, LUA_GCSTOP);
+    }
+
+    GcStopGuard(GcStopGuard const &) = delete;
+
+    GcStopGuard &operator=(GcStopGuard const &) = delete;
+
+    ~GcStopGuard() {
+      if (fWasRunning) {
+        lua_gc(fState, LUA_GCRESTART);
+      }
     }
+
+    private:
+    lua_State *fState;
+    bool fWasRunning;
+  };
+
+  [[nodiscard]] GcStopGuard stopGcInScope() {
+    return GcStopGuard{fState};
+  }
+
+  /*
+   * Performs one bounded step of collection work (roughly aKilobytes worth of allocation,
+   * or a basic step if 0), even if the collector is stopped. Returns true if the step
+   * finished a collection cycle.
+   */
+  bool stepGc(int aKilobytes = 0) {
+    return lua_gc(fState, LUA_GCSTEP, aKilobytes);
+  }
+
+  /*
+   * Performs collection steps until aBudget has elapsed or a cycle finishes, for use in
+   * idle time between requests. Returns true if a cycle finished.
+   */
+  template <typename Rep, typename Period>
+  bool stepGcFor(std::chrono::duration<Rep, Period> aBudget, int aKilobytesPerStep = 0) {
+    auto deadline = std::chrono::steady_clock::now() + aBudget;
+    do {
+      if (stepGc(aKilobytesPerStep)) {
+        return true;
+      }
+    } while (std::chrono::steady_clock::now() < deadline);
+    return false;
+  }
+
+  void collectGarbage() {
+    lua_gc(fState, LUA_GCCOLLECT);
+  }
+
+  /*
+   * Bytes currently allocated by the state
+   */
+  [[nodiscard]] std::size_t memoryInUse() const {
+    return static_cast<std::size_t>(lua_gc(fState, LUA_GCCOUNT))*1024 + lua_gc(fState, LUA_GCCOUNTB);
   }
 
   /*
@@ -622,30 +2895,41 @@ class Lua {
    * interface for storing and referencing Lua symbols from C++.
    */
   struct GetGlobalHelper {
-    GetGlobalHelper(const std::string_view aGlobalName, Lua &aLua)
-        : fGlobalName(aGlobalName), fLua(aLua) {}
+    GetGlobalHelper(const std::string_view aGlobalName, Lua &aLua, int aEnvironmentRef = LUA_NOREF)
+        : fGlobalName(aGlobalName), fLua(aLua), fEnvironmentRef(aEnvironmentRef) {}
 
     template <typename ...Args>
     auto operator()(const Args &... aArgs) {
-      return fLua.call(fGlobalName, aArgs...);
+      return fLua.callIn(fEnvironmentRef, fGlobalName, aArgs...);
     }
 
     template <typename T>
     operator T() { // NOLINT(google-explicit-constructor)
-      lua_getglobal(fLua.fState, fGlobalName.data());
+      return as<T>();
+    }
+
+    /*
+     * The conversion operator, spelled out. Needed for std::optional and std::variant,
+     * whose converting constructors make "std::optional<int> x = lua[name]" ambiguous:
+     * write "auto x = lua[name].as<std::optional<int>>()" instead.
+     */
+    template <typename T>
+    T as() {
+      fLua.getName(fEnvironmentRef, fGlobalName);
       return detail::fromLua<T>(fLua.fState);
     }
 
     template <typename T>
     Lua &operator=(T const &aVal) { // NOLINT(misc-unconventional-assign-operator)
       detail::toLua(fLua.fState, aVal);
-      lua_setglobal(fLua.fState, fGlobalName.data());
+      fLua.setName(fEnvironmentRef, fGlobalName);
       return fLua;
     }
 
     private:
     const std::string_view fGlobalName;
     Lua &fLua;
+    const int fEnvironmentRef; // LUA_NOREF for the global table
   };
 
   /*
@@ -655,6 +2939,152 @@ class Lua {
     return GetGlobalHelper{aGlobalName, *this};
   }
 
+  /*
+   * A Chunk is a piece of Lua code compiled once by compile() and then run any number of
+   * times, either against the global table with run() or inside an Environment. It holds
+   * a registry reference and must not outlive the Lua that compiled it.
+   */
+  class Chunk {
+    public:
+    Chunk(Chunk const &) = delete;
+
+    Chunk &operator=(Chunk const &) = delete;
+
+    Chunk(Chunk &&aOther) noexcept : fState(aOther.fState), fRef(std::exchange(aOther.fRef, LUA_NOREF)) {}
+
+    Chunk &operator=(Chunk &&aOther) noexcept {
+      std::swap(fState, aOther.fState);
+      std::swap(fRef, aOther.fRef);
+      return *this;
+    }
+
+    ~Chunk() {
+      luaL_unref(fState, LUA_REGISTRYINDEX, fRef);
+    }
+
+    private:
+    friend class Lua;
+
+    Chunk(lua_State *aState, int aRef) : fState(aState), fRef(aRef) {}
+
+    lua_State *fState;
+    int fRef;
+  };
+
+  /*
+   * Compiles aCode without running it. The chunk reads its globals from an _ENV passed
+   * in when it is run, so one compilation can be shared by any number of environments.
+   */
+  [[nodiscard]] Chunk compile(const std::string_view aCode) {
+    // Naming the chunk after the original source keeps error messages as they would be
+    // for loadScript
+    return compileChunk(aCode, detail::chunkName(aCode).c_str());
+  }
+
+  /*
+   * Compiles the script at aPath without running it, like compile(). The file is mapped
+   * and parsed in place, never copied into a string. A first line starting with '#' is
+   * skipped. Precompiled chunks can't be given an environment per run, so they are
+   * rejected with a FileError; run them with runFile.
+   */
+  [[nodiscard]] Chunk loadFile(std::string const &aPath) {
+    detail::MappedFile file(aPath);
+    auto source = detail::scriptSource(file.contents());
+    if (detail::isPrecompiled(source)) {
+      throw FileError(aPath + " is a precompiled chunk, which loadFile can't compile (use runFile)");
+    }
+    return compileChunk(source, ("@" + aPath).c_str());
+  }
+
+  /*
+   * Runs the script (or precompiled chunk) at aPath against the global table, like
+   * operator<< (and, like loadFile, without copying it)
+   */
+  void runFile(std::string const &aPath) {
+    detail::MappedFile file(aPath);
+    handleLuaErrCode(detail::loadChunk(fState, {}, detail::scriptSource(file.contents()), ("@" + aPath).c_str()));
+    handleLuaErrCode(protectedCall(0, LUA_MULTRET));
+  }
+
+  /*
+   * Runs aChunk against the global table
+   */
+  void run(Chunk const &aChunk) {
+    runIn(LUA_NOREF, aChunk);
+  }
+
+  /*
+   * Creates an empty Environment on top of the global table; see Environment.
+   */
+  [[nodiscard]] Environment newEnvironment();
+
+  /*
+   * Calls the global aFunctionName with aArgs and iterates over what it returns the way a
+   * generic for loop would: an iterator function (plus optional state and control
+   * values), such as a generator made with coroutine.wrap or the results of pairs. See
+   * LuaRange.
+   *
+   *   for (int id : lua.iterate<int>("matching", "pattern")) { ... }
+   *   for (auto [key, value] : lua.iterate<std::string, int>("pairs", ...)) { ... }
+   */
+  template <typename ...Values, typename ...Args>
+  [[nodiscard]] LuaRange<Values...> iterate(const std::string_view aFunctionName, const Args &... aArgs);
+
+  private:
+  friend class Environment;
+
+  template <typename ...Values>
+  friend class LuaRange;
+
+  Chunk compileChunk(const std::string_view aCode, const char *aChunkName) {
+    // The chunk takes its _ENV as an argument; declaring it on the first line keeps line numbers
+    handleLuaErrCode(detail::loadChunk(fState, "local _ENV = ...; ", aCode, aChunkName));
+    return Chunk{fState, luaL_ref(fState, LUA_REGISTRYINDEX)};
+  }
+
+  /*
+   * Pushes the table that names are resolved in: an environment's table, or the global
+   * table for LUA_NOREF.
+   */
+  void pushScope(int aEnvironmentRef) {
+    if (aEnvironmentRef==LUA_NOREF) {
+      lua_pushglobaltable(fState);
+    } else {
+      lua_rawgeti(fState, LUA_REGISTRYINDEX, aEnvironmentRef);
+    }
+  }
+
+  void getName(int aEnvironmentRef, const std::string_view aName) {
+    if (aEnvironmentRef==LUA_NOREF) {
+      lua_getglobal(fState, aName.data());
+      return;
+    }
+    pushScope(aEnvironmentRef);
+    lua_getfield(fState, -1, aName.data()); // Misses fall through to the base via __index
+    lua_remove(fState, -2);
+  }
+
+  /*
+   * Pops the value on top of the stack into aName
+   */
+  void setName(int aEnvironmentRef, const std::string_view aName) {
+    if (aEnvironmentRef==LUA_NOREF) {
+      lua_setglobal(fState, aName.data());
+      return;
+    }
+    pushScope(aEnvironmentRef);
+    lua_insert(fState, -2);
+    lua_setfield(fState, -2, aName.data());
+    lua_pop(fState, 1);
+  }
+
+  void runIn(int aEnvironmentRef, Chunk const &aChunk) {
+    lua_rawgeti(fState, LUA_REGISTRYINDEX, aChunk.fRef);
+    pushScope(aEnvironmentRef);
+    auto res = protectedCall(1, 0);
+    handleLuaErrCode(res);
+  }
+
   private:
   /*
    * RetHelper is an RAII/casting helper to "deduce" a function's output type
@@ -677,6 +3107,11 @@ class Lua {
 
     template <typename T>
     operator T() { // NOLINT(google-explicit-constructor)
+      return as<T>();
+    }
+
+    template <typename T>
+    T as() {
       assert(!fWasCasted); // We can only pop off the stack once
       fWasCasted = true;
       return detail::fromLua<T>(fState);
@@ -688,10 +3123,10 @@ class Lua {
   };
 
   template <typename ...Args>
-  void pushFunctionAndArgs(const std::string_view aFunctionName, const Args &... aArgs) {
+  void pushFunctionAndArgs(int aEnvironmentRef, const std::string_view aFunctionName, const Args &... aArgs) {
     using namespace std::string_literals;
     // push function on stack
-    lua_getglobal(fState, aFunctionName.data());
+    getName(aEnvironmentRef, aFunctionName);
 
     if (!lua_isfunction(fState, -1) && !lua_iscfunction(fState, -1)) {
       lua_pop(fState, 1); // We need to clean up the global we retrieved before throwing
@@ -709,7 +3144,11 @@ class Lua {
     };
     switch (aErrCode) {
       case LUA_OK:break;
-      case LUA_ERRRUN:throw RuntimeError(stringFromErrorOnStack());
+      case LUA_ERRRUN:
+        if (fCapturedFrames != nullptr) {
+          throw RuntimeError(stringFromErrorOnStack(), fCapturedFrames->toStackFrames());
+        }
+        throw RuntimeError(stringFromErrorOnStack());
       case LUA_ERRMEM:throw MemoryError(stringFromErrorOnStack());
       case LUA_ERRERR:throw ErrorHandlerError(stringFromErrorOnStack());
       case LUA_ERRSYNTAX:throw SyntaxError(stringFromErrorOnStack());
@@ -718,25 +3157,56 @@ class Lua {
     }
   }
 
+  /*
+   * lua_pcall with the configured message handler (if any). The function and its
+   * aArgCount arguments must be on top of the stack. The handler is slotted in below the
+   * function for the duration of the call and removed again afterwards, leaving the
+   * stack exactly as a plain lua_pcall would.
+   */
+  int protectedCall(int aArgCount, int aResultCount) {
+    if (fErrorHandlerRef==LUA_NOREF) {
+      return lua_pcall(fState, aArgCount, aResultCount, 0);
+    }
+    int handlerIdx = lua_gettop(fState) - aArgCount;
+    lua_rawgeti(fState, LUA_REGISTRYINDEX, fErrorHandlerRef);
+    lua_insert(fState, handlerIdx);
+    auto errCode = lua_pcall(fState, aArgCount, aResultCount, handlerIdx);
+    lua_remove(fState, handlerIdx);
+    return errCode;
+  }
+
+  /*
+   * protectedCall for a call to a named function, reported to the call observer if any
+   */
+  int observedCall(const std::string_view aFunctionName, int aArgCount, int aResultCount) {
+    if (fCallObserver==nullptr) {
+      return protectedCall(aArgCount, aResultCount);
+    }
+    fCallObserver->callStarting(fState, aFunctionName, aArgCount);
+    auto errCode = protectedCall(aArgCount, aResultCount);
+    fCallObserver->callFinished(fState, errCode==LUA_OK);
+    return errCode;
+  }
+
   template <typename ...Args>
-  void callWithoutReturnValue(const std::string_view aFunctionName, const Args &... aArgs) {
-    pushFunctionAndArgs(aFunctionName, aArgs...);
-    auto errCode = lua_pcall(fState, sizeof...(aArgs), 0, 0);
+  void callWithoutReturnValue(int aEnvironmentRef, const std::string_view aFunctionName, const Args &... aArgs) {
+    pushFunctionAndArgs(aEnvironmentRef, aFunctionName, aArgs...);
+    auto errCode = observedCall(aFunctionName, sizeof...(aArgs), 0);
     handleLuaErrCode(errCode);
   }
 
   template <typename ...Args>
-  auto callWithReturnValue(const std::string_view aFunctionName, const Args &... aArgs) {
-    pushFunctionAndArgs(aFunctionName, aArgs...);
-    auto errCode = lua_pcall(fState, sizeof...(aArgs), 1, 0);
+  auto callWithReturnValue(int aEnvironmentRef, const std::string_view aFunctionName, const Args &... aArgs) {
+    pushFunctionAndArgs(aEnvironmentRef, aFunctionName, aArgs...);
+    auto errCode = observedCall(aFunctionName, sizeof...(aArgs), 1);
     handleLuaErrCode(errCode);
     return RetHelper(fState);
   }
 
   void loadScript(const std::string_view aScript) {
-    auto res = luaL_loadstring(fState, aScript.data());
+    auto res = detail::loadChunk(fState, {}, aScript, detail::chunkName(aScript).c_str());
     handleLuaErrCode(res);
-    res = lua_pcall(fState, 0, LUA_MULTRET, 0);
+    res = protectedCall(0, LUA_MULTRET);
     handleLuaErrCode(res);
   }
 
@@ -749,26 +3219,36 @@ class Lua {
    */
   template <typename ...Args>
   struct CallHelper {
-    CallHelper(Lua &aLua, const std::string_view aFunctionName, const std::tuple<Args...> &aArgs)
-        : fLua(aLua), fFunctionName(aFunctionName), fArgs{aArgs}, fWasCasted(false) {}
+    CallHelper(Lua &aLua, int aEnvironmentRef, const std::string_view aFunctionName, const std::tuple<Args...> &aArgs)
+        : fLua(aLua), fEnvironmentRef(aEnvironmentRef), fFunctionName(aFunctionName), fArgs{aArgs}, fWasCasted(false) {}
 
     ~CallHelper() {
       // If we never called the operator T(), we should run the function with no return val
       if (!fWasCasted) {
         auto lam = [&](auto const &... aArgs) { fLua.callWithoutReturnValue(aArgs...); };
-        std::apply(lam, std::tuple_cat(std::tuple{fFunctionName}, fArgs));
+        std::apply(lam, std::tuple_cat(std::tuple{fEnvironmentRef, fFunctionName}, fArgs));
       }
     }
 
     template <typename T>
     operator T() { // NOLINT(google-explicit-constructor)
+      return as<T>();
+    }
+
+    /*
+     * Calls the function and converts its result, like the conversion operator; see
+     * GetGlobalHelper::as for when this is needed
+     */
+    template <typename T>
+    T as() {
       fWasCasted = true;
       auto lam = [&](auto const &... aArgs) { return fLua.callWithReturnValue(aArgs...); };
-      return std::apply(lam, std::tuple_cat(std::tuple{fFunctionName}, fArgs));
+      return std::apply(lam, std::tuple_cat(std::tuple{fEnvironmentRef, fFunctionName}, fArgs)).template as<T>();
     }
 
     private:
     Lua &fLua;
+    const int fEnvironmentRef;
     const std::string_view fFunctionName;
     const std::tuple<Args...> fArgs;
     bool fWasCasted;
@@ -776,19 +3256,326 @@ class Lua {
 
   template <typename ...Args>
   auto call(const std::string_view aFunctionName, const Args &... aArgs) {
-    return CallHelper{*this, aFunctionName, std::tuple{aArgs...}};
+    return callIn(LUA_NOREF, aFunctionName, aArgs...);
+  }
+
+  template <typename ...Args>
+  auto callIn(int aEnvironmentRef, const std::string_view aFunctionName, const Args &... aArgs) {
+    return CallHelper{*this, aEnvironmentRef, aFunctionName, std::make_tuple(aArgs...)};
   }
 
   private:
   lua_State *fState;
   bool fOwnsState;
+  ErrorHandlerMode fErrorHandlerMode = ErrorHandlerMode::NONE;
+  int fErrorHandlerRef = LUA_NOREF;
+  detail::CapturedFrames *fCapturedFrames = nullptr; // Owned by the handler closure, when mode is FRAMES
+  CallObserver *fCallObserver = nullptr;
+};
+
+/*
+ * LuaRange is a C++ input range over a Lua iterator, made by Lua::iterate. Each step calls
+ * the iterator function, so elements are converted one at a time and a generator of any
+ * length runs in bounded memory. With one value type the range yields that type; with
+ * several it yields a tuple of the first values the iterator returns.
+ *
+ * Iteration stops when the iterator returns nil. An error raised by the iterator, or a
+ * value of the wrong type, throws from the increment (or from begin() for the first
+ * element). A LuaRange holds a registry reference and must not outlive its Lua.
+ */
+template <typename ...Values>
+class LuaRange {
+  public:
+  static_assert(sizeof...(Values) > 0, "LuaRange needs at least one value type");
+
+  using value_type = std::conditional_t<sizeof...(Values)==1, std::tuple_element_t<0, std::tuple<Values...>>,
+                                        std::tuple<Values...>>;
+
+  class iterator {
+    public:
+    using value_type = LuaRange::value_type;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+
+    value_type &operator*() const {
+      return *fRange->fCurrent;
+    }
+
+    iterator &operator++() {
+      fRange->advance();
+      return *this;
+    }
+
+    void operator++(int) {
+      fRange->advance();
+    }
+
+    bool operator==(std::default_sentinel_t) const {
+      return !fRange->fCurrent;
+    }
+
+    private:
+    friend class LuaRange;
+
+    explicit iterator(LuaRange *aRange) : fRange(aRange) {}
+
+    LuaRange *fRange = nullptr;
+  };
+
+  LuaRange(LuaRange const &) = delete;
+
+  LuaRange &operator=(LuaRange const &) = delete;
+
+  LuaRange(LuaRange &&aOther) noexcept
+      : fLua(aOther.fLua), fRef(std::exchange(aOther.fRef, LUA_NOREF)), fCurrent(std::move(aOther.fCurrent)),
+        fStarted(aOther.fStarted) {}
+
+  ~LuaRange() {
+    luaL_unref(fLua->fState, LUA_REGISTRYINDEX, fRef);
+  }
+
+  iterator begin() {
+    if (!fStarted) {
+      fStarted = true;
+      advance();
+    }
+    return iterator{this};
+  }
+
+  [[nodiscard]] std::default_sentinel_t end() const {
+    return {};
+  }
+
+  private:
+  friend class Lua;
+
+  static constexpr int VALUE_COUNT = sizeof...(Values);
+
+  // The registry reference is to the table { iterator function, state, control value }
+  static constexpr lua_Integer FUNCTION = 1;
+  static constexpr lua_Integer STATE = 2;
+  static constexpr lua_Integer CONTROL = 3;
+
+  LuaRange(Lua &aLua, int aRef) : fLua(&aLua), fRef(aRef) {}
+
+  void advance() {
+    lua_State *state = fLua->fState;
+    fCurrent.reset();
+    lua_rawgeti(state, LUA_REGISTRYINDEX, fRef);
+    int iterationIdx = lua_gettop(state);
+    lua_rawgeti(state, iterationIdx, FUNCTION);
+    lua_rawgeti(state, iterationIdx, STATE);
+    lua_rawgeti(state, iterationIdx, CONTROL);
+    int errCode = fLua->protectedCall(2, VALUE_COUNT);
+    if (errCode!=LUA_OK) {
+      lua_remove(state, iterationIdx);
+      fLua->handleLuaErrCode(errCode);
+    }
+    auto guard = detail::makeScopeGuard([state, iterationIdx]() { lua_settop(state, iterationIdx - 1); });
+    int firstIdx = iterationIdx + 1;
+    if (lua_isnil(state, firstIdx)) {
+      return;
+    }
+    lua_pushvalue(state, firstIdx);
+    lua_rawseti(state, iterationIdx, CONTROL);
+
+    if constexpr (VALUE_COUNT==1) {
+      auto value = detail::tryFromLua<value_type>(state, firstIdx);
+      if (!value) {
+        throw IncorrectType(value.reason());
+      }
+      fCurrent.emplace(std::move(*value));
+    } else {
+      auto values = detail::tryConvertEach<value_type>([state, firstIdx](auto aI) {
+        return detail::tryFromLua<std::tuple_element_t<decltype(aI)::value, value_type>>(state,
+                                                                                         firstIdx + static_cast<int>(decltype(aI)::value));
+      }, std::make_index_sequence<VALUE_COUNT>());
+      if (!values) {
+        throw IncorrectType(values.reason());
+      }
+      fCurrent.emplace(std::move(*values));
+    }
+  }
+
+  Lua *fLua;
+  int fRef;
+  std::optional<value_type> fCurrent;
+  bool fStarted = false;
+};
+
+template <typename ...Values, typename ...Args>
+LuaRange<Values...> Lua::iterate(const std::string_view aFunctionName, const Args &... aArgs) {
+  pushFunctionAndArgs(LUA_NOREF, aFunctionName, aArgs...);
+  handleLuaErrCode(protectedCall(sizeof...(aArgs), 3));
+  lua_createtable(fState, 3, 0);
+  lua_insert(fState, -4);
+  for (lua_Integer i = 3; i >= 1; --i) {
+    lua_rawseti(fState, -1 - static_cast<int>(i), i);
+  }
+  return LuaRange<Values...>(*this, luaL_ref(fState, LUA_REGISTRYINDEX));
+}
+
+/*
+ * An Environment is a private global namespace layered over the state's global table,
+ * for isolating requests or tenants without creating and initializing a state for each.
+ * It is a single table whose metatable (shared by all environments) sends reads of
+ * missing names to the global table, so everything the initialization scripts defined
+ * is visible, while every assignment lands in the environment:
+ *
+ *   auto env = lua.newEnvironment();
+ *   env["request"] = body;
+ *   env << "response = handle(request)"; // handle is a global, response stays in env
+ *   std::string response = env["response"];
+ *
+ * Code run in an environment (with operator<< or run()) sees the environment as _ENV, and
+ * _G refers to the environment rather than the global table. Functions defined that way
+ * keep the environment; calling a global function through env["f"]() resolves f in the
+ * environment but runs it with the globals it was defined with.
+ *
+ * The shared base is frozen: tables reached through the global table (string, math,
+ * configuration tables...) are seen through read-only views, so one environment can't
+ * change what another sees. Views read the real tables live and support indexing, #,
+ * pairs and ipairs, but not next or raw access, and conversions to C++ containers read
+ * them as empty. What isn't covered: global functions defined by the base scripts still
+ * assign into the real globals, and tables reached other than through names (the string
+ * metatable, values returned by functions) are not wrapped.
+ *
+ * An Environment must not outlive the Lua that created it.
+ */
+class Environment {
+  public:
+  Environment(Environment const &) = delete;
+
+  Environment &operator=(Environment const &) = delete;
+
+  Environment(Environment &&aOther) noexcept
+      : fLua(aOther.fLua), fRef(std::exchange(aOther.fRef, LUA_NOREF)) {}
+
+  Environment &operator=(Environment &&aOther) noexcept {
+    std::swap(fLua, aOther.fLua);
+    std::swap(fRef, aOther.fRef);
+    return *this;
+  }
+
+  ~Environment() {
+    luaL_unref(fLua->fState, LUA_REGISTRYINDEX, fRef);
+  }
+
+  /*
+   * Gets the name aName as seen from the environment: its own value if it has one,
+   * otherwise the global of that name. Assignment always stores into the environment.
+   */
+  auto operator[](const std::string_view aName) {
+    return Lua::GetGlobalHelper{aName, *fLua, fRef};
+  }
+
+  /*
+   * Compiles and runs aCodeToRun in the environment. To run the same code for many
+   * environments, compile() it once and use run().
+   */
+  Environment &operator<<(const std::string_view aCodeToRun) {
+    run(fLua->compile(aCodeToRun));
+    return *this;
+  }
+
+  void run(Lua::Chunk const &aChunk) {
+    fLua->runIn(fRef, aChunk);
+  }
+
+  private:
+  friend class Lua;
+
+  Environment(Lua &aLua, int aRef) : fLua(&aLua), fRef(aRef) {}
+
+  Lua *fLua;
+  int fRef;
 };
 
+inline Environment Lua::newEnvironment() {
+  lua_createtable(fState, 0, 1);
+  if (lua_rawgetp(fState, LUA_REGISTRYINDEX, &detail::ENVIRONMENT_METATABLE_KEY)==LUA_TNIL) {
+    lua_pop(fState, 1);
+    lua_createtable(fState, 0, 2);
+    lua_pushcfunction(fState, &detail::environmentIndex);
+    lua_setfield(fState, -2, "__index");
+    lua_pushboolean(fState, false);
+    lua_setfield(fState, -2, "__metatable");
+    lua_pushvalue(fState, -1);
+    lua_rawsetp(fState, LUA_REGISTRYINDEX, &detail::ENVIRONMENT_METATABLE_KEY);
+  }
+  lua_setmetatable(fState, -2);
+  lua_pushvalue(fState, -1);
+  lua_setfield(fState, -2, "_G");
+  return Environment{*this, luaL_ref(fState, LUA_REGISTRYINDEX)};
+}
+
+inline std::pmr::memory_resource *scratchResource() {
+  return detail::conversionResource();
+}
+
 template <typename Callable, typename UniqueType>
 lua_CFunction adapt(const Callable &aFunc) {
-  detail::gCallable<Callable, UniqueType>.emplace(aFunc);
-  return &detail::adapted<Callable, UniqueType>;
+  if constexpr (detail::traits::is_stateless_v<Callable>) {
+    return &detail::adaptedStateless<Callable>;
+  } else {
+    detail::gCallable<Callable, UniqueType>.emplace(aFunc);
+    return &detail::adapted<Callable, UniqueType>;
+  }
 }
+
+template <auto Callable>
+lua_CFunction adapt() {
+  return &detail::adaptedStatic<Callable>;
+}
+
+/*
+ * def pairs a compile-time name with a compile-time callable (a function pointer or a
+ * captureless lambda) for registration in a luabind::module. Because the callable is
+ * a template argument, its lua_CFunction is a plain constant: no gCallable storage
+ * has to be initialized before it can be called.
+ */
+template <meta::DiscriminatorContainer Name, auto Callable>
+struct def {
+  static inline constexpr meta::DiscriminatorContainer fName = Name;
+  static inline constexpr lua_CFunction fFunction = &detail::adaptedStatic<Callable>;
+};
+
+/*
+ * module builds the luaL_Reg registration array for a C library at compile time from a
+ * list of luabind::def entries, so a require-d module does no work at load time beyond
+ * creating its table:
+ *
+ *   using MyModule = luabind::module<"mymodule"_f,
+ *       luabind::def<"say_hello"_f, []() { return "hello world!"; }>>;
+ *
+ *   extern "C" int luaopen_mymodule(lua_State *L) { return MyModule::open(L); }
+ *
+ * open() follows the require convention of returning the library table. openGlobal()
+ * additionally stores the table in the global of the module's name.
+ */
+template <meta::DiscriminatorContainer Name, typename ...Defs>
+struct module {
+  static inline constexpr meta::DiscriminatorContainer fName = Name;
+  static inline constexpr std::array<luaL_Reg, sizeof...(Defs) + 1> fFunctions{{
+      {Defs::fName.data(), Defs::fFunction}...,
+      {nullptr, nullptr}
+  }};
+
+  static int open(lua_State *aState) {
+    luaL_checkversion(aState);
+    lua_createtable(aState, 0, sizeof...(Defs));
+    luaL_setfuncs(aState, fFunctions.data(), 0);
+    return 1;
+  }
+
+  static int openGlobal(lua_State *aState) {
+    open(aState);
+    lua_pushvalue(aState, -1);
+    lua_setglobal(aState, fName.data());
+    return 1;
+  }
+};
 }
 
 #endif //LUABIND_LUABIND_HPP
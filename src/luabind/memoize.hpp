@@ -0,0 +1,339 @@
+#ifndef LUABIND_MEMOIZE_HPP
+#define LUABIND_MEMOIZE_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace luabind::detail::memoize {
+/*
+ * How an argument is stored in a cache key: string pointers and views, also inside
+ * tuples, are copied into strings, so keys compare by contents and don't dangle
+ */
+template <typename T>
+struct KeyElementOf {
+  using type = T;
+};
+
+template <>
+struct KeyElementOf<const char *> {
+  using type = std::string;
+};
+
+template <>
+struct KeyElementOf<char *> {
+  using type = std::string;
+};
+
+template <>
+struct KeyElementOf<std::string_view> {
+  using type = std::string;
+};
+
+template <typename ...Elements>
+struct KeyElementOf<std::tuple<Elements...>> {
+  using type = std::tuple<typename KeyElementOf<std::decay_t<Elements>>::type...>;
+};
+
+template <typename T>
+using KeyElement = typename KeyElementOf<std::decay_t<T>>::type;
+
+inline std::size_t combine(std::size_t aSeed, std::size_t aHash) {
+  return aSeed ^ (aHash + 0x9e3779b97f4a7c15ull + (aSeed << 6) + (aSeed >> 2));
+}
+
+/*
+ * Hashes the arguments memoization supports: arithmetic values, strings and tuples of those
+ */
+template <typename T>
+std::size_t hashValue(T const &aValue) {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_arithmetic_v<U>) {
+    return std::hash<U>{}(aValue);
+  } else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>
+      || std::is_same_v<U, const char *> || std::is_same_v<U, char *>) {
+    return std::hash<std::string_view>{}(aValue);
+  } else if constexpr (traits::is_tuple_v<U>) {
+    return std::apply([](auto const &... aElements) {
+      std::size_t seed = 0;
+      ((seed = combine(seed, hashValue(aElements))), ...);
+      return seed;
+    }, aValue);
+  } else {
+    static_assert(traits::always_false_v<T>, "Memoized arguments must be arithmetic values, strings or tuples");
+  }
+}
+
+template <typename Key>
+struct KeyHash {
+  std::size_t operator()(Key const &aKey) const {
+    return hashValue(aKey);
+  }
+};
+
+/*
+ * One shard of an LRU cache: a recency list (most recent first) indexed by key
+ */
+template <typename Key, typename Result>
+class LruShard {
+  public:
+  std::optional<Result> find(Key const &aKey) {
+    std::lock_guard lock(fMutex);
+    auto it = fIndex.find(aKey);
+    if (it==fIndex.end()) {
+      return std::nullopt;
+    }
+    fEntries.splice(fEntries.begin(), fEntries, it->second);
+    return it->second->second;
+  }
+
+  /*
+   * Returns true if an entry had to be evicted to stay within aCapacity
+   */
+  bool insert(Key aKey, Result aResult, std::size_t aCapacity) {
+    std::lock_guard lock(fMutex);
+    if (auto it = fIndex.find(aKey); it!=fIndex.end()) {
+      it->second->second = std::move(aResult);
+      fEntries.splice(fEntries.begin(), fEntries, it->second);
+      return false;
+    }
+    fEntries.emplace_front(std::move(aKey), std::move(aResult));
+    fIndex.emplace(fEntries.front().first, fEntries.begin());
+    if (fEntries.size() <= aCapacity) {
+      return false;
+    }
+    fIndex.erase(fEntries.back().first);
+    fEntries.pop_back();
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard lock(fMutex);
+    fIndex.clear();
+    fEntries.clear();
+  }
+
+  [[nodiscard]] std::size_t size() {
+    std::lock_guard lock(fMutex);
+    return fEntries.size();
+  }
+
+  private:
+  std::mutex fMutex;
+  std::list<std::pair<Key, Result>> fEntries;
+  std::unordered_map<Key, typename std::list<std::pair<Key, Result>>::iterator, KeyHash<Key>> fIndex;
+};
+}
+
+namespace luabind {
+struct MemoOptions {
+  std::size_t fCapacity = 4096; // Entries, across all shards
+  std::size_t fShards = 8;      // Independently locked parts, for caches shared between threads
+};
+
+struct MemoStats {
+  std::uint64_t fHits = 0;
+  std::uint64_t fMisses = 0;
+  std::uint64_t fEvictions = 0;
+  std::uint64_t fInvalidations = 0;
+
+  [[nodiscard]] double hitRate() const {
+    auto calls = fHits + fMisses;
+    return calls==0 ? 0.0 : static_cast<double>(fHits)/static_cast<double>(calls);
+  }
+};
+
+template <typename Signature>
+class MemoCache;
+
+/*
+ * A bounded LRU map from argument tuples to results, split into shards by key hash so
+ * that threads sharing it rarely contend. Each shard holds at most its share of the
+ * capacity, so the least recently used entry of the shard is what gets evicted. There
+ * are never more shards than entries of capacity.
+ */
+template <typename Result, typename ...Args>
+class MemoCache<Result(Args...)> {
+  public:
+  using Key = std::tuple<detail::memoize::KeyElement<Args>...>;
+
+  explicit MemoCache(MemoOptions const &aOptions = {})
+      : fShards(std::clamp<std::size_t>(aOptions.fShards, 1, std::max<std::size_t>(aOptions.fCapacity, 1))),
+        fShardCapacity(std::max<std::size_t>(aOptions.fCapacity/fShards.size(), 1)) {}
+
+  std::optional<Result> find(Key const &aKey, std::size_t aHash) {
+    auto result = fShards[aHash%fShards.size()].find(aKey);
+    (result ? fHits : fMisses).fetch_add(1, std::memory_order_relaxed);
+    return result;
+  }
+
+  void insert(Key aKey, std::size_t aHash, Result aResult) {
+    if (fShards[aHash%fShards.size()].insert(std::move(aKey), std::move(aResult), fShardCapacity)) {
+      fEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void clear() {
+    for (auto &shard : fShards) {
+      shard.clear();
+    }
+    fInvalidations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] std::size_t size() {
+    std::size_t size = 0;
+    for (auto &shard : fShards) {
+      size += shard.size();
+    }
+    return size;
+  }
+
+  [[nodiscard]] MemoStats stats() const {
+    return {fHits.load(std::memory_order_relaxed), fMisses.load(std::memory_order_relaxed),
+            fEvictions.load(std::memory_order_relaxed), fInvalidations.load(std::memory_order_relaxed)};
+  }
+
+  private:
+  std::vector<detail::memoize::LruShard<Key, Result>> fShards;
+  std::size_t fShardCapacity;
+  std::atomic<std::uint64_t> fHits = 0;
+  std::atomic<std::uint64_t> fMisses = 0;
+  std::atomic<std::uint64_t> fEvictions = 0;
+  std::atomic<std::uint64_t> fInvalidations = 0;
+};
+
+template <typename Signature>
+class Memoized;
+
+/*
+ * Memoized wraps a pure global Lua function so that repeated arguments are answered from
+ * a C++ cache: the arguments are hashed in C++ and a hit never touches the Lua state.
+ *
+ *   luabind::Memoized<std::string(int)> classify(lua, "classify", {.fCapacity = 10000});
+ *   std::string label = classify(key);
+ *   classify.stats().hitRate();
+ *
+ * Arguments must be arithmetic values, strings or tuples of those, and the function must
+ * depend on nothing but them. The cache is cleared when the global is replaced, from C++,
+ * by a script or by a ScriptReloader: every call first checks that the global is still
+ * the function the cache was filled by, which costs a lookup and a raw comparison. Call
+ * invalidate() when something else the function reads has changed.
+ *
+ * Several states running the same function (say, the workers of a StatePool) can share
+ * one MemoCache, each through its own Memoized.
+ */
+template <typename Result, typename ...Args>
+class Memoized<Result(Args...)> {
+  public:
+  using Cache = MemoCache<Result(Args...)>;
+
+  Memoized(Lua &aLua, std::string aFunctionName, MemoOptions const &aOptions = {})
+      : Memoized(aLua, std::move(aFunctionName), std::make_shared<Cache>(aOptions)) {}
+
+  Memoized(Lua &aLua, std::string aFunctionName, std::shared_ptr<Cache> aCache)
+      : fLua(&aLua), fFunctionName(std::move(aFunctionName)), fCache(std::move(aCache)),
+        fNameRef(referenceName()), fFunctionRef(referenceFunction()) {}
+
+  Memoized(Memoized const &) = delete;
+
+  Memoized &operator=(Memoized const &) = delete;
+
+  ~Memoized() {
+    luaL_unref(fLua->state(), LUA_REGISTRYINDEX, fFunctionRef);
+    luaL_unref(fLua->state(), LUA_REGISTRYINDEX, fNameRef);
+  }
+
+  Result operator()(Args const &... aArgs) {
+    checkFunction();
+    typename Cache::Key key{aArgs...};
+    std::size_t hash = detail::memoize::hashValue(key);
+    if (auto cached = fCache->find(key, hash)) {
+      return std::move(*cached);
+    }
+    Result result = (*fLua)[fFunctionName](aArgs...).template as<Result>();
+    fCache->insert(std::move(key), hash, result);
+    return result;
+  }
+
+  /*
+   * Drops every cached result
+   */
+  void invalidate() {
+    fCache->clear();
+    luaL_unref(fLua->state(), LUA_REGISTRYINDEX, fFunctionRef);
+    fFunctionRef = referenceFunction();
+  }
+
+  [[nodiscard]] MemoStats stats() const {
+    return fCache->stats();
+  }
+
+  [[nodiscard]] std::shared_ptr<Cache> const &cache() const {
+    return fCache;
+  }
+
+  private:
+  /*
+   * The name as a Lua string, so that looking the global up on every call doesn't intern
+   * it again
+   */
+  [[nodiscard]] int referenceName() const {
+    lua_State *state = fLua->state();
+    lua_pushlstring(state, fFunctionName.data(), fFunctionName.size());
+    return luaL_ref(state, LUA_REGISTRYINDEX);
+  }
+
+  void pushFunction() const {
+    lua_State *state = fLua->state();
+    lua_rawgeti(state, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+    lua_rawgeti(state, LUA_REGISTRYINDEX, fNameRef);
+    lua_gettable(state, -2);
+    lua_remove(state, -2);
+  }
+
+  /*
+   * A registry reference to the function the cache was filled by. Holding it keeps the
+   * function alive, so a replacement can never be allocated at the same address and be
+   * mistaken for it.
+   */
+  [[nodiscard]] int referenceFunction() const {
+    pushFunction();
+    return luaL_ref(fLua->state(), LUA_REGISTRYINDEX);
+  }
+
+  void checkFunction() {
+    lua_State *state = fLua->state();
+    pushFunction();
+    lua_rawgeti(state, LUA_REGISTRYINDEX, fFunctionRef);
+    bool same = lua_rawequal(state, -1, -2);
+    lua_pop(state, 2);
+    if (!same) {
+      luaL_unref(state, LUA_REGISTRYINDEX, fFunctionRef);
+      fFunctionRef = referenceFunction();
+      fCache->clear();
+    }
+  }
+
+  Lua *fLua;
+  std::string fFunctionName;
+  std::shared_ptr<Cache> fCache;
+  int fNameRef;
+  int fFunctionRef;
+};
+}
+
+#endif //LUABIND_MEMOIZE_HPP
@@ -0,0 +1,325 @@
+#ifndef LUABIND_PARALLEL_HPP
+#define LUABIND_PARALLEL_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace luabind::detail {
+/*
+ * ChunkRange is one worker's share of the chunk indices of a parallel job, stored as a
+ * half-open [begin, end) interval packed into a single 64-bit atomic so that both the
+ * owner and thieves can update it with one compare-and-swap and no locks.
+ *
+ * The owner takes chunks from the front. A thief takes the back half of the remaining
+ * interval, which keeps steals rare: a worker that runs dry steals a big block of work
+ * instead of coming back for every chunk.
+ */
+class ChunkRange {
+  public:
+  void reset(std::uint32_t aBegin, std::uint32_t aEnd) {
+    fRange.store(pack(aBegin, aEnd), std::memory_order_release);
+  }
+
+  std::optional<std::uint32_t> takeFront() {
+    auto current = fRange.load(std::memory_order_acquire);
+    while (true) {
+      auto [begin, end] = unpack(current);
+      if (begin >= end) {
+        return std::nullopt;
+      }
+      if (fRange.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel)) {
+        return begin;
+      }
+    }
+  }
+
+  /*
+   * Removes the back half of the interval (or the last chunk, if only one is left) and
+   * returns it as [begin, end).
+   */
+  std::optional<std::pair<std::uint32_t, std::uint32_t>> stealBack() {
+    auto current = fRange.load(std::memory_order_acquire);
+    while (true) {
+      auto [begin, end] = unpack(current);
+      if (begin >= end) {
+        return std::nullopt;
+      }
+      std::uint32_t mid = begin + (end - begin)/2;
+      if (fRange.compare_exchange_weak(current, pack(begin, mid), std::memory_order_acq_rel)) {
+        return std::pair{mid, end};
+      }
+    }
+  }
+
+  private:
+  static std::uint64_t pack(std::uint32_t aBegin, std::uint32_t aEnd) {
+    return (static_cast<std::uint64_t>(aBegin) << 32) | aEnd;
+  }
+
+  static std::pair<std::uint32_t, std::uint32_t> unpack(std::uint64_t aPacked) {
+    return {static_cast<std::uint32_t>(aPacked >> 32), static_cast<std::uint32_t>(aPacked)};
+  }
+
+  std::atomic<std::uint64_t> fRange{0};
+};
+}
+
+namespace luabind {
+/*
+ * StatePool owns a fixed set of worker threads, each with its own independently
+ * initialized luabind::Lua. Lua states are single-threaded, so the only way to use
+ * more than one core for a script workload is to run the same scripts in several
+ * states and shard the input between them.
+ *
+ * The initializer passed to the constructor runs once on every worker thread, against
+ * that worker's state, and should load scripts and bind functions. After that, map()
+ * and mapChunks() split an input range into chunks, hand each worker a contiguous block
+ * of chunks, and let idle workers steal from busy ones. Results are written by index, so
+ * the output is in input order regardless of which worker processed which chunk.
+ *
+ * A StatePool is driven from one thread at a time; map() blocks until the job is done.
+ * If any call into Lua throws, the remaining chunks are abandoned and the first exception
+ * is rethrown from map().
+ */
+class StatePool {
+  public:
+  using Initializer = std::function<void(Lua &)>;
+
+  static inline constexpr std::size_t DEFAULT_CHUNK_SIZE = 256;
+
+  explicit StatePool(std::size_t aThreadCount, Initializer aInit = {}) : fRanges(std::max<std::size_t>(aThreadCount, 1)) {
+    std::size_t threadCount = fRanges.size();
+    fWorkers.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i) {
+      fWorkers.emplace_back([this, i, &aInit]() { workerMain(i, aInit); });
+    }
+
+    // aInit is borrowed by the workers, so we can't return until they are all done with it
+    std::unique_lock lock(fMutex);
+    fDoneCv.wait(lock, [&]() { return fReady==threadCount; });
+    if (fError) {
+      lock.unlock();
+      shutdown();
+      std::rethrow_exception(fError);
+    }
+  }
+
+  StatePool(StatePool const &) = delete;
+
+  StatePool &operator=(StatePool const &) = delete;
+
+  ~StatePool() {
+    shutdown();
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return fWorkers.size();
+  }
+
+  /*
+   * Calls the global function aFunctionName once per element of aInput, and returns
+   * the results converted to Result, in input order.
+   */
+  template <typename Result, std::ranges::random_access_range Range>
+  std::vector<Result> map(std::string const &aFunctionName, Range const &aInput,
+                          std::size_t aChunkSize = DEFAULT_CHUNK_SIZE) {
+    std::size_t count = std::ranges::size(aInput);
+    std::vector<std::optional<Result>> results(count);
+    forEachChunk(count, aChunkSize, [&](Lua &aLua, std::size_t aBegin, std::size_t aEnd) {
+      auto function = aLua[aFunctionName];
+      for (std::size_t i = aBegin; i < aEnd; ++i) {
+        Result result = function(std::ranges::begin(aInput)[i]);
+        results[i].emplace(std::move(result));
+      }
+    });
+    return unwrap(std::move(results));
+  }
+
+  /*
+   * Calls the global function aFunctionName once per chunk, passing the chunk as a Lua
+   * sequence and expecting a sequence of the same length back. This amortizes the cost
+   * of crossing into Lua over a whole chunk, for transforms that are cheap per element.
+   */
+  template <typename Result, std::ranges::random_access_range Range>
+  std::vector<Result> mapChunks(std::string const &aFunctionName, Range const &aInput,
+                                std::size_t aChunkSize = DEFAULT_CHUNK_SIZE) {
+    using namespace std::string_literals;
+    using Value = std::ranges::range_value_t<Range>;
+    std::size_t count = std::ranges::size(aInput);
+    std::vector<std::optional<Result>> results(count);
+    forEachChunk(count, aChunkSize, [&](Lua &aLua, std::size_t aBegin, std::size_t aEnd) {
+      auto first = std::ranges::begin(aInput);
+      std::vector<Value> chunk(first + aBegin, first + aEnd);
+      std::vector<Result> chunkResults = aLua[aFunctionName](chunk);
+      if (chunkResults.size()!=chunk.size()) {
+        throw RuntimeError(aFunctionName + " returned "s + std::to_string(chunkResults.size())
+                               + " results for a chunk of "s + std::to_string(chunk.size()));
+      }
+      for (std::size_t i = 0; i < chunkResults.size(); ++i) {
+        results[aBegin + i].emplace(std::move(chunkResults[i]));
+      }
+    });
+    return unwrap(std::move(results));
+  }
+
+  private:
+  using Job = std::function<void(Lua &, std::size_t, std::size_t)>;
+
+  template <typename Result>
+  static std::vector<Result> unwrap(std::vector<std::optional<Result>> &&aResults) {
+    std::vector<Result> ret;
+    ret.reserve(aResults.size());
+    for (auto &result : aResults) {
+      ret.emplace_back(std::move(*result));
+    }
+    return ret;
+  }
+
+  /*
+   * Splits [0, aCount) into chunks of aChunkSize elements, deals the chunks out to the
+   * workers in contiguous blocks, and blocks until every chunk has been processed.
+   */
+  void forEachChunk(std::size_t aCount, std::size_t aChunkSize, Job aJob) {
+    if (aCount==0) {
+      return;
+    }
+    fChunkSize = std::max<std::size_t>(aChunkSize, 1);
+    fCount = aCount;
+    std::size_t chunkCount = (aCount + fChunkSize - 1)/fChunkSize;
+    assert(chunkCount <= UINT32_MAX);
+    std::size_t workerCount = fRanges.size();
+    for (std::size_t i = 0; i < workerCount; ++i) {
+      fRanges[i].reset(static_cast<std::uint32_t>(chunkCount*i/workerCount),
+                       static_cast<std::uint32_t>(chunkCount*(i + 1)/workerCount));
+    }
+
+    std::unique_lock lock(fMutex);
+    fJob = std::move(aJob);
+    fError = nullptr;
+    fAbort.store(false, std::memory_order_relaxed);
+    fPending = workerCount;
+    ++fGeneration;
+    fStartCv.notify_all();
+    fDoneCv.wait(lock, [&]() { return fPending==0; });
+    fJob = nullptr;
+    if (fError) {
+      std::rethrow_exception(std::exchange(fError, nullptr));
+    }
+  }
+
+  std::optional<std::uint32_t> nextChunk(std::size_t aWorker) {
+    if (auto chunk = fRanges[aWorker].takeFront()) {
+      return chunk;
+    }
+    for (std::size_t offset = 1; offset < fRanges.size(); ++offset) {
+      auto &victim = fRanges[(aWorker + offset)%fRanges.size()];
+      if (auto stolen = victim.stealBack()) {
+        // Our own range is empty, so nobody else can be modifying it
+        fRanges[aWorker].reset(stolen->first + 1, stolen->second);
+        return stolen->first;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void recordError(std::exception_ptr aError) {
+    std::lock_guard lock(fMutex);
+    if (!fError) {
+      fError = std::move(aError);
+    }
+    fAbort.store(true, std::memory_order_relaxed);
+  }
+
+  void workerMain(std::size_t aWorker, Initializer const &aInit) {
+    std::optional<Lua> lua;
+    try {
+      lua.emplace();
+      if (aInit) {
+        aInit(*lua);
+      }
+    } catch (...) {
+      recordError(std::current_exception());
+    }
+    std::uint64_t seenGeneration = 0;
+    {
+      std::lock_guard lock(fMutex);
+      ++fReady;
+      fDoneCv.notify_all();
+    }
+
+    while (true) {
+      {
+        std::unique_lock lock(fMutex);
+        fStartCv.wait(lock, [&]() { return fStopping || fGeneration!=seenGeneration; });
+        if (fStopping) {
+          return;
+        }
+        seenGeneration = fGeneration;
+      }
+
+      try {
+        while (!fAbort.load(std::memory_order_relaxed)) {
+          auto chunk = nextChunk(aWorker);
+          if (!chunk) {
+            break;
+          }
+          std::size_t begin = *chunk*fChunkSize;
+          fJob(*lua, begin, std::min(begin + fChunkSize, fCount));
+        }
+      } catch (...) {
+        recordError(std::current_exception());
+      }
+
+      std::lock_guard lock(fMutex);
+      if (--fPending==0) {
+        fDoneCv.notify_all();
+      }
+    }
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard lock(fMutex);
+      fStopping = true;
+      fStartCv.notify_all();
+    }
+    for (auto &worker : fWorkers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+  }
+
+  std::vector<detail::ChunkRange> fRanges;
+  std::vector<std::thread> fWorkers;
+
+  std::mutex fMutex;
+  std::condition_variable fStartCv;
+  std::condition_variable fDoneCv;
+  std::uint64_t fGeneration = 0;
+  std::size_t fReady = 0;
+  std::size_t fPending = 0;
+  bool fStopping = false;
+  std::exception_ptr fError;
+  std::atomic<bool> fAbort{false};
+
+  // Only written by forEachChunk while no job is running
+  Job fJob;
+  std::size_t fChunkSize = DEFAULT_CHUNK_SIZE;
+  std::size_t fCount = 0;
+};
+}
+
+#endif //LUABIND_PARALLEL_HPP
@@ -0,0 +1,284 @@
+#ifndef LUABIND_REGISTRY_HPP
+#define LUABIND_REGISTRY_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace luabind::detail::registry {
+struct NameHash {
+  using is_transparent = void;
+
+  std::size_t operator()(const std::string_view aName) const {
+    return std::hash<std::string_view>{}(aName);
+  }
+};
+
+/*
+ * A registered function: a lua_CFunction, pushed as a closure over a light userdata
+ * pointing at fCallable when the callable has state
+ */
+struct Binding {
+  lua_CFunction fFunction;
+  std::shared_ptr<void> fCallable;
+};
+
+/*
+ * The functions registered under one table name ("" for the globals), and the tables
+ * nested in it
+ */
+struct Namespace {
+  std::unordered_map<std::string, Binding, NameHash, std::equal_to<>> fFunctions;
+  std::unordered_map<std::string, std::unique_ptr<Namespace>, NameHash, std::equal_to<>> fChildren;
+};
+
+template <typename Callable>
+int registeredBody(lua_State *aState) {
+  return enterFromLua(aState, *static_cast<Callable *>(lua_touserdata(aState, lua_upvalueindex(1))));
+}
+
+inline void pushNamespace(lua_State *aState, Namespace const &aNamespace);
+
+/*
+ * The name at aKeyIdx, or an empty view if it isn't a string
+ */
+inline std::string_view keyName(lua_State *aState, int aKeyIdx) {
+  if (lua_type(aState, aKeyIdx)!=LUA_TSTRING) {
+    return {};
+  }
+  std::size_t length = 0;
+  const char *data = lua_tolstring(aState, aKeyIdx, &length);
+  return {data, length};
+}
+
+inline bool registers(Namespace const &aNamespace, const std::string_view aName) {
+  return aNamespace.fFunctions.contains(aName) || aNamespace.fChildren.contains(aName);
+}
+
+/*
+ * Pushes what aNamespace registers under the name at aKeyIdx (a function or a nested
+ * table) and returns true, or returns false with nothing pushed
+ */
+inline bool pushEntry(lua_State *aState, Namespace const &aNamespace, int aKeyIdx) {
+  auto name = keyName(aState, aKeyIdx);
+  if (name.empty()) {
+    return false;
+  }
+  if (auto function = aNamespace.fFunctions.find(name); function!=aNamespace.fFunctions.end()) {
+    auto const &binding = function->second;
+    if (binding.fCallable) {
+      lua_pushlightuserdata(aState, binding.fCallable.get());
+      lua_pushcclosure(aState, binding.fFunction, 1);
+    } else {
+      lua_pushcfunction(aState, binding.fFunction);
+    }
+    return true;
+  }
+  if (auto child = aNamespace.fChildren.find(name); child!=aNamespace.fChildren.end()) {
+    pushNamespace(aState, *child->second);
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Marks the name at aKeyIdx as resolved in the table at aResolvedIdx
+ */
+inline void markResolved(lua_State *aState, int aResolvedIdx, int aKeyIdx) {
+  lua_pushvalue(aState, aKeyIdx);
+  lua_pushboolean(aState, true);
+  lua_rawset(aState, aResolvedIdx);
+}
+
+/*
+ * __index and __newindex of the globals table and of the tables of nested namespaces.
+ * Upvalue 1 is the Namespace, upvalue 2 the table of names already resolved in this
+ * table, and upvalue 3 the metamethod the globals table had before (none for
+ * namespaces).
+ *
+ * A registered name is resolved once: its first read stores the function (or table) in
+ * the table, and its first assignment stores the assigned value. Either way the name is
+ * never looked up again, so "name = nil" removes it for good.
+ */
+inline int index(lua_State *aState) {
+  lua_settop(aState, 2);
+  auto const &bindings = *static_cast<Namespace const *>(lua_touserdata(aState, lua_upvalueindex(1)));
+  lua_pushvalue(aState, 2);
+  bool resolved = lua_rawget(aState, lua_upvalueindex(2))!=LUA_TNIL;
+  lua_pop(aState, 1);
+  if (!resolved && pushEntry(aState, bindings, 2)) {
+    markResolved(aState, lua_upvalueindex(2), 2);
+    lua_pushvalue(aState, 2);
+    lua_pushvalue(aState, -2);
+    lua_rawset(aState, 1);
+    return 1;
+  }
+  switch (lua_type(aState, lua_upvalueindex(3))) {
+    case LUA_TNONE:
+    case LUA_TNIL:lua_pushnil(aState);
+      return 1;
+    case LUA_TFUNCTION:lua_pushvalue(aState, lua_upvalueindex(3));
+      lua_insert(aState, 1);
+      lua_call(aState, 2, 1);
+      return 1;
+    default:lua_gettable(aState, lua_upvalueindex(3));
+      return 1;
+  }
+}
+
+inline int newIndex(lua_State *aState) {
+  lua_settop(aState, 3);
+  auto const &bindings = *static_cast<Namespace const *>(lua_touserdata(aState, lua_upvalueindex(1)));
+  if (registers(bindings, keyName(aState, 2))) {
+    markResolved(aState, lua_upvalueindex(2), 2);
+  }
+  switch (lua_type(aState, lua_upvalueindex(3))) {
+    case LUA_TNONE:
+    case LUA_TNIL:lua_rawset(aState, 1);
+      return 0;
+    case LUA_TFUNCTION:lua_pushvalue(aState, lua_upvalueindex(3));
+      lua_insert(aState, 1);
+      lua_call(aState, 3, 0);
+      return 0;
+    default:lua_settable(aState, lua_upvalueindex(3));
+      return 0;
+  }
+}
+
+/*
+ * Sets aEvent of the metatable at aMetatableIdx to aFunction closed over aNamespace, the
+ * resolved-names table at aResolvedIdx and, if aChain, the previous value of aEvent
+ */
+inline void setMetamethod(lua_State *aState, int aMetatableIdx, const char *aEvent, lua_CFunction aFunction,
+                          Namespace const &aNamespace, int aResolvedIdx, bool aChain) {
+  lua_pushlightuserdata(aState, const_cast<Namespace *>(&aNamespace));
+  lua_pushvalue(aState, aResolvedIdx);
+  if (aChain) {
+    lua_getfield(aState, aMetatableIdx, aEvent);
+  }
+  lua_pushcclosure(aState, aFunction, aChain ? 3 : 2);
+  lua_setfield(aState, aMetatableIdx, aEvent);
+}
+
+/*
+ * Installs index and newIndex on the metatable at aMetatableIdx, with a new table of
+ * resolved names
+ */
+inline void setMetamethods(lua_State *aState, int aMetatableIdx, Namespace const &aNamespace, bool aChain) {
+  aMetatableIdx = lua_absindex(aState, aMetatableIdx);
+  lua_newtable(aState);
+  int resolvedIdx = lua_gettop(aState);
+  setMetamethod(aState, aMetatableIdx, "__index", &index, aNamespace, resolvedIdx, aChain);
+  setMetamethod(aState, aMetatableIdx, "__newindex", &newIndex, aNamespace, resolvedIdx, aChain);
+  lua_pop(aState, 1);
+}
+
+inline void pushNamespace(lua_State *aState, Namespace const &aNamespace) {
+  lua_createtable(aState, 0, 0);
+  lua_createtable(aState, 0, 2);
+  setMetamethods(aState, -1, aNamespace, false);
+  lua_setmetatable(aState, -2);
+}
+}
+
+namespace luabind {
+/*
+ * A BindingRegistry records a large set of functions once, and installs them into any
+ * number of states in constant time: nothing is pushed until a script first reads a name.
+ *
+ *   luabind::BindingRegistry registry;
+ *   registry.add("log", [](std::string aMessage) { ... });
+ *   registry.add("geo.distance", &distance);       // geo is a table, also created lazily
+ *   ...
+ *   registry.install(lua);                           // for every new state
+ *
+ * install() chains __index and __newindex metamethods onto the globals table, as
+ * bindVariable does, keeping the ones it had before for other names. The first read of a
+ * registered name pushes the function (or the table of a dotted prefix) and stores it as
+ * an ordinary global, so later reads and calls cost exactly what they would for an
+ * eagerly bound function. Each state remembers which names it has resolved, by reading
+ * or by assigning them, and never resolves them again: scripts can replace registered
+ * names, or remove them for good with "log = nil". pairs(_G) only lists the names
+ * that have been used.
+ *
+ * Callables are held by the registry, which must outlive the states it is installed in,
+ * and a name can only be registered once. Registering is not thread-safe, so finish
+ * before the first install(); a complete registry can then be installed into states on
+ * any threads.
+ */
+class BindingRegistry {
+  public:
+  /*
+   * Registers aCallable under aName. Dots in aName place it in nested tables.
+   */
+  template <typename Callable>
+  BindingRegistry &add(const std::string_view aName, Callable const &aCallable) {
+    if constexpr (detail::traits::is_stateless_v<Callable>) {
+      return bind(aName, {&detail::adaptedStateless<Callable>, nullptr});
+    } else {
+      return bind(aName, {&detail::registry::registeredBody<Callable>, std::make_shared<Callable>(aCallable)});
+    }
+  }
+
+  /*
+   * Registers a function already written against the Lua C API
+   */
+  BindingRegistry &addCFunction(const std::string_view aName, lua_CFunction aFunction) {
+    return bind(aName, {aFunction, nullptr});
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return fSize;
+  }
+
+  void install(Lua &aLua) const {
+    install(aLua.state());
+  }
+
+  void install(lua_State *aState) const {
+    lua_pushglobaltable(aState);
+    if (!lua_getmetatable(aState, -1)) {
+      lua_newtable(aState);
+      lua_pushvalue(aState, -1);
+      lua_setmetatable(aState, -3);
+    }
+    detail::registry::setMetamethods(aState, -1, fRoot, true);
+    lua_pop(aState, 2);
+  }
+
+  private:
+  BindingRegistry &bind(std::string_view aName, detail::registry::Binding aBinding) {
+    auto *names = &fRoot;
+    for (auto dot = aName.find('.'); dot!=std::string_view::npos; dot = aName.find('.')) {
+      if (names->fFunctions.contains(aName.substr(0, dot))) {
+        throw RuntimeError("Table " + std::string(aName.substr(0, dot)) + " would hide a binding of the same name");
+      }
+      auto &child = names->fChildren[std::string(aName.substr(0, dot))];
+      if (!child) {
+        child = std::make_unique<detail::registry::Namespace>();
+      }
+      names = child.get();
+      aName.remove_prefix(dot + 1);
+    }
+    if (names->fChildren.contains(aName)) {
+      throw RuntimeError("Binding " + std::string(aName) + " would hide a table of the same name");
+    }
+    // Replacing a binding would free a callable that installed states may still call
+    if (!names->fFunctions.try_emplace(std::string(aName), std::move(aBinding)).second) {
+      throw RuntimeError("Binding " + std::string(aName) + " is already registered");
+    }
+    ++fSize;
+    return *this;
+  }
+
+  detail::registry::Namespace fRoot;
+  std::size_t fSize = 0;
+};
+}
+
+#endif //LUABIND_REGISTRY_HPP
@@ -0,0 +1,329 @@
+#ifndef LUABIND_RELOAD_HPP
+#define LUABIND_RELOAD_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace luabind::detail::reload {
+/*
+ * Reads the script at aPath into memory. Scripts are read rather than mapped: a file
+ * truncated while it is mapped raises SIGBUS, and editors rewrite files in place.
+ */
+inline std::string readScript(std::filesystem::path const &aPath) {
+  std::ifstream file(aPath, std::ios::binary);
+  if (!file) {
+    throw FileError("cannot open " + aPath.string());
+  }
+  return {std::istreambuf_iterator<char>(file), {}};
+}
+
+/*
+ * Registry key (by address) of the metatable of reload sandboxes: { __index = globals }
+ */
+inline const char SANDBOX_METATABLE_KEY = 0;
+
+/*
+ * Points each table upvalue of the new function at aNewIdx at the same-named table
+ * upvalue of the old function at aOldIdx, if there is one, so that file-local state kept
+ * in tables (a "local cache = {}" the functions close over) survives the reload. Every
+ * other upvalue keeps its new value: local helper functions and constants are code, and
+ * an edit to them must take effect. _ENV is left alone.
+ */
+inline void joinUpvalues(lua_State *aState, int aNewIdx, int aOldIdx) {
+  for (int i = 1;; ++i) {
+    const char *name = lua_getupvalue(aState, aNewIdx, i);
+    if (name==nullptr) {
+      return;
+    }
+    bool isTable = lua_type(aState, -1)==LUA_TTABLE;
+    lua_pop(aState, 1);
+    if (!isTable || std::strcmp(name, "_ENV")==0) {
+      continue;
+    }
+    for (int j = 1;; ++j) {
+      const char *oldName = lua_getupvalue(aState, aOldIdx, j);
+      if (oldName==nullptr) {
+        break;
+      }
+      bool oldIsTable = lua_type(aState, -1)==LUA_TTABLE;
+      lua_pop(aState, 1);
+      if (std::strcmp(name, oldName)==0) {
+        if (oldIsTable) {
+          lua_upvaluejoin(aState, aNewIdx, i, aOldIdx, j);
+        }
+        break;
+      }
+    }
+  }
+}
+}
+
+namespace luabind {
+/*
+ * Counters and reload latency (from noticing the change to the new functions being in
+ * place) for a ScriptReloader.
+ */
+struct ReloadStats {
+  std::size_t fReloads = 0;            // Scripts reloaded and swapped in
+  std::size_t fFailures = 0;           // Reloads rejected because the new script failed to compile or run
+  std::size_t fFunctionsReplaced = 0;
+  std::chrono::nanoseconds fLastLatency{0};
+  std::chrono::nanoseconds fMaxLatency{0};
+  std::chrono::nanoseconds fTotalLatency{0};
+  std::string fLastError;
+};
+
+/*
+ * ScriptReloader keeps a state's global functions up to date with the script files that
+ * define them, without rebuilding the state, so caches and other data it has built up
+ * survive a deployment.
+ *
+ *   luabind::ScriptReloader reloader(lua);
+ *   reloader.watch("rules.lua");        // runs it now
+ *   ...
+ *   reloader.reloadChanged();           // between calls, e.g. once per request batch
+ *
+ * Changes are noticed with inotify on Linux (watching the directory, so editors that
+ * replace the file by renaming are seen) and by modification time elsewhere, for scripts
+ * inotify couldn't watch, and after inotify dropped events. A changed file is only
+ * reloaded if its contents differ from the version loaded last. Files are read, not
+ * mapped, so one rewritten in place is at worst seen half-written: it then fails to load,
+ * and is reloaded once the write completes.
+ *
+ * A reload runs the script in a sandbox table that reads through to the globals, so
+ * nothing is touched until it has compiled and run without errors; a failing script is
+ * counted in stats() and the previous version stays in place. Then, in one step with no
+ * Lua code running:
+ * - Every global function the script defines replaces the global of the same name. Its
+ *   table upvalues are joined with same-named table upvalues of the function it
+ *   replaces, so file-local state kept in tables carries over. Local helper functions and
+ *   constants take their new definitions; a local counter must live in a table to survive.
+ * - Other globals the script defines are only set if they don't exist yet: data the state
+ *   accumulated is kept.
+ * Handles to the old functions (registry references, tables that stored them, Chunks)
+ * stay valid and keep running the old code. Assignments into existing tables (such as
+ * "function M.f() end" for an existing M) happen as the script runs, not in the swap.
+ *
+ * Like the Lua it reloads, a ScriptReloader must only be used from one thread at a time.
+ */
+class ScriptReloader {
+  public:
+  explicit ScriptReloader(Lua &aLua) : fLua(aLua) {
+#ifdef __linux__
+    fInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  }
+
+  ScriptReloader(ScriptReloader const &) = delete;
+
+  ScriptReloader &operator=(ScriptReloader const &) = delete;
+
+  ~ScriptReloader() {
+#ifdef __linux__
+    if (fInotify >= 0) {
+      close(fInotify);
+    }
+#endif
+  }
+
+  /*
+   * Loads the script at aPath, as a reload would, and watches it for changes. Unlike a
+   * reload, a script that fails to load throws.
+   */
+  void watch(std::string const &aPath) {
+    namespace fs = std::filesystem;
+    Script script{fs::path(aPath).lexically_normal(), 0, {}};
+    auto directory = script.fPath.parent_path().empty() ? fs::path(".") : script.fPath.parent_path();
+#ifdef __linux__
+    if (fInotify >= 0) {
+      script.fWatch = inotify_add_watch(fInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+    std::error_code error;
+    script.fModified = fs::last_write_time(script.fPath, error);
+    load(script, detail::reload::readScript(script.fPath));
+    fScripts.push_back(std::move(script));
+  }
+
+  /*
+   * Reloads every watched script that changed since the last call. Returns how many
+   * were reloaded successfully; failures are recorded in stats().
+   */
+  std::size_t reloadChanged() {
+    std::vector<bool> changed(fScripts.size(), false);
+    collectChanges(changed);
+    std::size_t reloaded = 0;
+    for (std::size_t i = 0; i < fScripts.size(); ++i) {
+      if (changed[i] && reload(fScripts[i])) {
+        ++reloaded;
+      }
+    }
+    return reloaded;
+  }
+
+  [[nodiscard]] ReloadStats const &stats() const {
+    return fStats;
+  }
+
+  private:
+  struct Script {
+    std::filesystem::path fPath;
+    std::size_t fHash;
+    std::filesystem::file_time_type fModified;
+    int fWatch = -1;
+  };
+
+  /*
+   * Marks the scripts changed since the last call. Scripts without an inotify watch, and
+   * every script after the event queue overflowed, are checked by modification time.
+   */
+  void collectChanges(std::vector<bool> &aChanged) {
+    bool overflowed = false;
+#ifdef __linux__
+    if (fInotify >= 0) {
+      alignas(inotify_event) char buffer[4096];
+      ssize_t length;
+      while ((length = read(fInotify, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+          auto *event = reinterpret_cast<inotify_event *>(buffer + offset);
+          offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+          if (event->mask & IN_Q_OVERFLOW) {
+            overflowed = true;
+          }
+          if (event->len==0) {
+            continue;
+          }
+          for (std::size_t i = 0; i < fScripts.size(); ++i) {
+            if (fScripts[i].fWatch==event->wd && fScripts[i].fPath.filename()==event->name) {
+              aChanged[i] = true;
+            }
+          }
+        }
+      }
+    }
+#endif
+    for (std::size_t i = 0; i < fScripts.size(); ++i) {
+      if (fScripts[i].fWatch >= 0 && !overflowed) {
+        continue;
+      }
+      std::error_code error;
+      auto modified = std::filesystem::last_write_time(fScripts[i].fPath, error);
+      if (!error && modified!=fScripts[i].fModified) {
+        fScripts[i].fModified = modified;
+        aChanged[i] = true;
+      }
+    }
+  }
+
+  bool reload(Script &aScript) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto source = detail::reload::readScript(aScript.fPath);
+      if (std::hash<std::string_view>{}(source)==aScript.fHash) {
+        return false;
+      }
+      fStats.fFunctionsReplaced += load(aScript, source);
+    } catch (std::exception const &e) {
+      ++fStats.fFailures;
+      fStats.fLastError = e.what();
+      return false;
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    ++fStats.fReloads;
+    fStats.fLastLatency = latency;
+    fStats.fMaxLatency = std::max(fStats.fMaxLatency, latency);
+    fStats.fTotalLatency += latency;
+    return true;
+  }
+
+  /*
+   * Runs aSource in a sandbox and, if it succeeds, swaps its definitions into the globals.
+   * Returns the number of functions swapped in.
+   */
+  std::size_t load(Script &aScript, const std::string_view aSource) {
+    lua_State *state = fLua.state();
+    int top = lua_gettop(state);
+    auto guard = detail::makeScopeGuard([state, top]() { lua_settop(state, top); });
+    luaL_checkstack(state, 8, "reload");
+
+    auto chunkName = "@" + aScript.fPath.string();
+    int res = detail::loadChunk(state, {}, detail::scriptSource(aSource), chunkName.c_str());
+    if (res!=LUA_OK) {
+      throw SyntaxError(detail::fromLua<std::string>(state));
+    }
+    int chunkIdx = lua_gettop(state);
+    lua_newtable(state);
+    int sandboxIdx = lua_gettop(state);
+    pushSandboxMetatable(state);
+    lua_setmetatable(state, sandboxIdx);
+    lua_pushvalue(state, sandboxIdx);
+    lua_setupvalue(state, chunkIdx, 1); // The main chunk's only upvalue is its _ENV
+
+    lua_pushvalue(state, chunkIdx);
+    if (lua_pcall(state, 0, 0, 0)!=LUA_OK) {
+      throw RuntimeError(detail::fromLua<std::string>(state));
+    }
+
+    // The script's functions share the chunk's _ENV upvalue, so this repoints all of them
+    lua_pushglobaltable(state);
+    int globalsIdx = lua_gettop(state);
+    lua_pushvalue(state, globalsIdx);
+    lua_setupvalue(state, chunkIdx, 1);
+
+    std::size_t functions = 0;
+    lua_pushnil(state);
+    while (lua_next(state, sandboxIdx)) {
+      int valueIdx = lua_gettop(state);
+      lua_pushvalue(state, valueIdx - 1);
+      int oldType = lua_rawget(state, globalsIdx);
+      if (lua_type(state, valueIdx)==LUA_TFUNCTION) {
+        if (oldType==LUA_TFUNCTION && !lua_iscfunction(state, -1) && !lua_iscfunction(state, valueIdx)) {
+          detail::reload::joinUpvalues(state, valueIdx, lua_gettop(state));
+        }
+        ++functions;
+      } else if (oldType!=LUA_TNIL) {
+        lua_settop(state, valueIdx - 1);
+        continue;
+      }
+      lua_settop(state, valueIdx);
+      lua_pushvalue(state, valueIdx - 1);
+      lua_insert(state, valueIdx);
+      lua_rawset(state, globalsIdx);
+    }
+    aScript.fHash = std::hash<std::string_view>{}(aSource);
+    return functions;
+  }
+
+  static void pushSandboxMetatable(lua_State *aState) {
+    if (lua_rawgetp(aState, LUA_REGISTRYINDEX, &detail::reload::SANDBOX_METATABLE_KEY)==LUA_TNIL) {
+      lua_pop(aState, 1);
+      lua_createtable(aState, 0, 1);
+      lua_pushglobaltable(aState);
+      lua_setfield(aState, -2, "__index");
+      lua_pushvalue(aState, -1);
+      lua_rawsetp(aState, LUA_REGISTRYINDEX, &detail::reload::SANDBOX_METATABLE_KEY);
+    }
+  }
+
+  Lua &fLua;
+  std::vector<Script> fScripts;
+  ReloadStats fStats;
+  int fInotify = -1;
+};
+}
+
+#endif //LUABIND_RELOAD_HPP
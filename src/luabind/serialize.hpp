@@ -0,0 +1,512 @@
+#ifndef LUABIND_SERIALIZE_HPP
+#define LUABIND_SERIALIZE_HPP
+
+#include "luabind/luabind.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace luabind::detail::serialize {
+/*
+ * Tags of the binary value format shared by ValueBuffer and Snapshot. Each encoded value
+ * starts with one tag byte. ValueBuffer only writes plain data; the tags after END are
+ * used by snapshots, which also serialize functions.
+ */
+enum class Tag : std::uint8_t {
+  NIL,
+  BOOLEAN_FALSE,
+  BOOLEAN_TRUE,
+  INTEGER,          // zigzag varint
+  FLOAT,            // 8 bytes, native byte order
+  STRING,           // varint length, bytes
+  TABLE,            // varint sequence length, fixed32 other field count, pairs, END (snapshots: then metatable or NIL)
+  REFERENCE,        // varint id of a table (or, in snapshots, function) seen earlier
+  END,
+  BUILTIN_TABLE,    // path of a standard library table, then pairs to merge into it, END
+  BUILTIN_FUNCTION, // path of a standard library function
+  BINDING,          // name in SnapshotBindings
+  FUNCTION,         // lua_dump bytes, varint upvalue count, upvalues
+  SHARED_UPVALUE    // varint function id, varint upvalue number: upvalue shared with that closure
+};
+
+/*
+ * Tables (and in snapshots, standard library references and Lua functions) get
+ * consecutive ids in the order they appear, so later occurrences can be written as
+ * REFERENCEs. This is what makes shared subtables and cycles round-trip.
+ */
+using Id = std::uint64_t;
+
+/*
+ * Nesting limit for tables, so that deep or malicious input fails with an exception
+ * instead of overflowing the C++ stack
+ */
+inline constexpr int MAX_DEPTH = 200;
+
+class Writer {
+  public:
+  explicit Writer(std::string &aOut) : fOut(aOut) {}
+
+  void tag(Tag aTag) {
+    fOut.push_back(static_cast<char>(aTag));
+  }
+
+  void varint(std::uint64_t aValue) {
+    while (aValue >= 0x80) {
+      fOut.push_back(static_cast<char>((aValue & 0x7f) | 0x80));
+      aValue >>= 7;
+    }
+    fOut.push_back(static_cast<char>(aValue));
+  }
+
+  void integer(lua_Integer aValue) {
+    auto bits = static_cast<std::uint64_t>(aValue);
+    varint((bits << 1) ^ (aValue < 0 ? ~std::uint64_t{0} : 0));
+  }
+
+  void number(lua_Number aValue) {
+    char bytes[sizeof(lua_Number)];
+    std::memcpy(bytes, &aValue, sizeof(bytes));
+    fOut.append(bytes, sizeof(bytes));
+  }
+
+  void bytes(std::string_view aBytes) {
+    varint(aBytes.size());
+    fOut.append(aBytes);
+  }
+
+  void raw(std::string_view aBytes) {
+    fOut.append(aBytes);
+  }
+
+  /*
+   * Writes four placeholder bytes, to be filled in by patchFixed32 once the value is known
+   */
+  std::size_t reserveFixed32() {
+    fOut.append(4, '\0');
+    return fOut.size() - 4;
+  }
+
+  void patchFixed32(std::size_t aPos, std::uint32_t aValue) {
+    for (int i = 0; i < 4; ++i) {
+      fOut[aPos + i] = static_cast<char>(aValue >> (8*i));
+    }
+  }
+
+  private:
+  std::string &fOut;
+};
+
+class Reader {
+  public:
+  explicit Reader(std::string_view aData, std::size_t aPos = 0) : fData(aData), fPos(aPos) {}
+
+  [[nodiscard]] std::size_t position() const {
+    return fPos;
+  }
+
+  [[nodiscard]] std::size_t remaining() const {
+    return fData.size() - fPos;
+  }
+
+  Tag peekTag() {
+    require(1);
+    return static_cast<Tag>(fData[fPos]);
+  }
+
+  Tag tag() {
+    auto ret = peekTag();
+    ++fPos;
+    return ret;
+  }
+
+  std::uint64_t varint() {
+    std::uint64_t ret = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      require(1);
+      auto byte = static_cast<std::uint8_t>(fData[fPos++]);
+      ret |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return ret;
+      }
+    }
+    throw RuntimeError("Malformed serialized data: varint too long");
+  }
+
+  std::uint32_t fixed32() {
+    auto bytes = raw(4);
+    std::uint32_t ret = 0;
+    for (int i = 0; i < 4; ++i) {
+      ret |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[i])) << (8*i);
+    }
+    return ret;
+  }
+
+  lua_Integer integer() {
+    auto bits = varint();
+    return static_cast<lua_Integer>((bits >> 1) ^ (~(bits & 1) + 1));
+  }
+
+  lua_Number number() {
+    lua_Number ret;
+    require(sizeof(ret));
+    std::memcpy(&ret, fData.data() + fPos, sizeof(ret));
+    fPos += sizeof(ret);
+    return ret;
+  }
+
+  std::string_view bytes() {
+    return raw(varint());
+  }
+
+  std::string_view raw(std::size_t aCount) {
+    require(aCount);
+    auto ret = fData.substr(fPos, aCount);
+    fPos += aCount;
+    return ret;
+  }
+
+  private:
+  void require(std::size_t aCount) const {
+    if (fData.size() - fPos < aCount) {
+      throw RuntimeError("Malformed serialized data: unexpected end of data");
+    }
+  }
+
+  std::string_view fData;
+  std::size_t fPos;
+};
+
+/*
+ * Writes the value at aIdx if it is nil, a boolean, a number or a string, and returns
+ * whether it was
+ */
+inline bool writeScalar(lua_State *aState, int aIdx, Writer &aWriter) {
+  switch (lua_type(aState, aIdx)) {
+    case LUA_TNIL:aWriter.tag(Tag::NIL);
+      return true;
+    case LUA_TBOOLEAN:aWriter.tag(lua_toboolean(aState, aIdx) ? Tag::BOOLEAN_TRUE : Tag::BOOLEAN_FALSE);
+      return true;
+    case LUA_TNUMBER:
+      if (lua_isinteger(aState, aIdx)) {
+        aWriter.tag(Tag::INTEGER);
+        aWriter.integer(lua_tointeger(aState, aIdx));
+      } else {
+        aWriter.tag(Tag::FLOAT);
+        aWriter.number(lua_tonumber(aState, aIdx));
+      }
+      return true;
+    case LUA_TSTRING: {
+      std::size_t length;
+      const char *data = lua_tolstring(aState, aIdx, &length);
+      aWriter.tag(Tag::STRING);
+      aWriter.bytes({data, length});
+      return true;
+    }
+    default:return false;
+  }
+}
+
+/*
+ * Pushes the scalar introduced by aTag (already consumed) and returns true, or returns
+ * false without pushing if aTag doesn't introduce a scalar
+ */
+inline bool readScalar(lua_State *aState, Tag aTag, Reader &aReader) {
+  switch (aTag) {
+    case Tag::NIL:lua_pushnil(aState);
+      return true;
+    case Tag::BOOLEAN_FALSE:lua_pushboolean(aState, false);
+      return true;
+    case Tag::BOOLEAN_TRUE:lua_pushboolean(aState, true);
+      return true;
+    case Tag::INTEGER:lua_pushinteger(aState, aReader.integer());
+      return true;
+    case Tag::FLOAT:lua_pushnumber(aState, aReader.number());
+      return true;
+    case Tag::STRING: {
+      auto bytes = aReader.bytes();
+      lua_pushlstring(aState, bytes.data(), bytes.size());
+      return true;
+    }
+    default:return false;
+  }
+}
+
+/*
+ * A table is written as its tag, the length of its sequence part, the number of its
+ * other fields, its key/value pairs and END. The sizes let the reader allocate the table
+ * once instead of growing it; the field count is only known after the pairs have been
+ * written, so it is a fixed-width field that is filled in afterwards.
+ */
+struct TableHeader {
+  std::size_t fSequence;
+  std::size_t fFieldCountPos;
+};
+
+inline TableHeader writeTableHeader(lua_State *aState, int aIdx, Writer &aWriter) {
+  std::size_t sequence = lua_rawlen(aState, aIdx);
+  aWriter.tag(Tag::TABLE);
+  aWriter.varint(sequence);
+  return {sequence, aWriter.reserveFixed32()};
+}
+
+/*
+ * Fills in the header once aFieldCount pairs (and END) have been written
+ */
+inline void finishTableHeader(TableHeader const &aHeader, std::size_t aFieldCount, Writer &aWriter) {
+  auto others = aFieldCount - std::min(aHeader.fSequence, aFieldCount);
+  aWriter.patchFixed32(aHeader.fFieldCountPos, static_cast<std::uint32_t>(std::min<std::size_t>(others, UINT32_MAX)));
+}
+
+/*
+ * Reads the sizes following a TABLE tag and pushes a table presized for them
+ */
+inline void readTableHeader(lua_State *aState, Reader &aReader) {
+  auto sequence = aReader.varint();
+  std::uint64_t others = aReader.fixed32();
+  // The sizes are only hints; every entry takes at least two bytes, so corrupt input
+  // can't make us allocate more than the data could fill
+  std::uint64_t limit = std::min<std::uint64_t>(aReader.remaining()/2, INT32_MAX);
+  lua_createtable(aState, static_cast<int>(std::min(sequence, limit)), static_cast<int>(std::min(others, limit)));
+}
+
+/*
+ * Reads key/value pairs into the table at aTableIdx up to and including END, calling
+ * aReadValue to push each key and value
+ */
+template <typename ReadValue>
+void readFields(lua_State *aState, int aTableIdx, Reader &aReader, ReadValue &&aReadValue) {
+  while (true) {
+    auto tag = aReader.peekTag();
+    if (tag==Tag::END) {
+      aReader.tag();
+      return;
+    }
+    if (tag==Tag::INTEGER) {
+      // Sequence entries are by far the most common; skip pushing the key
+      aReader.tag();
+      auto key = aReader.integer();
+      aReadValue();
+      lua_rawseti(aState, aTableIdx, key);
+      continue;
+    }
+    aReadValue();
+    if (lua_isnil(aState, -1) || (lua_type(aState, -1)==LUA_TNUMBER && lua_tonumber(aState, -1)!=lua_tonumber(aState, -1))) {
+      // lua_rawset would raise an unprotected Lua error for these
+      throw RuntimeError("Malformed serialized data: nil or NaN table key");
+    }
+    aReadValue();
+    lua_rawset(aState, aTableIdx);
+  }
+}
+
+class ValueEncoder {
+  public:
+  ValueEncoder(lua_State *aState, std::string &aOut, std::unordered_map<const void *, Id> &aIds)
+      : fState(aState), fWriter(aOut), fIds(aIds) {}
+
+  void encode(int aIdx, int aDepth = 0) {
+    using namespace std::string_literals;
+    if (writeScalar(fState, aIdx, fWriter)) {
+      return;
+    }
+    if (lua_type(fState, aIdx)!=LUA_TTABLE) {
+      throw RuntimeError("Cannot serialize a "s + luaL_typename(fState, aIdx) + " value"s);
+    }
+    auto [it, inserted] = fIds.emplace(lua_topointer(fState, aIdx), fIds.size());
+    if (!inserted) {
+      fWriter.tag(Tag::REFERENCE);
+      fWriter.varint(it->second);
+      return;
+    }
+    if (aDepth >= MAX_DEPTH) {
+      throw RuntimeError("Cannot serialize tables nested more than "s + std::to_string(MAX_DEPTH) + " deep"s);
+    }
+    luaL_checkstack(fState, 3, "serialize: tables too deeply nested");
+    auto header = writeTableHeader(fState, aIdx, fWriter);
+    std::size_t fields = 0;
+    lua_pushnil(fState);
+    while (lua_next(fState, aIdx)) {
+      int valueIdx = lua_gettop(fState);
+      encode(valueIdx - 1, aDepth + 1);
+      encode(valueIdx, aDepth + 1);
+      lua_pop(fState, 1);
+      ++fields;
+    }
+    fWriter.tag(Tag::END);
+    finishTableHeader(header, fields, fWriter);
+  }
+
+  private:
+  lua_State *fState;
+  Writer fWriter;
+  std::unordered_map<const void *, Id> &fIds;
+};
+
+class ValueDecoder {
+  public:
+  /*
+   * aIdsIdx is a table on the stack used to look up REFERENCEs, or 0 if the value
+   * is known not to contain tables
+   */
+  ValueDecoder(lua_State *aState, Reader &aReader, int aIdsIdx) : fState(aState), fReader(aReader), fIdsIdx(aIdsIdx) {}
+
+  void decode(int aDepth = 0) {
+    auto tag = fReader.tag();
+    if (readScalar(fState, tag, fReader)) {
+      return;
+    }
+    if (fIdsIdx==0 || aDepth >= MAX_DEPTH) {
+      throw RuntimeError("Malformed serialized data: unexpected table");
+    }
+    luaL_checkstack(fState, 3, "serialize: tables too deeply nested");
+    if (tag==Tag::REFERENCE) {
+      if (lua_rawgeti(fState, fIdsIdx, static_cast<lua_Integer>(fReader.varint() + 1))==LUA_TNIL) {
+        throw RuntimeError("Malformed serialized data: reference to an unknown table");
+      }
+      return;
+    }
+    if (tag!=Tag::TABLE) {
+      throw RuntimeError("Malformed serialized data: unexpected tag");
+    }
+    readTableHeader(fState, fReader);
+    int tableIdx = lua_gettop(fState);
+    lua_pushvalue(fState, tableIdx);
+    lua_rawseti(fState, fIdsIdx, static_cast<lua_Integer>(++fNextId));
+    readFields(fState, tableIdx, fReader, [&]() { decode(aDepth + 1); });
+  }
+
+  private:
+  lua_State *fState;
+  Reader &fReader;
+  int fIdsIdx;
+  Id fNextId = 0;
+};
+
+/*
+ * Appends the value at aIdx to aOut. On failure aOut and the stack are left as they
+ * were. aIds is scratch space, passed in so callers can reuse its allocation.
+ */
+inline void writeValue(lua_State *aState, int aIdx, std::string &aOut, std::unordered_map<const void *, Id> &aIds) {
+  aIdx = lua_absindex(aState, aIdx);
+  int top = lua_gettop(aState);
+  std::size_t size = aOut.size();
+  try {
+    aIds.clear();
+    ValueEncoder(aState, aOut, aIds).encode(aIdx);
+  } catch (...) {
+    aOut.resize(size);
+    lua_settop(aState, top);
+    throw;
+  }
+}
+
+/*
+ * Pushes the next value from aReader. On failure the stack is left as it was.
+ */
+inline void readValue(lua_State *aState, Reader &aReader) {
+  int top = lua_gettop(aState);
+  try {
+    luaL_checkstack(aState, 2, "serialize: reading value");
+    if (aReader.peekTag()==Tag::TABLE) {
+      lua_newtable(aState); // REFERENCE lookup, only needed when there are tables
+      ValueDecoder(aState, aReader, top + 1).decode();
+      lua_remove(aState, top + 1);
+    } else {
+      ValueDecoder(aState, aReader, 0).decode();
+    }
+  } catch (...) {
+    lua_settop(aState, top);
+    throw;
+  }
+}
+}
+
+namespace luabind {
+/*
+ * ValueBuffer encodes Lua values straight from one state's stack into a compact byte
+ * string and decodes them onto another's, without converting through C++ types. It
+ * handles nil, booleans, integers, floats, strings and tables of those, keeping shared
+ * subtables shared and cycles intact; metatables are not included. Functions, userdata
+ * and coroutines can't be serialized and make write() throw.
+ *
+ *   luabind::ValueBuffer buffer;
+ *   buffer.writeGlobal(producer, "result");
+ *   buffer.readGlobal(consumer, "input");
+ *
+ * Values are appended, and read back in the same order. clear() keeps the allocated
+ * capacity, so one buffer can be reused for many transfers. bytes() can be written to
+ * a pipe or file, and assign() loads bytes received that way; numbers are stored in
+ * native byte order, so both ends must share an architecture.
+ */
+class ValueBuffer {
+  public:
+  ValueBuffer() = default;
+
+  explicit ValueBuffer(std::string_view aBytes) : fBytes(aBytes) {}
+
+  /*
+   * Appends the value at aIdx of aState's stack
+   */
+  void write(lua_State *aState, int aIdx) {
+    detail::serialize::writeValue(aState, aIdx, fBytes, fIds);
+  }
+
+  void writeGlobal(Lua &aLua, const std::string_view aGlobalName) {
+    lua_getglobal(aLua.state(), aGlobalName.data());
+    auto guard = detail::makeScopeGuard([&aLua]() { lua_pop(aLua.state(), 1); });
+    write(aLua.state(), -1);
+  }
+
+  /*
+   * Pushes the next unread value onto aState's stack
+   */
+  void read(lua_State *aState) {
+    detail::serialize::Reader reader(fBytes, fReadPos);
+    detail::serialize::readValue(aState, reader);
+    fReadPos = reader.position();
+  }
+
+  void readGlobal(Lua &aLua, const std::string_view aGlobalName) {
+    read(aLua.state());
+    lua_setglobal(aLua.state(), aGlobalName.data());
+  }
+
+  /*
+   * True when every value written has been read
+   */
+  [[nodiscard]] bool atEnd() const {
+    return fReadPos==fBytes.size();
+  }
+
+  /*
+   * Empties the buffer, keeping its capacity
+   */
+  void clear() {
+    fBytes.clear();
+    fReadPos = 0;
+  }
+
+  /*
+   * Replaces the contents with previously written bytes, e.g. received from a pipe
+   */
+  void assign(std::string_view aBytes) {
+    fBytes.assign(aBytes);
+    fReadPos = 0;
+  }
+
+  [[nodiscard]] std::string_view bytes() const {
+    return fBytes;
+  }
+
+  private:
+  std::string fBytes;
+  std::size_t fReadPos = 0;
+  std::unordered_map<const void *, detail::serialize::Id> fIds; // Kept to reuse its buckets
+};
+}
+
+#endif //LUABIND_SERIALIZE_HPP
@@ -0,0 +1,533 @@
+#ifndef LUABIND_SNAPSHOT_HPP
+#define LUABIND_SNAPSHOT_HPP
+
+#include "luabind/serialize.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace luabind {
+/*
+ * SnapshotBindings names the C++ functions that may appear in a snapshot. C functions
+ * can't be serialized, so a snapshot records a binding by name and the restoring side
+ * looks the name up again. Bindings are matched by their lua_CFunction, and every adapt()
+ * call site produces a distinct one, so bind through the registry rather than assigning
+ * the callable to a global separately:
+ *
+ *   luabind::SnapshotBindings bindings;
+ *   bindings.add("add", add);
+ *   bindings.installGlobals(lua); // lua["add"] is now the registered function
+ *
+ * Inside one process the same SnapshotBindings can be used to capture and restore.
+ * Another process restoring a saved snapshot must register the same names.
+ *
+ * Functions from the standard library need no registration.
+ */
+class SnapshotBindings {
+  public:
+  SnapshotBindings &add(std::string const &aName, lua_CFunction aFunction) {
+    fByName[aName] = aFunction;
+    fByFunction.emplace(aFunction, aName);
+    return *this;
+  }
+
+  template <typename Callable>
+  SnapshotBindings &add(std::string const &aName, Callable const &aCallable) {
+    return add(aName, adapt(aCallable));
+  }
+
+  /*
+   * Stores every binding in the global of its name
+   */
+  void installGlobals(Lua &aLua) const {
+    for (auto const &[name, function] : fByName) {
+      lua_pushcfunction(aLua.state(), function);
+      lua_setglobal(aLua.state(), name.c_str());
+    }
+  }
+
+  [[nodiscard]] lua_CFunction find(std::string const &aName) const {
+    auto it = fByName.find(aName);
+    return it==fByName.end() ? nullptr : it->second;
+  }
+
+  [[nodiscard]] std::string const *nameOf(lua_CFunction aFunction) const {
+    auto it = fByFunction.find(aFunction);
+    return it==fByFunction.end() ? nullptr : &it->second;
+  }
+
+  private:
+  std::unordered_map<std::string, lua_CFunction> fByName;
+  std::unordered_map<lua_CFunction, std::string> fByFunction;
+};
+}
+
+namespace luabind::detail::snapshot {
+inline constexpr std::string_view MAGIC = "LBSN";
+inline constexpr std::uint8_t FORMAT_VERSION = 1;
+
+using serialize::Id;
+using serialize::Reader;
+using serialize::Tag;
+using serialize::Writer;
+
+/*
+ * Standard library values are identified by their path from the global table, e.g.
+ * "string.format" or "package.searchers[1]". Only string and integer keys form paths.
+ */
+inline std::string childPath(lua_State *aState, std::string const &aParent, int aKeyIdx) {
+  if (lua_type(aState, aKeyIdx)==LUA_TSTRING) {
+    std::string key = lua_tostring(aState, aKeyIdx);
+    return aParent.empty() ? key : aParent + "." + key;
+  }
+  return aParent + "[" + std::to_string(lua_tointeger(aState, aKeyIdx)) + "]";
+}
+
+inline bool isPathKey(lua_State *aState, int aKeyIdx) {
+  return lua_type(aState, aKeyIdx)==LUA_TSTRING || lua_isinteger(aState, aKeyIdx);
+}
+
+/*
+ * Calls aVisit(path, valueIdx) for every table, function and userdata reachable from the
+ * global table through path keys. A table reachable by several paths (string and
+ * package.loaded.string) is visited under each of them, so lookups don't depend on
+ * traversal order; only cycles back to an enclosing table are cut.
+ */
+template <typename Visitor>
+void forEachLibraryValue(lua_State *aState, Visitor &&aVisit) {
+  std::unordered_set<const void *> enclosing;
+  auto walk = [&](auto &&aSelf, std::string const &aPath, int aTableIdx) -> void {
+    luaL_checkstack(aState, 3, "snapshot: library too deeply nested");
+    enclosing.insert(lua_topointer(aState, aTableIdx));
+    lua_pushnil(aState);
+    while (lua_next(aState, aTableIdx)) {
+      int valueIdx = lua_gettop(aState);
+      int type = lua_type(aState, valueIdx);
+      if (isPathKey(aState, valueIdx - 1)
+          && (type==LUA_TTABLE || type==LUA_TFUNCTION || type==LUA_TUSERDATA)) {
+        auto path = childPath(aState, aPath, valueIdx - 1);
+        aVisit(path, valueIdx);
+        if (type==LUA_TTABLE && !enclosing.contains(lua_topointer(aState, valueIdx))) {
+          aSelf(aSelf, path, valueIdx);
+        }
+      }
+      lua_pop(aState, 1);
+    }
+    enclosing.erase(lua_topointer(aState, aTableIdx));
+  };
+  lua_pushglobaltable(aState);
+  aVisit(std::string{}, lua_gettop(aState));
+  walk(walk, std::string{}, lua_gettop(aState));
+  lua_pop(aState, 1);
+}
+
+/*
+ * What luaL_openlibs puts in a fresh state, recorded once per process. Capturing only
+ * writes what a state has beyond (or in place of) this.
+ */
+struct LibraryIndex {
+  struct Entry {
+    int fType;
+    lua_CFunction fFunction;
+  };
+
+  std::unordered_map<std::string, Entry> fByPath;
+  std::unordered_map<lua_CFunction, std::string> fFunctionPaths;
+
+  static LibraryIndex const &get() {
+    static const LibraryIndex index = [] {
+      LibraryIndex ret;
+      Lua fresh;
+      forEachLibraryValue(fresh.state(), [&](std::string const &aPath, int aIdx) {
+        lua_State *state = fresh.state();
+        lua_CFunction function = lua_iscfunction(state, aIdx) ? lua_tocfunction(state, aIdx) : nullptr;
+        ret.fByPath.emplace(aPath, Entry{lua_type(state, aIdx), function});
+        if (function!=nullptr) {
+          ret.fFunctionPaths.emplace(function, aPath);
+        }
+      });
+      return ret;
+    }();
+    return index;
+  }
+};
+
+class Encoder {
+  public:
+  Encoder(lua_State *aState, SnapshotBindings const &aBindings, std::string &aOut)
+      : fState(aState), fBindings(aBindings), fLibrary(LibraryIndex::get()), fWriter(aOut) {}
+
+  void encodeGlobals() {
+    fWriter.raw(MAGIC);
+    fWriter.varint(FORMAT_VERSION);
+    fWriter.varint(static_cast<std::uint64_t>(lua_version(fState)));
+    lua_pushglobaltable(fState);
+    std::string root;
+    encodeValue(lua_gettop(fState), &root);
+    lua_pop(fState, 1);
+  }
+
+  private:
+  /*
+   * aPath is the value's library path while we are inside library tables, and null
+   * everywhere else.
+   */
+  void encodeValue(int aIdx, std::string const *aPath) {
+    using namespace std::string_literals;
+    luaL_checkstack(fState, 4, "snapshot: value too deeply nested");
+    if (serialize::writeScalar(fState, aIdx, fWriter)) {
+      return;
+    }
+    switch (lua_type(fState, aIdx)) {
+      case LUA_TTABLE:encodeTable(aIdx, aPath);
+        return;
+      case LUA_TFUNCTION:
+        if (lua_iscfunction(fState, aIdx)) {
+          encodeCFunction(aIdx, aPath);
+        } else {
+          encodeLuaFunction(aIdx);
+        }
+        return;
+      default:
+        throw RuntimeError("Cannot snapshot a "s + luaL_typename(fState, aIdx) + " value"s
+                               + (aPath ? " at "s + *aPath : ""s));
+    }
+  }
+
+  bool encodeReference(int aIdx) {
+    auto it = fIds.find(lua_topointer(fState, aIdx));
+    if (it==fIds.end()) {
+      return false;
+    }
+    fWriter.tag(Tag::REFERENCE);
+    fWriter.varint(it->second);
+    return true;
+  }
+
+  Id assignId(int aIdx) {
+    fIds.emplace(lua_topointer(fState, aIdx), fNextId);
+    return fNextId++;
+  }
+
+  void encodeTable(int aIdx, std::string const *aPath) {
+    if (encodeReference(aIdx)) {
+      return;
+    }
+    assignId(aIdx);
+    auto library = aPath ? fLibrary.fByPath.find(*aPath) : fLibrary.fByPath.end();
+    if (library!=fLibrary.fByPath.end() && library->second.fType==LUA_TTABLE) {
+      // The restoring state has its own copy of this table, possibly referenced from
+      // places we don't see (like the string metatable), so we update it in place
+      fWriter.tag(Tag::BUILTIN_TABLE);
+      fWriter.bytes(*aPath);
+      encodeFields(aIdx, aPath);
+      return;
+    }
+    auto header = serialize::writeTableHeader(fState, aIdx, fWriter);
+    serialize::finishTableHeader(header, encodeFields(aIdx, nullptr), fWriter);
+    if (lua_getmetatable(fState, aIdx)) {
+      encodeValue(lua_gettop(fState), nullptr);
+      lua_pop(fState, 1);
+    } else {
+      fWriter.tag(Tag::NIL);
+    }
+  }
+
+  /*
+   * Writes the fields of the table at aIdx and END, and returns how many were written
+   */
+  std::size_t encodeFields(int aIdx, std::string const *aPath) {
+    std::size_t fields = 0;
+    lua_pushnil(fState);
+    while (lua_next(fState, aIdx)) {
+      int valueIdx = lua_gettop(fState);
+      std::string path;
+      bool inLibrary = aPath && isPathKey(fState, valueIdx - 1);
+      if (inLibrary) {
+        path = childPath(fState, *aPath, valueIdx - 1);
+        if (isUnchangedLibraryValue(path, valueIdx)) {
+          lua_pop(fState, 1);
+          continue;
+        }
+      }
+      encodeValue(valueIdx - 1, nullptr);
+      encodeValue(valueIdx, inLibrary ? &path : nullptr);
+      lua_pop(fState, 1);
+      ++fields;
+    }
+    fWriter.tag(Tag::END);
+    return fields;
+  }
+
+  /*
+   * Library functions are compared by pointer. Userdata (io.stdout and friends) can't be
+   * compared across states, so a userdata where the library has one is assumed unchanged.
+   */
+  bool isUnchangedLibraryValue(std::string const &aPath, int aIdx) {
+    auto it = fLibrary.fByPath.find(aPath);
+    if (it==fLibrary.fByPath.end() || it->second.fType!=lua_type(fState, aIdx)) {
+      return false;
+    }
+    if (it->second.fType==LUA_TUSERDATA) {
+      return true;
+    }
+    return it->second.fFunction!=nullptr && lua_iscfunction(fState, aIdx)
+        && lua_tocfunction(fState, aIdx)==it->second.fFunction;
+  }
+
+  void encodeCFunction(int aIdx, std::string const *aPath) {
+    using namespace std::string_literals;
+    auto function = lua_tocfunction(fState, aIdx);
+    if (auto library = fLibrary.fFunctionPaths.find(function); library!=fLibrary.fFunctionPaths.end()) {
+      ++fNextId;
+      fWriter.tag(Tag::BUILTIN_FUNCTION);
+      fWriter.bytes(library->second);
+      return;
+    }
+    auto name = fBindings.nameOf(function);
+    if (name==nullptr || lua_getupvalue(fState, aIdx, 1)!=nullptr) {
+      throw RuntimeError("Cannot snapshot C function"s + (aPath ? " at "s + *aPath : ""s)
+                             + ": it is not in the SnapshotBindings"s);
+    }
+    fWriter.tag(Tag::BINDING);
+    fWriter.bytes(*name);
+  }
+
+  void encodeLuaFunction(int aIdx) {
+    if (encodeReference(aIdx)) {
+      return;
+    }
+    auto id = assignId(aIdx);
+    fWriter.tag(Tag::FUNCTION);
+    std::string code;
+    lua_pushvalue(fState, aIdx);
+    lua_dump(fState, [](lua_State *, const void *aChunk, std::size_t aSize, void *aOut) {
+      static_cast<std::string *>(aOut)->append(static_cast<const char *>(aChunk), aSize);
+      return 0;
+    }, &code, 0);
+    lua_pop(fState, 1);
+    fWriter.bytes(code);
+
+    lua_Debug info;
+    lua_pushvalue(fState, aIdx);
+    lua_getinfo(fState, ">u", &info);
+    fWriter.varint(info.nups);
+    for (int i = 1; i <= info.nups; ++i) {
+      auto [shared, inserted] = fUpvalues.emplace(lua_upvalueid(fState, aIdx, i), std::pair{id, i});
+      if (!inserted) {
+        fWriter.tag(Tag::SHARED_UPVALUE);
+        fWriter.varint(shared->second.first);
+        fWriter.varint(static_cast<std::uint64_t>(shared->second.second));
+        continue;
+      }
+      lua_getupvalue(fState, aIdx, i);
+      encodeValue(lua_gettop(fState), nullptr);
+      lua_pop(fState, 1);
+    }
+  }
+
+  lua_State *fState;
+  SnapshotBindings const &fBindings;
+  LibraryIndex const &fLibrary;
+  Writer fWriter;
+  std::unordered_map<const void *, Id> fIds;
+  std::unordered_map<void *, std::pair<Id, int>> fUpvalues; // By lua_upvalueid
+  Id fNextId = 0;
+};
+
+class Decoder {
+  public:
+  Decoder(lua_State *aState, SnapshotBindings const &aBindings, std::string_view aData)
+      : fState(aState), fBindings(aBindings), fReader(aData) {}
+
+  void decodeGlobals() {
+    if (fReader.raw(MAGIC.size())!=MAGIC || fReader.varint()!=FORMAT_VERSION) {
+      throw RuntimeError("Not a luabind snapshot, or one of an unsupported format version");
+    }
+    if (fReader.varint()!=static_cast<std::uint64_t>(lua_version(fState))) {
+      throw RuntimeError("Snapshot was taken with a different Lua version");
+    }
+    int top = lua_gettop(fState);
+    auto guard = makeScopeGuard([this, top]() { lua_settop(fState, top); });
+
+    lua_newtable(fState);
+    fIdsIdx = lua_gettop(fState);
+    // Index the library values of this state before we start replacing them
+    lua_newtable(fState);
+    fLibraryIdx = lua_gettop(fState);
+    forEachLibraryValue(fState, [this](std::string const &aPath, int aIdx) {
+      lua_pushvalue(fState, aIdx);
+      lua_setfield(fState, fLibraryIdx, aPath.c_str());
+    });
+    decodeValue();
+  }
+
+  private:
+  void decodeValue() {
+    luaL_checkstack(fState, 4, "snapshot: value too deeply nested");
+    auto tag = fReader.tag();
+    if (serialize::readScalar(fState, tag, fReader)) {
+      return;
+    }
+    switch (tag) {
+      case Tag::TABLE: {
+        serialize::readTableHeader(fState, fReader);
+        int tableIdx = lua_gettop(fState);
+        assignId(tableIdx);
+        decodeFields(tableIdx);
+        decodeValue();
+        if (lua_isnil(fState, -1)) {
+          lua_pop(fState, 1);
+        } else {
+          lua_setmetatable(fState, tableIdx);
+        }
+        return;
+      }
+      case Tag::REFERENCE:
+        if (lua_rawgeti(fState, fIdsIdx, static_cast<lua_Integer>(fReader.varint() + 1))==LUA_TNIL) {
+          throw RuntimeError("Malformed snapshot: reference to an unknown value");
+        }
+        return;
+      case Tag::BUILTIN_TABLE:pushLibraryValue(LUA_TTABLE);
+        decodeFields(lua_gettop(fState));
+        return;
+      case Tag::BUILTIN_FUNCTION:pushLibraryValue(LUA_TFUNCTION);
+        return;
+      case Tag::BINDING: {
+        using namespace std::string_literals;
+        std::string name{fReader.bytes()};
+        auto function = fBindings.find(name);
+        if (function==nullptr) {
+          throw RuntimeError("Snapshot uses binding "s + name + ", which is not in the SnapshotBindings"s);
+        }
+        lua_pushcfunction(fState, function);
+        return;
+      }
+      case Tag::FUNCTION:decodeLuaFunction();
+        return;
+      default:throw RuntimeError("Malformed snapshot: unexpected tag");
+    }
+  }
+
+  void assignId(int aIdx) {
+    lua_pushvalue(fState, aIdx);
+    lua_rawseti(fState, fIdsIdx, static_cast<lua_Integer>(++fNextId));
+  }
+
+  void decodeFields(int aTableIdx) {
+    serialize::readFields(fState, aTableIdx, fReader, [this]() { decodeValue(); });
+  }
+
+  void pushLibraryValue(int aExpectedType) {
+    using namespace std::string_literals;
+    std::string path{fReader.bytes()};
+    if (lua_getfield(fState, fLibraryIdx, path.c_str())!=aExpectedType) {
+      throw RuntimeError("Snapshot refers to library value "s + (path.empty() ? "_G"s : path)
+                             + ", which this state does not have"s);
+    }
+    assignId(lua_gettop(fState));
+  }
+
+  void decodeLuaFunction() {
+    auto code = fReader.bytes();
+    if (luaL_loadbufferx(fState, code.data(), code.size(), "=snapshot", "b")!=LUA_OK) {
+      throw RuntimeError(lua_tostring(fState, -1));
+    }
+    int functionIdx = lua_gettop(fState);
+    assignId(functionIdx);
+    auto upvalueCount = static_cast<int>(fReader.varint());
+    for (int i = 1; i <= upvalueCount; ++i) {
+      if (fReader.peekTag()==Tag::SHARED_UPVALUE) {
+        fReader.tag();
+        lua_rawgeti(fState, fIdsIdx, static_cast<lua_Integer>(fReader.varint() + 1));
+        auto upvalue = static_cast<int>(fReader.varint());
+        if (!lua_isfunction(fState, -1)) {
+          throw RuntimeError("Malformed snapshot: shared upvalue of an unknown function");
+        }
+        lua_upvaluejoin(fState, functionIdx, i, -1, upvalue);
+        lua_pop(fState, 1);
+        continue;
+      }
+      decodeValue();
+      if (lua_setupvalue(fState, functionIdx, i)==nullptr) {
+        lua_pop(fState, 1);
+      }
+    }
+  }
+
+  lua_State *fState;
+  SnapshotBindings const &fBindings;
+  Reader fReader;
+  int fIdsIdx = 0;
+  int fLibraryIdx = 0;
+  Id fNextId = 0;
+};
+}
+
+namespace luabind {
+/*
+ * A Snapshot is a serialized copy of the global data of an initialized state, from which
+ * new states can be created without running the initialization again:
+ *
+ *   luabind::SnapshotBindings bindings;
+ *   bindings.add("add", add);
+ *
+ *   luabind::Lua lua;
+ *   bindings.installGlobals(lua);
+ *   lua << initScript;
+ *   auto snapshot = luabind::Snapshot::capture(lua, bindings);
+ *   luabind::Lua worker = snapshot.clone(bindings);
+ *
+ * Everything reachable from the global table is captured: strings, numbers, booleans,
+ * tables (with metatables, shared references and cycles), Lua functions (as bytecode,
+ * with their upvalues, preserving upvalues shared between closures), standard library
+ * functions and the C++ bindings registered in the SnapshotBindings. Changes to standard
+ * library tables are applied to the restoring state's own tables. Userdata, coroutines
+ * and unregistered C functions can't be captured and make capture() throw.
+ *
+ * Not captured: the registry (other than what is reachable from globals), and per-state
+ * settings such as the error handler mode and collector parameters.
+ *
+ * data() is a flat byte string that can be written to a file and read back by another
+ * process built against the same Lua, as long as it registers the same bindings.
+ */
+class Snapshot {
+  public:
+  explicit Snapshot(std::string aData) : fData(std::move(aData)) {}
+
+  static Snapshot capture(Lua &aLua, SnapshotBindings const &aBindings = {}) {
+    std::string data;
+    lua_State *state = aLua.state();
+    int top = lua_gettop(state);
+    auto guard = detail::makeScopeGuard([state, top]() { lua_settop(state, top); });
+    detail::snapshot::Encoder(state, aBindings, data).encodeGlobals();
+    return Snapshot{std::move(data)};
+  }
+
+  /*
+   * Applies the snapshot to aLua, which is expected to be a freshly constructed state
+   */
+  void restoreInto(Lua &aLua, SnapshotBindings const &aBindings = {}) const {
+    detail::snapshot::Decoder(aLua.state(), aBindings, fData).decodeGlobals();
+  }
+
+  [[nodiscard]] Lua clone(SnapshotBindings const &aBindings = {}) const {
+    Lua lua;
+    restoreInto(lua, aBindings);
+    return lua;
+  }
+
+  [[nodiscard]] std::string const &data() const {
+    return fData;
+  }
+
+  private:
+  std::string fData;
+};
+}
+
+#endif //LUABIND_SNAPSHOT_HPP
@@ -0,0 +1,484 @@
+#ifndef LUABIND_TRACE_HPP
+#define LUABIND_TRACE_HPP
+
+#include "luabind/luabind.hpp"
+#include "luabind/serialize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace luabind::detail::trace {
+inline constexpr char MAGIC[4] = {'L', 'B', 'T', 'R'};
+inline constexpr std::uint64_t FORMAT_VERSION = 1;
+
+/*
+ * Recorded calls are buffered and written out once this much has accumulated
+ */
+inline constexpr std::size_t FLUSH_SIZE = 64*1024;
+
+/*
+ * A trace file is MAGIC, varint FORMAT_VERSION, then records, each starting with its type:
+ * - NAME: bytes. Names get consecutive ids from 0 in order of appearance.
+ * - CALL (C++ into Lua) and CALLBACK (Lua into an adapted function): varint nesting depth,
+ *   varint name id, varint start and varint duration (nanoseconds since recording
+ *   began), a status byte (1 if the call succeeded), varint argument count, and the
+ *   arguments as length-prefixed bytes in the ValueBuffer format. Arguments that can't
+ *   be serialized (functions, userdata) are recorded as nil.
+ * Records are written as calls finish, so nested calls come before the call containing
+ * them and top-level calls are in the order they were made.
+ */
+enum class RecordType : std::uint8_t {
+  NAME,
+  CALL,
+  CALLBACK
+};
+
+struct Record {
+  RecordType fType;
+  std::uint64_t fDepth;
+  std::uint64_t fName;
+  std::uint64_t fStart;
+  std::uint64_t fDuration;
+  bool fSucceeded;
+  std::uint64_t fArgCount;
+  std::string_view fArgs;
+};
+
+class TraceReader {
+  public:
+  explicit TraceReader(std::string_view aData) : fReader(aData) {
+    if (fReader.remaining() < sizeof(MAGIC) || fReader.raw(sizeof(MAGIC))!=std::string_view(MAGIC, sizeof(MAGIC))) {
+      throw RuntimeError("Not a luabind trace");
+    }
+    if (fReader.varint()!=FORMAT_VERSION) {
+      throw RuntimeError("Unsupported trace format version");
+    }
+  }
+
+  /*
+   * Reads the next call record into aRecord, collecting names on the way. Returns false
+   * at the end of the trace.
+   */
+  bool next(Record &aRecord) {
+    while (fReader.remaining() > 0) {
+      auto type = static_cast<RecordType>(fReader.raw(1)[0]);
+      if (type==RecordType::NAME) {
+        fNames.emplace_back(fReader.bytes());
+        continue;
+      }
+      if (type!=RecordType::CALL && type!=RecordType::CALLBACK) {
+        throw RuntimeError("Malformed trace: unknown record type");
+      }
+      aRecord.fType = type;
+      aRecord.fDepth = fReader.varint();
+      aRecord.fName = fReader.varint();
+      aRecord.fStart = fReader.varint();
+      aRecord.fDuration = fReader.varint();
+      aRecord.fSucceeded = fReader.raw(1)[0]!=0;
+      aRecord.fArgCount = fReader.varint();
+      aRecord.fArgs = fReader.bytes();
+      if (aRecord.fName >= fNames.size()) {
+        throw RuntimeError("Malformed trace: unknown name id");
+      }
+      return true;
+    }
+    return false;
+  }
+
+  [[nodiscard]] std::string const &name(std::uint64_t aId) const {
+    return fNames[aId];
+  }
+
+  private:
+  serialize::Reader fReader;
+  std::vector<std::string> fNames;
+};
+
+struct NameHash {
+  using is_transparent = void;
+
+  std::size_t operator()(std::string_view aName) const {
+    return std::hash<std::string_view>{}(aName);
+  }
+};
+
+/*
+ * The name a called C function is known by to its caller, e.g. the global it was read from
+ */
+inline std::string_view callbackName(lua_State *aState) {
+  lua_Debug debug;
+  if (!lua_getstack(aState, 0, &debug) || !lua_getinfo(aState, "n", &debug) || debug.name==nullptr) {
+    return "?";
+  }
+  return debug.name;
+}
+}
+
+namespace luabind {
+/*
+ * A set of call latencies, for reporting percentiles
+ */
+class LatencyDistribution {
+  public:
+  void add(std::chrono::nanoseconds aLatency) {
+    fSamples.push_back(aLatency.count());
+    fSorted = false;
+  }
+
+  [[nodiscard]] std::size_t count() const {
+    return fSamples.size();
+  }
+
+  [[nodiscard]] std::chrono::nanoseconds mean() const {
+    if (fSamples.empty()) {
+      return {};
+    }
+    long double total = 0;
+    for (auto sample : fSamples) {
+      total += static_cast<long double>(sample);
+    }
+    return std::chrono::nanoseconds(static_cast<std::int64_t>(total/static_cast<long double>(fSamples.size())));
+  }
+
+  /*
+   * The latency below which aFraction (0 to 1) of the calls completed
+   */
+  [[nodiscard]] std::chrono::nanoseconds percentile(double aFraction) const {
+    if (fSamples.empty()) {
+      return {};
+    }
+    if (!fSorted) {
+      std::sort(fSamples.begin(), fSamples.end());
+      fSorted = true;
+    }
+    auto rank = static_cast<std::size_t>(std::clamp(aFraction, 0.0, 1.0)*static_cast<double>(fSamples.size() - 1) + 0.5);
+    return std::chrono::nanoseconds(fSamples[rank]);
+  }
+
+  [[nodiscard]] std::chrono::nanoseconds max() const {
+    return percentile(1.0);
+  }
+
+  private:
+  mutable std::vector<std::int64_t> fSamples;
+  mutable bool fSorted = true;
+};
+
+/*
+ * The latencies of one function in a trace, as recorded and as replayed
+ */
+struct FunctionLatency {
+  std::string fName;
+  bool fCallback = false; // An adapted C++ function called from Lua, rather than a Lua function called from C++
+  LatencyDistribution fRecorded;
+  LatencyDistribution fReplayed;
+  std::size_t fRecordedFailures = 0;
+  std::size_t fReplayedFailures = 0;
+};
+
+struct TraceReport {
+  std::vector<FunctionLatency> fFunctions; // Sorted by name, Lua functions before callbacks of the same name
+  std::size_t fReplayedCalls = 0;
+  std::chrono::nanoseconds fRecordedTotal{0}; // Time spent in top-level calls
+  std::chrono::nanoseconds fReplayedTotal{0};
+
+  [[nodiscard]] FunctionLatency const *find(const std::string_view aName, bool aCallback = false) const {
+    for (auto const &function : fFunctions) {
+      if (function.fName==aName && function.fCallback==aCallback) {
+        return &function;
+      }
+    }
+    return nullptr;
+  }
+
+  /*
+   * A table of call counts and p50/p99/max latencies in microseconds, one row per function
+   */
+  [[nodiscard]] std::string format() const {
+    std::string ret;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-24s %-8s %9s %27s %27s\n", "function", "kind", "calls",
+                  "recorded p50/p99/max us", "replayed p50/p99/max us");
+    ret += line;
+    auto us = [](std::chrono::nanoseconds aLatency) { return static_cast<double>(aLatency.count())/1000.0; };
+    for (auto const &function : fFunctions) {
+      auto const &recorded = function.fRecorded;
+      auto const &replayed = function.fReplayed;
+      std::snprintf(line, sizeof(line), "%-24s %-8s %9zu %9.1f/%8.1f/%8.1f %9.1f/%8.1f/%8.1f\n",
+                    function.fName.c_str(), function.fCallback ? "callback" : "lua", recorded.count(),
+                    us(recorded.percentile(0.5)), us(recorded.percentile(0.99)), us(recorded.max()),
+                    us(replayed.percentile(0.5)), us(replayed.percentile(0.99)), us(replayed.max()));
+      ret += line;
+    }
+    std::snprintf(line, sizeof(line), "%zu calls replayed: %.3f ms recorded, %.3f ms replayed\n", fReplayedCalls,
+                  us(fRecordedTotal)/1000.0, us(fReplayedTotal)/1000.0);
+    ret += line;
+    return ret;
+  }
+};
+
+/*
+ * TraceRecorder logs every call through a Lua to a compact binary trace while it exists:
+ * each call C++ makes into a Lua function (lua["f"](...)) and each call scripts make into
+ * adapted C++ functions, with its arguments and timing. replayTrace runs the trace again
+ * against a freshly set up state, so a production workload can be reproduced to compare
+ * library or script versions.
+ *
+ *   {
+ *     luabind::TraceRecorder recorder(lua, "requests.trace");
+ *     serve(lua);
+ *   } // the trace is complete once the recorder is destroyed
+ *
+ * Arguments are serialized as Lua values before each call and the clock only runs
+ * during the call itself, so recording adds little to the latencies it measures. A Lua
+ * has one CallObserver at a time; the recorder takes its place and removes itself.
+ */
+class TraceRecorder final : public CallObserver {
+  public:
+  TraceRecorder(Lua &aLua, std::string const &aPath)
+      : fLua(aLua), fFile(aPath, std::ios::binary | std::ios::trunc), fStart(Clock::now()) {
+    using namespace std::string_literals;
+    if (!fFile) {
+      throw FileError("Cannot write trace "s + aPath);
+    }
+    fBuffer.append(detail::trace::MAGIC, sizeof(detail::trace::MAGIC));
+    detail::serialize::Writer(fBuffer).varint(detail::trace::FORMAT_VERSION);
+    fLua.setCallObserver(this);
+  }
+
+  TraceRecorder(TraceRecorder const &) = delete;
+
+  TraceRecorder &operator=(TraceRecorder const &) = delete;
+
+  ~TraceRecorder() override {
+    if (fLua.callObserver()==this) {
+      fLua.setCallObserver(nullptr);
+    }
+    flush();
+  }
+
+  /*
+   * Writes out the calls recorded so far
+   */
+  void flush() {
+    fFile.write(fBuffer.data(), static_cast<std::streamsize>(fBuffer.size()));
+    fFile.flush();
+    fBuffer.clear();
+  }
+
+  /*
+   * Calls (and callbacks) recorded so far
+   */
+  [[nodiscard]] std::size_t recordCount() const {
+    return fRecordCount;
+  }
+
+  void callStarting(lua_State *aState, std::string_view aName, int aArgCount) override {
+    start(aState, detail::trace::RecordType::CALL, aName, lua_gettop(aState) - aArgCount + 1, aArgCount);
+  }
+
+  void callFinished(lua_State *, bool aSucceeded) override {
+    finish(aSucceeded);
+  }
+
+  void callbackStarting(lua_State *aState) override {
+    start(aState, detail::trace::RecordType::CALLBACK, detail::trace::callbackName(aState), 1, lua_gettop(aState));
+  }
+
+  void callbackFinished(lua_State *, bool aSucceeded) override {
+    finish(aSucceeded);
+  }
+
+  private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending {
+    detail::trace::RecordType fType;
+    std::uint64_t fName;
+    int fArgCount;
+    std::size_t fArgsPos; // Where its arguments start in fPendingArgs
+    Clock::time_point fStart;
+  };
+
+  std::uint64_t nameId(const std::string_view aName) {
+    if (auto found = fNames.find(aName); found!=fNames.end()) {
+      return found->second;
+    }
+    auto id = static_cast<std::uint64_t>(fNames.size());
+    fNames.emplace(std::string(aName), id);
+    fBuffer.push_back(static_cast<char>(detail::trace::RecordType::NAME));
+    detail::serialize::Writer(fBuffer).bytes(aName);
+    return id;
+  }
+
+  void start(lua_State *aState, detail::trace::RecordType aType, const std::string_view aName, int aFirstArg,
+             int aArgCount) {
+    Pending pending{aType, nameId(aName), aArgCount, fPendingArgs.size(), {}};
+    for (int i = 0; i < aArgCount; ++i) {
+      try {
+        detail::serialize::writeValue(aState, aFirstArg + i, fPendingArgs, fIds);
+      } catch (std::exception &) {
+        detail::serialize::Writer(fPendingArgs).tag(detail::serialize::Tag::NIL);
+      }
+    }
+    fPending.push_back(pending);
+    fPending.back().fStart = Clock::now();
+  }
+
+  void finish(bool aSucceeded) {
+    auto end = Clock::now();
+    auto pending = fPending.back();
+    fPending.pop_back();
+    auto nanos = [](Clock::duration aDuration) {
+      return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(aDuration).count());
+    };
+
+    detail::serialize::Writer writer(fBuffer);
+    fBuffer.push_back(static_cast<char>(pending.fType));
+    writer.varint(fPending.size());
+    writer.varint(pending.fName);
+    writer.varint(nanos(pending.fStart - fStart));
+    writer.varint(nanos(end - pending.fStart));
+    fBuffer.push_back(aSucceeded ? 1 : 0);
+    writer.varint(static_cast<std::uint64_t>(pending.fArgCount));
+    writer.bytes(std::string_view(fPendingArgs).substr(pending.fArgsPos));
+    fPendingArgs.resize(pending.fArgsPos);
+    ++fRecordCount;
+
+    if (fPending.empty() && fBuffer.size() >= detail::trace::FLUSH_SIZE) {
+      flush();
+    }
+  }
+
+  Lua &fLua;
+  std::ofstream fFile;
+  Clock::time_point fStart;
+  std::string fBuffer;
+  std::string fPendingArgs;
+  std::vector<Pending> fPending;
+  std::unordered_map<std::string, std::uint64_t, detail::trace::NameHash, std::equal_to<>> fNames;
+  std::unordered_map<const void *, detail::serialize::Id> fIds; // Scratch space for serializing
+  std::size_t fRecordCount = 0;
+};
+}
+
+namespace luabind::detail::trace {
+/*
+ * Times the calls made while a trace is replayed: callbacks, and calls the callbacks make
+ * back into Lua
+ */
+class ReplayObserver final : public CallObserver {
+  public:
+  using Latencies = std::map<std::pair<std::string, bool>, FunctionLatency>;
+
+  explicit ReplayObserver(Latencies &aLatencies) : fLatencies(aLatencies) {}
+
+  void callStarting(lua_State *, std::string_view aName, int) override {
+    fPending.push_back({std::string(aName), false, std::chrono::steady_clock::now()});
+  }
+
+  void callFinished(lua_State *, bool aSucceeded) override {
+    finish(aSucceeded);
+  }
+
+  void callbackStarting(lua_State *aState) override {
+    fPending.push_back({std::string(callbackName(aState)), true, std::chrono::steady_clock::now()});
+  }
+
+  void callbackFinished(lua_State *, bool aSucceeded) override {
+    finish(aSucceeded);
+  }
+
+  private:
+  struct Pending {
+    std::string fName;
+    bool fCallback;
+    std::chrono::steady_clock::time_point fStart;
+  };
+
+  void finish(bool aSucceeded) {
+    auto end = std::chrono::steady_clock::now();
+    auto pending = std::move(fPending.back());
+    fPending.pop_back();
+    auto &function = fLatencies[{pending.fName, pending.fCallback}];
+    function.fReplayed.add(end - pending.fStart);
+    function.fReplayedFailures += aSucceeded ? 0 : 1;
+  }
+
+  Latencies &fLatencies;
+  std::vector<Pending> fPending;
+};
+}
+
+namespace luabind {
+/*
+ * Replays the trace at aPath against aLua, which should be set up the way the recorded
+ * state was: the same scripts run and the same C++ functions bound. Each top-level call
+ * in the trace is made again, in order and back to back, with the recorded arguments.
+ * Callbacks, and calls they make into Lua, happen as the replayed code makes them.
+ *
+ * The report has the recorded and replayed latency distribution of every function in the
+ * trace. A replayed call that fails is counted and replay carries on.
+ */
+inline TraceReport replayTrace(Lua &aLua, std::string const &aPath) {
+  detail::MappedFile file(aPath);
+  detail::trace::TraceReader reader(file.contents());
+  detail::trace::ReplayObserver::Latencies latencies;
+  TraceReport report;
+
+  lua_State *state = aLua.state();
+  detail::trace::ReplayObserver observer(latencies);
+  auto *previousObserver = aLua.callObserver();
+  aLua.setCallObserver(&observer);
+  auto guard = detail::makeScopeGuard([&aLua, previousObserver]() { aLua.setCallObserver(previousObserver); });
+
+  detail::trace::Record record{};
+  while (reader.next(record)) {
+    auto const &name = reader.name(record.fName);
+    bool callback = record.fType==detail::trace::RecordType::CALLBACK;
+    auto &function = latencies[{name, callback}];
+    function.fRecorded.add(std::chrono::nanoseconds(record.fDuration));
+    function.fRecordedFailures += record.fSucceeded ? 0 : 1;
+    if (callback || record.fDepth!=0) {
+      continue;
+    }
+
+    int top = lua_gettop(state);
+    luaL_checkstack(state, static_cast<int>(record.fArgCount) + 2, "replaying trace");
+    lua_getglobal(state, name.c_str());
+    detail::serialize::Reader args(record.fArgs);
+    for (std::uint64_t i = 0; i < record.fArgCount; ++i) {
+      detail::serialize::readValue(state, args);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int status = lua_pcall(state, static_cast<int>(record.fArgCount), 0, 0);
+    auto latency = std::chrono::steady_clock::now() - start;
+    lua_settop(state, top);
+
+    function.fReplayed.add(latency);
+    function.fReplayedFailures += status==LUA_OK ? 0 : 1;
+    report.fRecordedTotal += std::chrono::nanoseconds(record.fDuration);
+    report.fReplayedTotal += std::chrono::duration_cast<std::chrono::nanoseconds>(latency);
+    ++report.fReplayedCalls;
+  }
+
+  for (auto &[key, function] : latencies) {
+    function.fName = key.first;
+    function.fCallback = key.second;
+    report.fFunctions.push_back(std::move(function));
+  }
+  return report;
+}
+}
+
+#endif //LUABIND_TRACE_HPP
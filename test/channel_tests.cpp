@@ -0,0 +1,142 @@
+#include "luabind/channel.hpp"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+TEST(Channel, SendAndReceive) {
+  luabind::Lua lua;
+  luabind::Channel channel(8);
+  ASSERT_EQ(channel.capacity(), 8);
+  channel.installGlobal(lua, "ch");
+  lua << R"(
+        ch:send(1)
+        ch:send("two")
+        ch:send({ three = { 3 } })
+        assert(ch:recv() == 1)
+        assert(ch:recv() == "two")
+        assert(ch:recv().three[1] == 3)
+        local ok, value = ch:try_recv()
+        assert(ok == false and value == nil)
+        ch:send(4)
+        ok, value = ch:try_recv()
+        assert(ok == true and value == 4)
+    )";
+}
+
+TEST(Channel, Close) {
+  luabind::Lua lua;
+  luabind::Channel channel(4);
+  channel.installGlobal(lua, "ch");
+  lua << R"(
+        ch:send("last")
+        ch:close()
+        assert(not pcall(ch.send, ch, "rejected"))
+        assert(ch:recv() == "last")
+        assert(ch:recv() == nil)
+        local ok, reason = ch:try_recv()
+        assert(ok == false and reason == "closed")
+    )";
+  ASSERT_TRUE(channel.closed());
+}
+
+TEST(Channel, UnsupportedValue) {
+  luabind::Lua lua;
+  luabind::Channel channel(4);
+  channel.installGlobal(lua, "ch");
+  lua << R"(
+        local ok, message = pcall(ch.send, ch, print)
+        assert(not ok and message:find("Cannot serialize"))
+        ok = pcall(ch.send, ch)
+        assert(not ok)
+    )";
+}
+
+TEST(Channel, NilIsNotAMessage) {
+  luabind::Lua lua;
+  luabind::Channel channel(4);
+  channel.installGlobal(lua, "ch");
+  lua << R"(
+        ch:send(1)
+        local ok, message = pcall(ch.send, ch, nil)
+        assert(not ok and message:find("can't be nil"))
+        ch:send(2)
+        ch:close()
+        local received = {}
+        for value in ch.recv, ch do received[#received + 1] = value end
+        assert(#received == 2 and received[2] == 2)
+        local ok, reason = ch:try_recv()
+        assert(ok == false and reason == "closed")
+    )";
+}
+
+TEST(Channel, CoroutinesYieldInsteadOfBlocking) {
+  luabind::Lua lua;
+  luabind::Channel channel(2);
+  channel.installGlobal(lua, "ch");
+  lua << R"(
+        local producer = coroutine.create(function()
+            for i = 1, 5 do ch:send(i) end
+        end)
+        local consumer = coroutine.create(function()
+            local sum = 0
+            for i = 1, 5 do sum = sum + ch:recv() end
+            return sum
+        end)
+
+        -- The producer fills the channel, then yields the channel it is waiting on
+        local ok, waitingOn = coroutine.resume(producer)
+        assert(ok and waitingOn == ch)
+        local sum
+        while coroutine.status(consumer) ~= "dead" do
+            local _, result = coroutine.resume(consumer)
+            sum = result
+            if coroutine.status(producer) ~= "dead" then coroutine.resume(producer) end
+        end
+        assert(sum == 15, tostring(sum))
+        assert(coroutine.status(producer) == "dead")
+    )";
+}
+
+TEST(Channel, AcrossThreads) {
+  constexpr int producers = 3;
+  constexpr int consumers = 2;
+  constexpr int perProducer = 20000;
+  luabind::Channel channel(64);
+  luabind::Channel results(consumers);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&]() {
+      luabind::Lua lua;
+      channel.installGlobal(lua, "ch");
+      lua["count"] = perProducer;
+      lua << "for i = 1, count do ch:send(i) end";
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&]() {
+      luabind::Lua lua;
+      channel.installGlobal(lua, "ch");
+      results.installGlobal(lua, "results");
+      lua << R"(
+          local sum = 0
+          for value in ch.recv, ch do sum = sum + value end
+          results:send(sum)
+      )";
+    });
+  }
+  for (int p = 0; p < producers; ++p) {
+    threads[p].join();
+  }
+  channel.close();
+  for (int c = producers; c < producers + consumers; ++c) {
+    threads[c].join();
+  }
+
+  luabind::Lua lua;
+  results.installGlobal(lua, "results");
+  lua << "total = results:recv() + results:recv()";
+  double total = lua["total"];
+  ASSERT_EQ(total, static_cast<double>(producers)*perProducer*(perProducer + 1)/2);
+}
@@ -63,6 +63,29 @@ static_assert(
     std::is_same_v<traits::function_traits<decltype(&CallableStruct::staticMethod)>::ArgumentTypes,
                    std::tuple<int, bool>>);
 
+static_assert(traits::is_stateless_v<decltype([](int, bool) {})>);
+static_assert(traits::is_stateless_v<CallableStruct>);
+static_assert(!traits::is_stateless_v<decltype([x = 1](int, bool) { return x; })>);
+static_assert(!traits::is_stateless_v<int (*)(int, bool)>);
+static_assert(!traits::is_stateless_v<int>);
+
+static_assert(luaTypeMask<int>()==luaTypeBit(LUA_TNUMBER));
+static_assert(luaTypeMask<bool>()==luaTypeBit(LUA_TBOOLEAN));
+static_assert(luaTypeMask<std::string>()==luaTypeBit(LUA_TSTRING));
+static_assert(luaTypeMask<std::vector<int>>()==luaTypeBit(LUA_TTABLE));
+static_assert(luaTypeMask<std::tuple<int>>()==luaTypeBit(LUA_TTABLE));
+static_assert(luaTypeMask<std::monostate>()==luaTypeBit(LUA_TNIL));
+static_assert(luaTypeMask<std::nullptr_t>()==luaTypeBit(LUA_TNIL));
+static_assert(luaTypeMask<std::optional<int>>()==(luaTypeBit(LUA_TNIL) | luaTypeBit(LUA_TNUMBER)));
+static_assert(luaTypeMask<std::variant<bool, std::string>>()==(luaTypeBit(LUA_TBOOLEAN) | luaTypeBit(LUA_TSTRING)));
+
+using TestOverload = decltype(luabind::overload([](int) {}, [](std::string, bool) {}));
+static_assert(traits::is_overloaded_v<TestOverload>);
+static_assert(!traits::is_overloaded_v<CallableStruct>);
+static_assert(OverloadSignatures<TestOverload>::fSignatures[0].fArity==1);
+static_assert(OverloadSignatures<TestOverload>::fSignatures[1].fArity==2);
+static_assert(OverloadSignatures<TestOverload>::fSignatures[1].fTypeMasks[1]==luaTypeBit(LUA_TBOOLEAN));
+
 static_assert(traits::is_vector_v<std::vector<int>>);
 static_assert(traits::is_vector_v<std::vector<std::string>>);
 static_assert(traits::is_vector_v<std::vector<std::vector<int>>>);
@@ -82,4 +105,47 @@ static_assert(traits::is_table_v<table<>>);
 static_assert(traits::is_table_v<table<field<"name"_f, int>>>);
 static_assert(traits::is_table_v<table<field<"name1"_f, int>, field<"name2"_f, std::string>>>);
 static_assert(!traits::is_table_v<int>);
-static_assert(!traits::is_table_v<std::string>);
\ No newline at end of file
+static_assert(!traits::is_table_v<std::string>);
+
+enum class Direction { UP, DOWN };
+
+enum class Unnamed { A, B };
+
+template <>
+struct luabind::EnumStrings<Direction> {
+  static constexpr std::array<std::pair<Direction, std::string_view>, 2> fNames{{{Direction::UP, "up"}, {Direction::DOWN, "down"}}};
+};
+
+static_assert(traits::is_named_enum_v<Direction>);
+static_assert(!traits::is_named_enum_v<Unnamed>);
+static_assert(!traits::is_named_enum_v<int>);
+static_assert(enums::Names<Direction>::DENSE);
+static_assert(enums::Names<Direction>::STRINGS[1].view()=="down");
+static_assert(luabind::interned<"name"_f>.view()=="name");
+struct Empty {};
+
+struct Nested {
+  std::string a;
+  struct {
+    int b;
+    int c;
+  } inner;
+  std::vector<int> d;
+};
+
+static_assert(luabind::detail::aggregate::memberCount<Empty>()==0);
+static_assert(luabind::detail::aggregate::memberCount<Nested>()==3);
+static_assert(!traits::is_reflected_struct_v<Nested>);
+
+static_assert((&luabind::interned<"name"_f>)==(&luabind::interned<"name"_f>));
+
+int moduleFunction(int a) { return a; }
+
+using TestModule = luabind::module<"testmodule"_f,
+                                   luabind::def<"first"_f, [](int a) { return a; }>,
+                                   luabind::def<"second"_f, &moduleFunction>>;
+static_assert(TestModule::fFunctions.size()==3);
+static_assert(TestModule::fFunctions[0].name[0]=='f');
+static_assert(TestModule::fFunctions[1].name[0]=='s');
+static_assert(TestModule::fFunctions[1].func==&adaptedStatic<&moduleFunction>);
+static_assert(TestModule::fFunctions[2].name==nullptr && TestModule::fFunctions[2].func==nullptr);
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "luabind/dataset.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+luabind::Dataset makeReference() {
+  luabind::Lua builder;
+  builder << R"(
+      local shared = { "x", "y" }
+      reference = {
+          10, 20, 30,
+          name = "reference",
+          enabled = true,
+          ratio = 0.5,
+          [-7] = "negative",
+          users = { { id = 1, tags = shared }, { id = 2, tags = shared } },
+      }
+      reference.self = reference
+  )";
+  return luabind::Dataset::fromLua(builder, "reference");
+}
+}
+
+TEST(Dataset, Access) {
+  auto dataset = makeReference();
+  luabind::Lua lua;
+  dataset.installGlobal(lua, "data");
+  lua << R"(
+      assert(#data == 3 and data[1] == 10 and data[3] == 30 and data[4] == nil)
+      assert(data[2.0] == 20 and data[2.5] == nil)
+      assert(data.name == "reference" and data.enabled == true and data.ratio == 0.5)
+      assert(data[-7] == "negative" and data.missing == nil and data[true] == nil)
+      assert(data.users[2].id == 2 and data.users[1].tags[2] == "y")
+      assert(data.users[1].tags == data.users[2].tags, "shared tables keep their identity")
+      assert(data.self == data)
+
+      local sum = 0
+      for _, value in ipairs(data) do sum = sum + value end
+      assert(sum == 60)
+
+      local keys = {}
+      for key in pairs(data) do keys[#keys + 1] = tostring(key) end
+      assert(table.concat(keys, ",") == "1,2,3,-7,enabled,name,ratio,self,users", table.concat(keys, ","))
+
+      local ok, message = pcall(function() data.name = "changed" end)
+      assert(not ok and message:find("read%-only"))
+  )";
+}
+
+TEST(Dataset, FromValue) {
+  std::vector<std::tuple<int, std::string>> rows{{1, "one"}, {2, "two"}};
+  auto dataset = luabind::Dataset::fromValue(rows);
+  luabind::Lua lua;
+  dataset.installGlobal(lua, "rows");
+  lua << "assert(#rows == 2 and rows[2][1] == 2 and rows[2][2] == 'two')";
+}
+
+TEST(Dataset, FileRoundTrip) {
+  auto path = testing::TempDir() + "luabind_dataset_test.lbds";
+  makeReference().save(path);
+  {
+    auto dataset = luabind::Dataset::load(path);
+    luabind::Lua lua;
+    dataset.installGlobal(lua, "data");
+    lua << "assert(data.users[2].tags[1] == 'x' and data.self.name == 'reference')";
+  }
+  std::remove(path.c_str());
+  ASSERT_THROW(luabind::Dataset::load(path), luabind::FileError);
+}
+
+TEST(Dataset, SharedAcrossThreads) {
+  luabind::Lua builder;
+  builder << R"(
+      reference = {}
+      for i = 1, 1000 do reference[i] = { value = i, label = "item" .. i } end
+  )";
+  auto dataset = luabind::Dataset::fromLua(builder, "reference");
+
+  std::vector<std::thread> threads;
+  std::vector<double> sums(4);
+  for (std::size_t t = 0; t < sums.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      luabind::Lua lua;
+      dataset.installGlobal(lua, "data");
+      lua << R"(
+          total = 0
+          for _, item in ipairs(data) do total = total + item.value + #item.label end
+      )";
+      sums[t] = lua["total"];
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (double sum : sums) {
+    ASSERT_EQ(sum, sums[0]);
+  }
+}
+
+TEST(Dataset, Errors) {
+  luabind::Lua lua;
+  lua << "withFunction = { f = print }; withBadKey = { [true] = 1 }";
+  ASSERT_THROW(luabind::Dataset::fromLua(lua, "withFunction"), luabind::RuntimeError);
+  ASSERT_THROW(luabind::Dataset::fromLua(lua, "withBadKey"), luabind::RuntimeError);
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+  ASSERT_THROW(luabind::Dataset::fromBytes("not a dataset"), luabind::RuntimeError);
+}
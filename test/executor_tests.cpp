@@ -0,0 +1,81 @@
+#include "luabind/executor.hpp"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+static void loadCounter(luabind::Lua &aLua) {
+  aLua << R"(
+      total = 0
+      order = {}
+      add = function(thread, n)
+          total = total + n
+          order[thread] = (order[thread] or 0) + 1
+          return total
+      end
+      fail = function()
+          error("bad request")
+      end
+  )";
+}
+
+TEST(Executor, CallsFromManyThreads) {
+  constexpr int threadCount = 4;
+  constexpr int callsPerThread = 2000;
+  std::vector<std::vector<std::future<int>>> results(threadCount);
+  {
+    luabind::StateExecutor executor(loadCounter);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&executor, &results, t]() {
+        for (int i = 0; i < callsPerThread; ++i) {
+          results[t].push_back(executor.call<int>("add", t + 1, 1));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto total = executor.submit([](luabind::Lua &aLua) { return aLua["total"].as<int>(); });
+    ASSERT_EQ(total.get(), threadCount*callsPerThread);
+    auto stats = executor.stats();
+    ASSERT_EQ(stats.fCalls, threadCount*callsPerThread + 1u);
+    ASSERT_GE(stats.meanBatchSize(), 1.0);
+  }
+  for (auto &futures : results) {
+    // Each thread's calls run in the order it submitted them
+    int previous = 0;
+    for (auto &future : futures) {
+      int total = future.get();
+      ASSERT_GT(total, previous);
+      previous = total;
+    }
+  }
+}
+
+TEST(Executor, DeliversErrors) {
+  luabind::StateExecutor executor(loadCounter);
+  auto failed = executor.call<int>("fail");
+  ASSERT_THROW(failed.get(), luabind::RuntimeError);
+  auto thrown = executor.submit([](luabind::Lua &) -> int { throw std::runtime_error("from C++"); });
+  ASSERT_THROW(thrown.get(), std::runtime_error);
+  // The state is still usable
+  ASSERT_EQ(executor.call<int>("add", 1, 2).get(), 2);
+}
+
+TEST(Executor, DestructorRunsQueuedCalls) {
+  std::vector<std::future<void>> done;
+  {
+    luabind::StateExecutor executor;
+    for (int i = 0; i < 100; ++i) {
+      done.push_back(executor.submit([](luabind::Lua &aLua) { aLua << "x = (x or 0) + 1"; }));
+    }
+  }
+  for (auto &future : done) {
+    ASSERT_NO_THROW(future.get());
+  }
+}
+
+TEST(Executor, InitializerErrorsAreRethrown) {
+  ASSERT_THROW(luabind::StateExecutor([](luabind::Lua &aLua) { aLua << "error('no')"; }), luabind::RuntimeError);
+}
@@ -0,0 +1,87 @@
+#include "luabind/globals.hpp"
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <string>
+
+TEST(Globals, BoundVariable) {
+  luabind::Lua lua;
+  double threshold = 0.5;
+  std::string mode = "fast";
+  luabind::bindVariable(lua, "threshold", &threshold);
+  luabind::bindVariable(lua, "mode", &mode);
+  lua << "assert(threshold == 0.5 and mode == 'fast')";
+
+  threshold = 0.75;
+  mode = "safe";
+  lua << "assert(threshold == 0.75 and mode == 'safe')";
+  lua << "threshold = threshold * 2; mode = 'changed'";
+  ASSERT_EQ(threshold, 1.5);
+  ASSERT_EQ(mode, "changed");
+  ASSERT_EQ(static_cast<double>(lua["threshold"]), 1.5);
+  lua["threshold"] = 3;
+  ASSERT_EQ(threshold, 3);
+
+  lua << R"(
+        local ok, message = pcall(function() threshold = "high" end)
+        assert(not ok and message:find("bound variable 'threshold'"), message)
+    )";
+  ASSERT_EQ(threshold, 3);
+}
+
+TEST(Globals, ReadOnlyAndProperties) {
+  luabind::Lua lua;
+  const int version = 7;
+  int writes = 0;
+  int level = 1;
+  luabind::bindVariable(lua, "version", &version);
+  luabind::bindProperty(lua, "level", [&level]() { return level; },
+                        [&level, &writes](int aLevel) {
+                          if (aLevel < 0) {
+                            throw std::invalid_argument("level must not be negative");
+                          }
+                          level = aLevel;
+                          ++writes;
+                        });
+  luabind::bindProperty(lua, "calls", [&writes]() { return writes; });
+  lua << R"(
+        assert(version == 7)
+        assert(not pcall(function() version = 8 end))
+        level = level + 4
+        assert(level == 5 and calls == 1)
+        local ok, message = pcall(function() level = -1 end)
+        assert(not ok and message:find("must not be negative"), message)
+        assert(not pcall(function() calls = 0 end))
+    )";
+  ASSERT_EQ(level, 5);
+  ASSERT_EQ(writes, 1);
+}
+
+TEST(Globals, CoexistsWithOtherGlobals) {
+  luabind::Lua lua;
+  int counter = 0;
+  lua << R"(
+        existing = "shadowed"
+        -- A strict mode in the style of strict.lua: unknown names are errors
+        setmetatable(_G, {
+            __index = function(_, name) error("undefined global " .. name, 2) end,
+        })
+    )";
+  luabind::bindVariable(lua, "existing", &counter);
+  luabind::bindVariable(lua, "counter", &counter);
+  lua << R"(
+        counter = 5
+        assert(existing == 5)
+        plain = 1
+        assert(plain == 1)
+        assert(not pcall(function() return undefined end))
+    )";
+  ASSERT_EQ(counter, 5);
+
+  luabind::unbindVariable(lua, "counter");
+  lua << "assert(not pcall(function() return counter end)); counter = 'now a plain global'";
+  ASSERT_EQ(counter, 5);
+
+  auto env = lua.newEnvironment();
+  env << "assert(existing == 5)";
+}
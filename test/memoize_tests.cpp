@@ -0,0 +1,128 @@
+#include "luabind/memoize.hpp"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <tuple>
+
+TEST(Memoize, ServesRepeatedArgumentsFromCache) {
+  luabind::Lua lua;
+  lua << R"(
+        calls = 0
+        function classify(key, prefix)
+            calls = calls + 1
+            return prefix .. math.floor(key % 3)
+        end
+    )";
+  luabind::Memoized<std::string(int, std::string)> classify(lua, "classify");
+  for (int round = 0; round < 3; ++round) {
+    for (int key = 0; key < 10; ++key) {
+      ASSERT_EQ(classify(key, "c"), "c" + std::to_string(key%3));
+    }
+  }
+  ASSERT_EQ(static_cast<int>(lua["calls"]), 10);
+  auto stats = classify.stats();
+  ASSERT_EQ(stats.fHits, 20);
+  ASSERT_EQ(stats.fMisses, 10);
+  ASSERT_DOUBLE_EQ(stats.hitRate(), 20.0/30.0);
+}
+
+TEST(Memoize, EvictsLeastRecentlyUsed) {
+  luabind::Lua lua;
+  lua << "calls = 0; function square(x) calls = calls + 1; return x * x end";
+  luabind::Memoized<int(int)> square(lua, "square", {.fCapacity = 2, .fShards = 1});
+  square(1);
+  square(2);
+  square(1); // 1 is now the most recently used
+  square(3); // evicts 2
+  ASSERT_EQ(square.stats().fEvictions, 1);
+  square(1);
+  ASSERT_EQ(static_cast<int>(lua["calls"]), 3);
+  square(2);
+  ASSERT_EQ(static_cast<int>(lua["calls"]), 4);
+  ASSERT_EQ(square.cache()->size(), 2);
+}
+
+TEST(Memoize, NeverHoldsMoreThanItsCapacity) {
+  luabind::MemoCache<int(int)> cache({.fCapacity = 4, .fShards = 8});
+  for (int key = 0; key < 100; ++key) {
+    cache.insert({key}, luabind::detail::memoize::hashValue(std::tuple<int>{key}), key);
+  }
+  ASSERT_LE(cache.size(), 4u);
+}
+
+TEST(Memoize, InvalidatedWhenGlobalIsReplaced) {
+  luabind::Lua lua;
+  lua << R"(
+        function label(x) return 'old' end
+        function replace() label = function() return 'replaced' end end
+    )";
+  luabind::Memoized<std::string(std::tuple<int, int>)> label(lua, "label");
+  ASSERT_EQ(label({1, 2}), "old");
+
+  lua["unrelated"] = 5;
+  ASSERT_EQ(label({1, 2}), "old");
+  ASSERT_EQ(label.stats().fInvalidations, 0);
+
+  lua << "function label(x) return 'new' end";
+  ASSERT_EQ(label({1, 2}), "new");
+  lua["label"] = [](std::tuple<int, int>) { return std::string("bound"); };
+  ASSERT_EQ(label({1, 2}), "bound");
+  ASSERT_EQ(label.stats().fInvalidations, 2);
+
+  lua["replace"]();
+  ASSERT_EQ(label({1, 2}), "replaced");
+  ASSERT_EQ(label.stats().fInvalidations, 3);
+}
+
+TEST(Memoize, HoldsTheFunctionItCompares) {
+  luabind::Lua lua;
+  lua << "function f(x) return 1 end; weak = setmetatable({ f }, { __mode = 'v' })";
+  luabind::Memoized<int(int)> memoized(lua, "f");
+  ASSERT_EQ(memoized(1), 1);
+  // The old function can't be collected, so its replacement can't reuse its address
+  lua << "f = nil; collectgarbage(); collectgarbage(); assert(weak[1] ~= nil)";
+  lua << "function f(x) return 2 end";
+  ASSERT_EQ(memoized(1), 2);
+  ASSERT_EQ(memoized.stats().fInvalidations, 1);
+  lua << "collectgarbage(); collectgarbage(); assert(weak[1] == nil)";
+}
+
+TEST(Memoize, SharedCache) {
+  auto cache = std::make_shared<luabind::MemoCache<double(double)>>();
+  luabind::Lua first;
+  luabind::Lua second;
+  first << "function half(x) return x / 2 end";
+  second << "function half(x) return x / 2 end";
+  luabind::Memoized<double(double)> firstHalf(first, "half", cache);
+  luabind::Memoized<double(double)> secondHalf(second, "half", cache);
+  ASSERT_EQ(firstHalf(3), 1.5);
+  ASSERT_EQ(secondHalf(3), 1.5);
+  ASSERT_EQ(cache->stats().fHits, 1);
+}
+
+TEST(Memoize, KeysOwnTheirStrings) {
+  luabind::Lua lua;
+  lua << R"(
+        calls = 0
+        function measure(text) calls = calls + 1 return #text end
+        function pair(key) calls = calls + 1 return #key[1] + key[2] end
+    )";
+  luabind::Memoized<int(std::string_view)> measure(lua, "measure");
+  {
+    std::string temporary(40, 'x');
+    ASSERT_EQ(measure(temporary), 40);
+  }
+  std::string same(40, 'x');
+  ASSERT_EQ(measure(same), 40);
+  ASSERT_EQ(measure.stats().fHits, 1u);
+
+  luabind::Memoized<int(std::tuple<std::string_view, int>)> pair(lua, "pair");
+  {
+    std::string temporary = "abc";
+    ASSERT_EQ(pair({temporary, 1}), 4);
+  }
+  std::string copy = "abc";
+  ASSERT_EQ(pair({copy, 1}), 4);
+  ASSERT_EQ(pair.stats().fHits, 1u);
+  ASSERT_EQ(static_cast<int>(lua["calls"]), 2);
+}
@@ -0,0 +1,77 @@
+#include "luabind/parallel.hpp"
+#include "gtest/gtest.h"
+
+#include <numeric>
+
+static void loadTransforms(luabind::Lua &aLua) {
+  aLua << R"(
+      square = function(x)
+          return x * x
+      end
+      squareAll = function(chunk)
+          local out = {}
+          for i, x in ipairs(chunk) do
+              out[i] = x * x
+          end
+          return out
+      end
+      fail = function(x)
+          if x == 500 then
+              error("bad record")
+          end
+          return x
+      end
+  )";
+}
+
+TEST(Parallel, MapPreservesOrder) {
+  luabind::StatePool pool(4, loadTransforms);
+  std::vector<int> input(10000);
+  std::iota(input.begin(), input.end(), 0);
+  auto output = pool.map<int>("square", input, 64);
+  ASSERT_EQ(output.size(), input.size());
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    ASSERT_EQ(output[i], input[i]*input[i]);
+  }
+}
+
+TEST(Parallel, MapChunks) {
+  luabind::StatePool pool(3, loadTransforms);
+  std::vector<int> input(1001);
+  std::iota(input.begin(), input.end(), 0);
+  auto output = pool.mapChunks<int>("squareAll", input, 100);
+  ASSERT_EQ(output.size(), input.size());
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    ASSERT_EQ(output[i], input[i]*input[i]);
+  }
+}
+
+TEST(Parallel, StringResults) {
+  luabind::StatePool pool(2, [](luabind::Lua &aLua) {
+    aLua << "greet = function(name) return 'hello ' .. name end";
+  });
+  std::vector<std::string> input{"a", "b", "c"};
+  auto output = pool.map<std::string>("greet", input, 1);
+  ASSERT_EQ(output, (std::vector<std::string>{"hello a", "hello b", "hello c"}));
+}
+
+TEST(Parallel, EmptyInput) {
+  luabind::StatePool pool(2, loadTransforms);
+  ASSERT_TRUE(pool.map<int>("square", std::vector<int>{}).empty());
+}
+
+TEST(Parallel, ErrorPropagatesAndPoolIsReusable) {
+  luabind::StatePool pool(4, loadTransforms);
+  std::vector<int> input(1000);
+  std::iota(input.begin(), input.end(), 0);
+  ASSERT_THROW(pool.map<int>("fail", input, 10), luabind::RuntimeError);
+  auto output = pool.map<int>("square", input, 10);
+  ASSERT_EQ(output[999], 999*999);
+}
+
+TEST(Parallel, InitializerErrorPropagates) {
+  auto willThrow = []() {
+    luabind::StatePool pool(2, [](luabind::Lua &aLua) { aLua << "foo("; });
+  };
+  ASSERT_THROW(willThrow(), luabind::SyntaxError);
+}
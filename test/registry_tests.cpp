@@ -0,0 +1,93 @@
+#include "luabind/registry.hpp"
+#include "luabind/globals.hpp"
+#include "gtest/gtest.h"
+
+#include <string>
+
+static double scale(double aValue) {
+  return aValue*2;
+}
+
+TEST(Registry, InstallsOnFirstUse) {
+  int calls = 0;
+  luabind::BindingRegistry registry;
+  registry.add("scale", &scale)
+      .add("greet", [](std::string aName) { return "hello " + aName; })
+      .add("counter.bump", [&calls]() { return ++calls; })
+      .add("counter.deep.zero", []() { return 0; })
+      .addCFunction("raw", [](lua_State *aState) {
+        lua_pushinteger(aState, lua_gettop(aState));
+        return 1;
+      });
+  ASSERT_EQ(registry.size(), 5u);
+
+  luabind::Lua lua;
+  registry.install(lua);
+  lua << R"(
+        assert(rawget(_G, "scale") == nil)
+        assert(scale(2) == 4 and rawget(_G, "scale") == scale)
+        assert(greet("lua") == "hello lua")
+        assert(counter.bump() == 1 and counter.bump() == 2 and counter.deep.zero() == 0)
+        assert(rawget(counter, "bump") ~= nil and counter.missing == nil)
+        assert(raw(1, 2, 3) == 3)
+        assert(unknown == nil)
+        scale = function() return "replaced" end
+        assert(scale() == "replaced")
+    )";
+  ASSERT_EQ(calls, 2);
+
+  // A second state gets its own copies, without touching the first
+  luabind::Lua other;
+  registry.install(other);
+  ASSERT_EQ(other["scale"](5).as<double>(), 10);
+  ASSERT_EQ(lua["scale"]().as<std::string>(), "replaced");
+}
+
+TEST(Registry, ChainsWithOtherIndexes) {
+  luabind::BindingRegistry registry;
+  registry.add("twice", [](int aValue) { return aValue*2; });
+  luabind::Lua lua;
+  lua << R"(setmetatable(_G, { __index = function(_, name) return "fallback " .. name end }))";
+  double threshold = 0.5;
+  luabind::bindVariable(lua, "threshold", &threshold);
+  registry.install(lua);
+  lua << R"(
+        assert(twice(3) == 6)
+        assert(threshold == 0.5)
+        assert(other == "fallback other")
+    )";
+}
+
+TEST(Registry, RejectsConflictingNames) {
+  luabind::BindingRegistry registry;
+  registry.add("geo.distance", &scale);
+  ASSERT_THROW(registry.add("geo", &scale), luabind::RuntimeError);
+  registry.add("area", &scale);
+  ASSERT_THROW(registry.add("area.sum", &scale), luabind::RuntimeError);
+  ASSERT_THROW(registry.add("area", [](int aValue) { return aValue; }), luabind::RuntimeError);
+  ASSERT_THROW(registry.add("geo.distance", &scale), luabind::RuntimeError);
+  ASSERT_EQ(registry.size(), 2u);
+}
+
+TEST(Registry, RemovedNamesStayRemoved) {
+  luabind::BindingRegistry registry;
+  registry.add("twice", [](int aValue) { return aValue*2; })
+      .add("unused", [](int aValue) { return aValue; })
+      .add("tools.clamp", [](int aValue) { return aValue < 0 ? 0 : aValue; });
+  luabind::Lua lua;
+  registry.install(lua);
+  lua << R"(
+        assert(twice(2) == 4)
+        twice = nil
+        assert(twice == nil and type(twice) == "nil")
+        unused = nil                -- never read before being removed
+        assert(unused == nil)
+        assert(tools.clamp(-1) == 0)
+        tools.clamp = nil
+        assert(tools.clamp == nil)
+        tools = nil
+        assert(tools == nil)
+        unused = "mine"
+        assert(unused == "mine")
+    )";
+}
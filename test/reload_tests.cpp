@@ -0,0 +1,139 @@
+#include "luabind/memoize.hpp"
+#include "luabind/reload.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+/*
+ * Replaces the file the way editors and deployment tools do: write elsewhere, then rename
+ */
+void writeScript(std::string const &aPath, std::string const &aContents) {
+  std::ofstream(aPath + ".tmp") << aContents;
+  std::filesystem::rename(aPath + ".tmp", aPath);
+}
+
+const char *const VERSION_ONE = R"(
+    local state = { calls = 0 }
+    settings = { greeting = "hello" }
+    function greet(name)
+        state.calls = state.calls + 1
+        return settings.greeting .. " " .. name
+    end
+    function callCount() return state.calls end
+)";
+
+const char *const VERSION_TWO = R"(
+    local state = { calls = 0 }
+    settings = { greeting = "replaced" }
+    function greet(name)
+        state.calls = state.calls + 1
+        return "v2 " .. settings.greeting .. " " .. name
+    end
+    function callCount() return state.calls end
+    function added() return true end
+)";
+}
+
+TEST(Reload, SwapsFunctionsAndKeepsState) {
+  auto path = testing::TempDir() + "luabind_reload_swap.lua";
+  writeScript(path, VERSION_ONE);
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+  lua << "pinned = greet; greet('a'); greet('b')";
+  ASSERT_EQ(reloader.reloadChanged(), 0);
+
+  writeScript(path, VERSION_TWO);
+  ASSERT_EQ(reloader.reloadChanged(), 1);
+  std::string greeting = lua["greet"]("c");
+  ASSERT_EQ(greeting, "v2 hello c"); // settings already existed, so it was kept
+  ASSERT_EQ(static_cast<int>(lua["callCount"]()), 3); // the local state table carried over
+  lua << "assert(added()); assert(pinned('d') == 'hello d')";
+
+  auto const &stats = reloader.stats();
+  ASSERT_EQ(stats.fReloads, 1);
+  ASSERT_EQ(stats.fFunctionsReplaced, 3);
+  ASSERT_GT(stats.fLastLatency.count(), 0);
+  ASSERT_EQ(stats.fMaxLatency, stats.fLastLatency);
+  std::remove(path.c_str());
+}
+
+TEST(Reload, EditedLocalsTakeEffect) {
+  auto path = testing::TempDir() + "luabind_reload_locals.lua";
+  writeScript(path, "local LIMIT = 10; local function helper(x) return x + 1 end; function rule(x) return helper(x) + LIMIT end");
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+  ASSERT_EQ(static_cast<int>(lua["rule"](1)), 12);
+
+  writeScript(path, "local LIMIT = 100; local function helper(x) return x + 1000 end; function rule(x) return helper(x) + LIMIT end");
+  ASSERT_EQ(reloader.reloadChanged(), 1);
+  ASSERT_EQ(static_cast<int>(lua["rule"](1)), 1101);
+  std::remove(path.c_str());
+}
+
+TEST(Reload, MemoizedFunctionsSeeReloads) {
+  auto path = testing::TempDir() + "luabind_reload_memoized.lua";
+  writeScript(path, "function classify(x) return 'v1' end");
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+  luabind::Memoized<std::string(int)> classify(lua, "classify");
+  ASSERT_EQ(classify(1), "v1");
+
+  writeScript(path, "function classify(x) return 'v2' end");
+  ASSERT_EQ(reloader.reloadChanged(), 1);
+  ASSERT_EQ(classify(1), "v2");
+  ASSERT_EQ(classify.stats().fInvalidations, 1);
+  std::remove(path.c_str());
+}
+
+TEST(Reload, FilesRewrittenInPlace) {
+  auto path = testing::TempDir() + "luabind_reload_in_place.lua";
+  std::ofstream(path) << "function version() return 1 end";
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+  std::ofstream(path, std::ios::trunc) << "function version() return 2 end";
+  ASSERT_EQ(reloader.reloadChanged(), 1);
+  ASSERT_EQ(static_cast<int>(lua["version"]()), 2);
+  std::remove(path.c_str());
+}
+
+TEST(Reload, UnchangedContentsAreSkipped) {
+  auto path = testing::TempDir() + "luabind_reload_unchanged.lua";
+  writeScript(path, VERSION_ONE);
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+  writeScript(path, VERSION_ONE);
+  ASSERT_EQ(reloader.reloadChanged(), 0);
+  ASSERT_EQ(reloader.stats().fReloads, 0);
+  std::remove(path.c_str());
+}
+
+TEST(Reload, FailedReloadKeepsPreviousVersion) {
+  auto path = testing::TempDir() + "luabind_reload_failure.lua";
+  writeScript(path, VERSION_ONE);
+  luabind::Lua lua;
+  luabind::ScriptReloader reloader(lua);
+  reloader.watch(path);
+
+  writeScript(path, "function greet() return 'broken' end\nerror('deploy failed')");
+  ASSERT_EQ(reloader.reloadChanged(), 0);
+  writeScript(path, "function greet( return end");
+  ASSERT_EQ(reloader.reloadChanged(), 0);
+  ASSERT_EQ(reloader.stats().fFailures, 2);
+  ASSERT_NE(reloader.stats().fLastError.find("luabind_reload_failure.lua:1:"), std::string::npos);
+  std::string greeting = lua["greet"]("e");
+  ASSERT_EQ(greeting, "hello e");
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+
+  std::remove(path.c_str());
+  ASSERT_THROW(reloader.watch(path), luabind::FileError);
+  ASSERT_THROW(luabind::ScriptReloader(lua).watch(path), luabind::FileError);
+}
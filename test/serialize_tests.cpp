@@ -0,0 +1,103 @@
+#include "luabind/serialize.hpp"
+#include "gtest/gtest.h"
+
+#include <limits>
+
+TEST(Serialize, Scalars) {
+  luabind::Lua source;
+  luabind::Lua destination;
+  source << R"(
+        values = { 0, -1, math.maxinteger, math.mininteger, 0.25, -1e300, "", "with\0nul", true, false }
+    )";
+  luabind::ValueBuffer buffer;
+  lua_getglobal(source.state(), "values");
+  int count = static_cast<int>(lua_rawlen(source.state(), -1));
+  for (int i = 1; i <= count; ++i) {
+    lua_rawgeti(source.state(), -1, i);
+    buffer.write(source.state(), -1);
+    lua_pop(source.state(), 1);
+  }
+  lua_pushnil(source.state());
+  buffer.write(source.state(), -1);
+  lua_pop(source.state(), 2);
+
+  lua_State *state = destination.state();
+  lua_createtable(state, count, 0);
+  for (int i = 1; i <= count; ++i) {
+    buffer.read(state);
+    lua_rawseti(state, -2, i);
+  }
+  lua_setglobal(state, "values");
+  buffer.read(state);
+  ASSERT_TRUE(lua_isnil(state, -1));
+  lua_pop(state, 1);
+  ASSERT_TRUE(buffer.atEnd());
+  destination << R"(
+        assert(values[1] == 0 and math.type(values[1]) == "integer")
+        assert(values[2] == -1)
+        assert(values[3] == math.maxinteger and values[4] == math.mininteger)
+        assert(values[5] == 0.25 and math.type(values[5]) == "float")
+        assert(values[6] == -1e300)
+        assert(values[7] == "" and values[8] == "with\0nul" and #values[8] == 8)
+        assert(values[9] == true and values[10] == false)
+    )";
+}
+
+TEST(Serialize, Tables) {
+  luabind::Lua source;
+  luabind::Lua destination;
+  source << R"(
+        record = { name = "x", list = { 1, 2, 3 }, [true] = "yes", [1.5] = "float key", nested = { deep = { "z" } } }
+        record.self = record
+        record.alias = record.list
+    )";
+  luabind::ValueBuffer buffer;
+  buffer.writeGlobal(source, "record");
+  buffer.readGlobal(destination, "record");
+  ASSERT_EQ(lua_gettop(source.state()), 0);
+  ASSERT_EQ(lua_gettop(destination.state()), 0);
+  destination << R"(
+        assert(record.name == "x" and #record.list == 3 and record.list[3] == 3)
+        assert(record[true] == "yes" and record[1.5] == "float key")
+        assert(record.nested.deep[1] == "z")
+        assert(record.self == record and record.alias == record.list)
+    )";
+}
+
+TEST(Serialize, ReuseAndTransfer) {
+  luabind::Lua source;
+  luabind::Lua destination;
+  luabind::ValueBuffer buffer;
+  for (int i = 0; i < 3; ++i) {
+    buffer.clear();
+    source["value"] = std::vector<int>{i, i + 1};
+    buffer.writeGlobal(source, "value");
+    // As if received through a pipe
+    luabind::ValueBuffer received(std::string{buffer.bytes()});
+    received.readGlobal(destination, "value");
+    std::vector<int> value = destination["value"];
+    ASSERT_EQ(value, (std::vector<int>{i, i + 1}));
+  }
+}
+
+TEST(Serialize, Errors) {
+  luabind::Lua lua;
+  luabind::ValueBuffer buffer;
+  lua << "ok = 1; bad = { 1, print }; deep = {}; local t = deep; for i = 1, 1000 do t.next = {}; t = t.next end";
+  buffer.writeGlobal(lua, "ok");
+  auto size = buffer.bytes().size();
+  ASSERT_THROW(buffer.writeGlobal(lua, "bad"), luabind::RuntimeError);
+  ASSERT_THROW(buffer.writeGlobal(lua, "deep"), luabind::RuntimeError);
+  ASSERT_EQ(buffer.bytes().size(), size);
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+
+  buffer.read(lua.state());
+  ASSERT_EQ(lua_tointeger(lua.state(), -1), 1);
+  lua_pop(lua.state(), 1);
+  ASSERT_THROW(buffer.read(lua.state()), luabind::RuntimeError);
+
+  std::string truncated{"\x06\x02\x00\x03\x02", 5};
+  luabind::ValueBuffer corrupt(truncated);
+  ASSERT_THROW(corrupt.read(lua.state()), luabind::RuntimeError);
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+}
@@ -0,0 +1,116 @@
+#include "luabind/snapshot.hpp"
+#include "gtest/gtest.h"
+
+static int add(int a, int b) {
+  return a + b;
+}
+
+TEST(Snapshot, DataRoundTrip) {
+  luabind::Lua lua;
+  lua << R"(
+        count = 42
+        ratio = 0.5
+        negative = -7
+        name = "luabind"
+        flag = true
+        config = { limits = { 1, 2, 3 }, nested = { deep = { value = "x" } } }
+        config.self = config
+        shared = config.limits
+        setmetatable(config, { __index = function(t, k) return "default" end })
+    )";
+  auto clone = luabind::Snapshot::capture(lua).clone();
+  clone << R"(
+        assert(count == 42 and math.type(count) == "integer")
+        assert(ratio == 0.5 and math.type(ratio) == "float")
+        assert(negative == -7)
+        assert(name == "luabind" and flag == true)
+        assert(config.limits[3] == 3 and config.nested.deep.value == "x")
+        assert(config.self == config)
+        assert(shared == config.limits)
+        assert(config.missing == "default")
+    )";
+}
+
+TEST(Snapshot, Functions) {
+  luabind::Lua lua;
+  lua << R"(
+        local counter = 0
+        function increment() counter = counter + 1; return counter end
+        function current() return counter end
+        function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+        local function localFactorial(n) if n <= 1 then return 1 end return n * localFactorial(n - 1) end
+        factorial = localFactorial
+        increment()
+    )";
+  auto clone = luabind::Snapshot::capture(lua).clone();
+  int fib = clone["fib"](10);
+  ASSERT_EQ(fib, 55);
+  int factorial = clone["factorial"](5);
+  ASSERT_EQ(factorial, 120);
+  // increment and current still share one counter, which kept its value
+  int incremented = clone["increment"]();
+  int current = clone["current"]();
+  ASSERT_EQ(incremented, 2);
+  ASSERT_EQ(current, 2);
+  // and the original is unaffected
+  int original = lua["current"]();
+  ASSERT_EQ(original, 1);
+}
+
+TEST(Snapshot, StandardLibrary) {
+  luabind::Lua lua;
+  lua << R"(
+        function string.shout(s) return s:upper() .. "!" end
+        printer = print
+        math.answer = 42
+        table.insert = nil
+    )";
+  auto clone = luabind::Snapshot::capture(lua).clone();
+  clone << R"(
+        assert(("hi"):shout() == "HI!")
+        assert(printer == print)
+        assert(math.answer == 42 and math.floor(1.5) == 1)
+        assert(package.loaded.string == string)
+        assert(io.write ~= nil)
+    )";
+}
+
+TEST(Snapshot, Bindings) {
+  luabind::SnapshotBindings bindings;
+  bindings.add("add", &add);
+
+  luabind::Lua lua;
+  bindings.installGlobals(lua);
+  lua << "function addThree(x) return add(x, 3) end";
+  auto snapshot = luabind::Snapshot::capture(lua, bindings);
+  auto clone = snapshot.clone(bindings);
+  int sum = clone["addThree"](4);
+  ASSERT_EQ(sum, 7);
+
+  ASSERT_THROW(snapshot.clone(), luabind::RuntimeError);
+  ASSERT_THROW(luabind::Snapshot::capture(lua), luabind::RuntimeError);
+
+  // A callable assigned directly is a different lua_CFunction from the registered one
+  lua["sub"] = [](int a, int b) { return a - b; };
+  ASSERT_THROW(luabind::Snapshot::capture(lua, bindings), luabind::RuntimeError);
+}
+
+TEST(Snapshot, SerializedData) {
+  luabind::Lua lua;
+  lua << "greeting = 'hello'; function greet(n) return greeting .. ' ' .. n end";
+  std::string data = luabind::Snapshot::capture(lua).data();
+
+  auto clone = luabind::Snapshot(data).clone();
+  std::string greeting = clone["greet"]("world");
+  ASSERT_EQ(greeting, "hello world");
+
+  ASSERT_THROW(luabind::Snapshot("nonsense").clone(), luabind::RuntimeError);
+  ASSERT_THROW(luabind::Snapshot(data.substr(0, data.size()/2)).clone(), luabind::RuntimeError);
+}
+
+TEST(Snapshot, UnsupportedValues) {
+  luabind::Lua lua;
+  lua << "co = coroutine.create(function() end)";
+  ASSERT_THROW(luabind::Snapshot::capture(lua), luabind::RuntimeError);
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+}
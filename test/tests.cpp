@@ -5,6 +5,11 @@
 #include "gtest/gtest.h"
 
 #include <array>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <memory_resource>
+#include <ranges>
 
 static const char *gIdentityFunction = R"(
     identity = function(a)
@@ -412,6 +417,793 @@ TEST(LuaBind, StackManagement) {
   ASSERT_EQ(lua_gettop(l), 0);
 }
 
+TEST(LuaBind, ArgumentOrder) {
+  luabind::Lua lua;
+  lua["subtract"] = [](int a, int b) { return a - b; };
+  lua["describe"] = [](int a, std::string b) { return std::to_string(a) + b; };
+  ASSERT_EQ((int)lua["subtract"](10, 3), 7);
+  std::string description = lua["describe"](1, std::string("x"));
+  ASSERT_EQ(description, "1x");
+}
+
+int moduleSubtract(int a, int b) {
+  return a - b;
+}
+
+TEST(LuaBind, Module) {
+  using namespace luabind::meta::literals;
+  using TestModule = luabind::module<"testmodule"_f,
+                                     luabind::def<"greet"_f, []() { return "hello"; }>,
+                                     luabind::def<"subtract"_f, &moduleSubtract>>;
+  auto l = luaL_newstate();
+  auto closeState = luabind::detail::makeScopeGuard([l]() { lua_close(l); });
+  luaL_requiref(l, "testmodule", &TestModule::open, 1);
+  lua_pop(l, 1);
+  luabind::Lua lua(l);
+  lua << R"(
+        greeting = testmodule.greet()
+        difference = testmodule.subtract(5, 2)
+    )";
+  ASSERT_EQ((std::string)lua["greeting"], "hello");
+  ASSERT_EQ((int)lua["difference"], 3);
+}
+
+TEST(LuaBind, StatelessCallableSharesFunction) {
+  auto timesTwo = [](int x) { return x*2; };
+  int offset = 1;
+  auto plusOffset = [&offset](int x) { return x + offset; };
+
+  // Stateless callables don't need per-call-site storage, so every adapt() of the same type agrees
+  ASSERT_EQ(luabind::adapt(timesTwo), luabind::adapt(timesTwo));
+  ASSERT_NE(luabind::adapt(plusOffset), luabind::adapt(plusOffset));
+
+  luabind::Lua lua;
+  lua["timesTwo"] = timesTwo;
+  lua["plusOffset"] = plusOffset;
+  ASSERT_EQ((int)lua["timesTwo"](4), 8);
+  ASSERT_EQ((int)lua["plusOffset"](4), 5);
+}
+
+TEST(LuaBind, AdaptCompileTimeFunction) {
+  auto l = luaL_newstate();
+  auto closeState = luabind::detail::makeScopeGuard([l]() { lua_close(l); });
+  lua_register(l, "add", luabind::adapt<&add>());
+  lua_register(l, "negate", luabind::adapt<[](int x) { return -x; }>());
+  luabind::Lua lua(l);
+  ASSERT_EQ((int)lua["add"](2, 3), 5);
+  ASSERT_EQ((int)lua["negate"](2), -2);
+}
+
+TEST(LuaBind, Overload) {
+  luabind::Lua lua;
+  lua["describe"] = luabind::overload(
+      [](double) { return std::string("number"); },
+      [](std::string aString) { return "string " + aString; },
+      [](std::vector<int> aSequence) { return "table of " + std::to_string(aSequence.size()); },
+      [](double a, double b) { return "sum " + std::to_string(static_cast<int>(a + b)); });
+  lua << R"(
+        n = describe(1)
+        s = describe("x")
+        t = describe({1, 2, 3})
+        two = describe(1, 2)
+    )";
+  ASSERT_EQ((std::string)lua["n"], "number");
+  ASSERT_EQ((std::string)lua["s"], "string x");
+  ASSERT_EQ((std::string)lua["t"], "table of 3");
+  ASSERT_EQ((std::string)lua["two"], "sum 3");
+}
+
+TEST(LuaBind, OverloadNoMatch) {
+  luabind::Lua lua;
+  int captured = 0;
+  lua["setValue"] = luabind::overload([&captured](int aValue) { captured = aValue; },
+                                      [&captured](bool aFlag) { captured = aFlag ? -1 : -2; });
+  lua << "setValue(false)";
+  ASSERT_EQ(captured, -2);
+  try {
+    lua << R"(setValue("thing"))";
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    ASSERT_NE(std::string(e.what()).find("No overload accepts argument types (string)"), std::string::npos);
+  }
+  ASSERT_THROW(lua << "setValue(1, 2)", luabind::RuntimeError);
+  lua << "setValue(7)";
+  ASSERT_EQ(captured, 7);
+}
+
+TEST(LuaBind, BadArgumentIsCatchableInLua) {
+  luabind::Lua lua;
+  lua["timesTwo"] = [](int x) { return x*2; };
+  lua << R"(
+        ok, message = pcall(timesTwo, {})
+        okNested, nestedMessage = pcall(function() return timesTwo("thing") end)
+    )";
+  ASSERT_FALSE((bool)lua["ok"]);
+  ASSERT_EQ((std::string)lua["message"], "Incorrect type: Runtime type cannot be converted to an arithmetic type");
+  ASSERT_FALSE((bool)lua["okNested"]);
+  ASSERT_EQ((int)lua["timesTwo"](2), 4);
+}
+
+TEST(LuaBind, CallbackExceptionRunsDestructors) {
+  luabind::Lua lua;
+  int destroyed = 0;
+  struct Tracker {
+    int &fDestroyed;
+
+    ~Tracker() { ++fDestroyed; }
+  };
+  lua["explode"] = [&destroyed](std::vector<std::string>) {
+    Tracker tracker{destroyed};
+    throw std::runtime_error("boom");
+  };
+  lua << R"(
+        ok, message = pcall(explode, {"a", "b"})
+    )";
+  ASSERT_EQ(destroyed, 1);
+  ASSERT_FALSE((bool)lua["ok"]);
+  ASSERT_EQ((std::string)lua["message"], "boom");
+}
+
+TEST(LuaBind, NestedArgumentTypeMismatch) {
+  luabind::Lua lua;
+  lua["sum"] = [](std::vector<std::tuple<int, int>> aPairs) {
+    int total = 0;
+    for (auto [a, b] : aPairs) {
+      total += a + b;
+    }
+    return total;
+  };
+  ASSERT_EQ((int)lua["sum"](std::vector<std::tuple<int, int>>{{1, 2}, {3, 4}}), 10);
+  lua << R"(
+        ok = pcall(sum, {{1, 2}, {3, "four"}})
+    )";
+  ASSERT_FALSE((bool)lua["ok"]);
+}
+
+TEST(LuaBind, ReferenceParameters) {
+  luabind::Lua lua;
+  lua["length"] = [](std::string const &aString) { return aString.size(); };
+  ASSERT_EQ((int)lua["length"](std::string("four")), 4);
+}
+
+TEST(LuaBind, NumericString) {
+  luabind::Lua lua;
+  lua << gIdentityFunction;
+  std::string x = lua["identity"](std::string("3"));
+  ASSERT_EQ(x, "3");
+}
+
+static const char *gNestedErrorScript = R"(
+    inner = function()
+        error("deep failure")
+    end
+    outer = function()
+        inner()
+    end
+)";
+
+TEST(LuaBind, ErrorHandlerNone) {
+  luabind::Lua lua;
+  lua << gNestedErrorScript;
+  try {
+    lua << "outer()";
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    ASSERT_TRUE(e.frames().empty());
+    ASSERT_EQ(std::string(e.what()).find("stack traceback"), std::string::npos);
+  }
+}
+
+TEST(LuaBind, ErrorHandlerFrames) {
+  auto l = luaL_newstate();
+  auto closeState = luabind::detail::makeScopeGuard([l]() { lua_close(l); });
+  luaL_openlibs(l);
+  luabind::Lua lua(l);
+  lua.setErrorHandlerMode(luabind::ErrorHandlerMode::FRAMES);
+  lua << gNestedErrorScript;
+  try {
+    lua << "outer()";
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    auto const &frames = e.frames();
+    auto hasFunction = [&](std::string const &aName) {
+      return std::any_of(frames.begin(), frames.end(), [&](auto const &aFrame) { return aFrame.fFunction==aName; });
+    };
+    ASSERT_TRUE(hasFunction("inner"));
+    ASSERT_TRUE(hasFunction("outer"));
+    auto inner = std::find_if(frames.begin(), frames.end(), [](auto const &aFrame) { return aFrame.fFunction=="inner"; });
+    ASSERT_EQ(inner->fLine, 3);
+    ASSERT_NE(e.traceback().find("in function 'inner'"), std::string::npos);
+  }
+  ASSERT_EQ(lua_gettop(l), 0);
+}
+
+TEST(LuaBind, ErrorHandlerTraceback) {
+  luabind::Lua lua;
+  lua.setErrorHandlerMode(luabind::ErrorHandlerMode::TRACEBACK);
+  lua << gNestedErrorScript;
+  try {
+    lua << "outer()";
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    std::string message = e.what();
+    ASSERT_NE(message.find("deep failure"), std::string::npos);
+    ASSERT_NE(message.find("stack traceback"), std::string::npos);
+    ASSERT_NE(message.find("inner"), std::string::npos);
+  }
+  lua << "x = 1";
+  ASSERT_EQ((int)lua["x"], 1);
+}
+
+TEST(LuaBind, GcModes) {
+  luabind::Lua lua;
+  ASSERT_EQ(lua.setGenerationalGc(), luabind::GcMode::INCREMENTAL);
+  ASSERT_EQ(lua.setIncrementalGc({.fPause = 150, .fStepMultiplier = 200}), luabind::GcMode::GENERATIONAL);
+  ASSERT_EQ(lua.setIncrementalGc(), luabind::GcMode::INCREMENTAL);
+}
+
+TEST(LuaBind, GcStopGuard) {
+  luabind::Lua lua;
+  ASSERT_TRUE(lua.isGcRunning());
+  {
+    auto guard = lua.stopGcInScope();
+    ASSERT_FALSE(lua.isGcRunning());
+    {
+      auto nested = lua.stopGcInScope();
+    }
+    // The nested guard found the collector stopped, so it must not restart it
+    ASSERT_FALSE(lua.isGcRunning());
+  }
+  ASSERT_TRUE(lua.isGcRunning());
+}
+
+TEST(LuaBind, GcExplicitSteps) {
+  luabind::Lua lua;
+  lua.stopGc();
+  lua << R"(
+        garbage = {}
+        for i = 1, 10000 do garbage[i] = {i} end
+        garbage = nil
+    )";
+  auto before = lua.memoryInUse();
+  bool finished = false;
+  for (int i = 0; i < 10000 && !finished; ++i) {
+    finished = lua.stepGc(64);
+  }
+  ASSERT_TRUE(finished);
+  ASSERT_LT(lua.memoryInUse(), before);
+  ASSERT_FALSE(lua.isGcRunning());
+  lua.restartGc();
+}
+
+TEST(LuaBind, EnvironmentIsolation) {
+  luabind::Lua lua;
+  lua << R"(
+        greeting = "hello"
+        function greet(name) return greeting .. " " .. name end
+    )";
+  auto first = lua.newEnvironment();
+  auto second = lua.newEnvironment();
+  first["name"] = std::string("first");
+  second["name"] = std::string("second");
+  first << "reply = greet(name); greeting = 'shadowed'";
+  second << "reply = greet(name); _G.leaked = true";
+
+  std::string firstReply = first["reply"];
+  std::string secondReply = second["reply"];
+  ASSERT_EQ(firstReply, "hello first");
+  ASSERT_EQ(secondReply, "hello second");
+  std::string shadowed = first["greeting"];
+  std::string base = lua["greeting"];
+  ASSERT_EQ(shadowed, "shadowed");
+  ASSERT_EQ(base, "hello");
+  bool leaked = second["leaked"];
+  ASSERT_TRUE(leaked);
+  lua << "assert(leaked == nil and reply == nil and name == nil)";
+}
+
+TEST(LuaBind, EnvironmentFrozenBase) {
+  luabind::Lua lua;
+  lua << "settings = { limit = 10, tags = { 'a', 'b' } }";
+  auto first = lua.newEnvironment();
+  auto second = lua.newEnvironment();
+  first << R"(
+        assert(not pcall(function() string.format = nil end))
+        assert(not pcall(function() math.x = 1 end))
+        assert(not pcall(function() settings.tags[1] = 'z' end))
+        assert(getmetatable(string) == false and not pcall(setmetatable, string, nil))
+        rawset(string, 'upper', 'only in this environment')
+        assert(#settings.tags == 2 and settings.tags[2] == 'b')
+        local keys = 0
+        for key, value in pairs(settings) do keys = keys + 1 end
+        for i, tag in ipairs(settings.tags) do keys = keys + 1 end
+        assert(keys == 4)
+    )";
+  second << R"(
+        assert(string.format('%d', 7) == '7' and string.upper('x') == 'X')
+        assert(math.x == nil and settings.limit == 10 and settings.tags[1] == 'a')
+    )";
+  lua << "assert(type(string.upper) == 'function' and math.x == nil)";
+  // The base stays writable for the host, and environments see its changes
+  lua << "settings.limit = 20";
+  second << "assert(settings.limit == 20)";
+}
+
+TEST(LuaBind, EnvironmentSeesReplacedTables) {
+  luabind::Lua lua;
+  lua << "config = { mode = 'old', nested = { level = 1 } }";
+  auto env = lua.newEnvironment();
+  env << "assert(config.mode == 'old' and config.nested.level == 1); held = config";
+  lua << "config = { mode = 'new', nested = { level = 1 } }";
+  env << "assert(config.mode == 'new' and held.mode == 'old')";
+  lua << "config.nested = { level = 2 }";
+  env << "assert(config.nested.level == 2)";
+  env << "local a, b = config, config; assert(rawequal(a, b))";
+}
+
+TEST(LuaBind, EnvironmentCompiledChunk) {
+  luabind::Lua lua;
+  lua << "function double(x) return x * 2 end";
+  auto chunk = lua.compile("result = double(input)");
+  for (int i = 0; i < 3; ++i) {
+    auto env = lua.newEnvironment();
+    env["input"] = i;
+    env.run(chunk);
+    int result = env["result"];
+    ASSERT_EQ(result, i*2);
+  }
+  lua["input"] = 21;
+  lua.run(chunk);
+  int result = lua["result"];
+  ASSERT_EQ(result, 42);
+}
+
+TEST(LuaBind, EnvironmentFunctions) {
+  luabind::Lua lua;
+  lua << "base = 1";
+  auto env = lua.newEnvironment();
+  env << "base = 10; function add(x) return base + x end";
+  int added = env["add"](5);
+  ASSERT_EQ(added, 15);
+  env["twice"] = [](int x) { return x*2; };
+  int twice = env["twice"](4);
+  ASSERT_EQ(twice, 8);
+  ASSERT_THROW(lua["add"](1).operator int(), luabind::RuntimeError);
+  ASSERT_THROW(env << "error('boom')", luabind::RuntimeError);
+  ASSERT_THROW(lua.compile("this is not lua"), luabind::SyntaxError);
+}
+
+TEST(LuaBind, ErrorMessageNamesChunk) {
+  luabind::Lua lua;
+  try {
+    lua << "local x = 1\nerror('boom')";
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    ASSERT_EQ(std::string(e.what()), "Lua runtime error: [string \"local x = 1...\"]:2: boom");
+  }
+}
+
+TEST(LuaBind, RunFile) {
+  auto path = testing::TempDir() + "luabind_run_file.lua";
+  std::string script = "values = {}\n";
+  // Long enough to be handed to the parser in several pieces, with a string split across them
+  for (int i = 1; i <= 5000; ++i) {
+    script += "values[" + std::to_string(i) + "] = '" + std::string(20, 'a' + i%26) + "'\n";
+  }
+  script += "count = #values\nerror('boom')\n";
+  std::ofstream(path) << script;
+
+  luabind::Lua lua;
+  try {
+    lua.runFile(path);
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    ASSERT_EQ(std::string(e.what()), "Lua runtime error: " + path + ":5003: boom");
+  }
+  ASSERT_EQ(static_cast<int>(lua["count"]), 5000);
+  std::remove(path.c_str());
+  ASSERT_THROW(lua.runFile(path), luabind::FileError);
+}
+
+TEST(LuaBind, LoadFile) {
+  auto path = testing::TempDir() + "luabind_load_file.lua";
+  std::ofstream(path) << "result = base + 1";
+  luabind::Lua lua;
+  auto chunk = lua.loadFile(path);
+  std::remove(path.c_str());
+
+  auto first = lua.newEnvironment();
+  auto second = lua.newEnvironment();
+  first["base"] = 1;
+  second["base"] = 10;
+  first.run(chunk);
+  second.run(chunk);
+  ASSERT_EQ(static_cast<int>(first["result"]), 2);
+  ASSERT_EQ(static_cast<int>(second["result"]), 11);
+}
+
+TEST(LuaBind, FilesWithShebangLines) {
+  auto path = testing::TempDir() + "luabind_shebang.lua";
+  std::ofstream(path) << "#!/usr/bin/env lua\nvalue = (base or 0) + 1\nif base then error('line') end\n";
+  luabind::Lua lua;
+  lua.runFile(path);
+  ASSERT_EQ(static_cast<int>(lua["value"]), 1);
+
+  auto chunk = lua.loadFile(path);
+  auto env = lua.newEnvironment();
+  env["base"] = 1;
+  try {
+    env.run(chunk);
+    FAIL();
+  } catch (luabind::RuntimeError &e) {
+    ASSERT_EQ(std::string(e.what()), "Lua runtime error: " + path + ":3: line");
+  }
+  ASSERT_EQ(static_cast<int>(env["value"]), 2);
+  std::remove(path.c_str());
+}
+
+TEST(LuaBind, PrecompiledFiles) {
+  auto path = testing::TempDir() + "luabind_precompiled.luac";
+  luabind::Lua lua;
+  lua["path"] = path;
+  lua << "local file = io.open(path, 'wb'); file:write(string.dump(load('value = 7'))); file:close()";
+  lua.runFile(path);
+  ASSERT_EQ(static_cast<int>(lua["value"]), 7);
+  try {
+    auto chunk = lua.loadFile(path);
+    FAIL();
+  } catch (luabind::FileError &e) {
+    ASSERT_NE(std::string(e.what()).find("precompiled"), std::string::npos);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(LuaBind, OptionalValues) {
+  luabind::Lua lua;
+  lua["describe"] = [](std::optional<std::string> aName) { return aName.value_or("nobody"); };
+  lua["find"] = [](int aKey) { return aKey > 0 ? std::optional<int>(aKey*2) : std::nullopt; };
+  lua << R"(
+        assert(describe("x") == "x" and describe(nil) == "nobody" and describe() == "nobody")
+        assert(not pcall(describe, 1))
+        assert(find(2) == 4 and find(-2) == nil)
+        function maybe(x) if x > 0 then return x end end
+    )";
+  ASSERT_EQ(lua["maybe"](3).as<std::optional<int>>(), 3);
+  ASSERT_FALSE(lua["maybe"](-3).as<std::optional<int>>().has_value());
+  ASSERT_FALSE(lua["missing"].as<std::optional<std::string>>().has_value());
+  ASSERT_THROW(lua["maybe"].as<std::optional<int>>(), luabind::IncorrectType);
+}
+
+TEST(LuaBind, VariantValues) {
+  luabind::Lua lua;
+  using Value = std::variant<std::monostate, bool, double, std::string, std::vector<int>>;
+  lua["kind"] = [](Value const &aValue) { return aValue.index(); };
+  lua["echo"] = [](Value aValue) { return aValue; };
+  lua << R"(
+        assert(kind(nil) == 0 and kind(true) == 1 and kind(2) == 2 and kind("s") == 3 and kind({1}) == 4)
+        assert(not pcall(kind, print))
+        assert(echo("s") == "s" and echo(nil) == nil and echo({5})[1] == 5)
+    )";
+  lua["stored"] = Value{std::string("text")};
+  ASSERT_EQ(std::get<std::string>(lua["stored"].as<Value>()), "text");
+  lua["stored"] = nullptr;
+  ASSERT_EQ(lua["stored"].as<Value>().index(), 0);
+  ASSERT_THROW((lua["stored"].as<std::variant<bool, std::string>>()), luabind::IncorrectType);
+}
+
+TEST(LuaBind, VariantIntegerOrFloat) {
+  luabind::Lua lua;
+  using Number = std::variant<int, double>;
+  lua["number"] = 1.5;
+  auto fractional = lua["number"].as<Number>();
+  ASSERT_EQ(fractional.index(), 1);
+  ASSERT_EQ(std::get<double>(fractional), 1.5);
+  lua["number"] = 3;
+  ASSERT_EQ(std::get<int>(lua["number"].as<Number>()), 3);
+  lua["number"] = 2.0; // Exactly an integer
+  ASSERT_EQ(std::get<int>(lua["number"].as<Number>()), 2);
+  lua["number"] = 1.5;
+  ASSERT_THROW((lua["number"].as<std::variant<int, std::string>>()), luabind::IncorrectType);
+}
+
+TEST(LuaBind, InternedStrings) {
+  using namespace luabind::meta::literals;
+  luabind::Lua lua;
+  lua["status"] = [](int aCode) -> luabind::InternedString const & {
+    return aCode==0 ? luabind::interned<"ok"_f> : luabind::interned<"failed"_f>;
+  };
+  lua["key"] = luabind::intern("threshold");
+  lua << R"(
+        assert(status(0) == "ok" and status(1) == "failed" and status(0) == "ok")
+        assert(key == "threshold")
+    )";
+  ASSERT_EQ(&luabind::intern("threshold"), &luabind::intern(std::string("thresh") + "old"));
+  ASSERT_EQ(luabind::interned<"ok"_f>.view(), "ok");
+
+  // Each state caches its own copy
+  luabind::Lua other;
+  other["key"] = luabind::intern("threshold");
+  other["okay"] = luabind::interned<"ok"_f>;
+  other << "assert(key == 'threshold' and okay == 'ok')";
+}
+
+enum class Color { RED, GREEN, BLUE };
+
+enum class Flags { READ = 1, WRITE = 2, EXECUTE = 4 };
+
+template <>
+struct luabind::EnumStrings<Color> {
+  static constexpr std::array<std::pair<Color, std::string_view>, 3> fNames{{
+      {Color::RED, "red"}, {Color::GREEN, "green"}, {Color::BLUE, "blue"}}};
+};
+
+template <>
+struct luabind::EnumStrings<Flags> {
+  static constexpr std::array<std::pair<Flags, std::string_view>, 3> fNames{{
+      {Flags::READ, "read"}, {Flags::WRITE, "write"}, {Flags::EXECUTE, "execute"}}};
+};
+
+TEST(LuaBind, EnumStrings) {
+  luabind::Lua lua;
+  lua["next"] = [](Color aColor) { return static_cast<Color>((static_cast<int>(aColor) + 1)%3); };
+  lua["combine"] = [](Flags aFirst, Flags aSecond) {
+    return static_cast<Flags>(static_cast<int>(aFirst) | static_cast<int>(aSecond));
+  };
+  lua << R"(
+        assert(next("red") == "green" and next("blue") == "red")
+        assert(combine("read", "execute") == 5 and combine("write", "write") == "write")
+        assert(not pcall(next, "purple"))
+        assert(not pcall(next, true))
+    )";
+  lua["color"] = Color::BLUE;
+  ASSERT_EQ(lua["color"].as<std::string>(), "blue");
+  ASSERT_EQ(lua["color"].as<Color>(), Color::BLUE);
+  lua["flags"] = Flags::WRITE;
+  ASSERT_EQ(lua["flags"].as<Flags>(), Flags::WRITE);
+  lua << "flags = 'none'";
+  ASSERT_THROW(lua["flags"].as<Flags>(), luabind::IncorrectType);
+}
+
+TEST(LuaBind, RangesToLua) {
+  luabind::Lua lua;
+  std::list<int> list{1, 2, 3};
+  lua["list"] = list;
+  lua["squares"] = std::views::iota(1, 5) | std::views::transform([](int i) { return i*i; });
+  lua["odd"] = std::views::iota(1, 10) | std::views::filter([](int i) { return i%2==1; });
+  lua["name"] = std::string_view("view");
+  lua << R"(
+        assert(#list == 3 and list[3] == 3)
+        assert(#squares == 4 and squares[4] == 16)
+        assert(#odd == 5 and odd[5] == 9)
+        assert(name == "view")
+    )";
+}
+
+TEST(LuaBind, LazyRange) {
+  luabind::Lua lua;
+  int produced = 0;
+  lua["numbers"] = luabind::lazy(std::views::iota(1, 1000001) | std::views::transform([&produced](int i) {
+    ++produced;
+    return i;
+  }));
+  lua << R"(
+        total = 0
+        for n in numbers do
+            total = total + n
+            if n == 10 then break end
+        end
+    )";
+  ASSERT_EQ(static_cast<int>(lua["total"]), 55);
+  ASSERT_EQ(produced, 10);
+
+  // Pushing a lazy range again continues where the last iteration stopped
+  std::vector<std::string> words{"a", "b", "c"};
+  auto lazyWords = luabind::lazy(words);
+  lua["first"] = lazyWords;
+  lua["rest"] = lazyWords;
+  lua << R"(
+        assert(first() == "a")
+        local joined = ""
+        for word in rest do joined = joined .. word end
+        assert(joined == "bc" and first() == nil)
+    )";
+}
+
+TEST(LuaBind, IterateLua) {
+  luabind::Lua lua;
+  lua << R"(
+        function range(n)
+            return coroutine.wrap(function() for i = 1, n do coroutine.yield(i) end end)
+        end
+        function enumerate(...)
+            return ipairs({...})
+        end
+        function failing()
+            return function() error("generator failed") end
+        end
+    )";
+  int total = 0;
+  for (int i : lua.iterate<int>("range", 100)) {
+    total += i;
+  }
+  ASSERT_EQ(total, 5050);
+
+  std::vector<std::pair<int, std::string>> pairs;
+  for (auto [index, word] : lua.iterate<int, std::string>("enumerate", "x", "y")) {
+    pairs.emplace_back(index, word);
+  }
+  ASSERT_EQ(pairs, (std::vector<std::pair<int, std::string>>{{1, "x"}, {2, "y"}}));
+
+  auto range = lua.iterate<int>("range", 3);
+  static_assert(std::ranges::input_range<decltype(range)>);
+  ASSERT_EQ(std::ranges::distance(range.begin(), range.end()), 3);
+
+  ASSERT_THROW(lua.iterate<std::string>("range", 1).begin(), luabind::IncorrectType);
+  ASSERT_THROW(lua.iterate<int>("failing").begin(), luabind::RuntimeError);
+  ASSERT_EQ(lua_gettop(lua.state()), 0);
+}
+
+struct Order {
+  std::string item;
+  int quantity;
+  std::optional<double> discount;
+  Color color;
+};
+
+template <>
+struct luabind::StructFields<Order> {
+  static constexpr std::array<std::string_view, 4> fNames{"item", "quantity", "discount", "color"};
+};
+
+struct Vec2 {
+  double x;
+  double y;
+};
+
+struct Particle {
+  Vec2 position;
+  float mass;
+  bool active;
+};
+
+template <>
+struct luabind::StructFields<Vec2> {
+  static constexpr std::array<std::string_view, 2> fNames{"x", "y"};
+};
+
+template <>
+struct luabind::StructFields<Particle> {
+  static constexpr std::array<std::string_view, 3> fNames{"position", "mass", "active"};
+  static constexpr bool fAsUserdata = true;
+};
+
+TEST(LuaBind, StructTables) {
+  luabind::Lua lua;
+  lua["total"] = [](Order const &aOrder) { return aOrder.quantity*(1 - aOrder.discount.value_or(0)); };
+  lua["double"] = [](Order aOrder) {
+    aOrder.quantity *= 2;
+    return aOrder;
+  };
+  lua << R"(
+        assert(total({ item = "pen", quantity = 4, color = "red" }) == 4)
+        assert(total({ item = "pen", quantity = 4, discount = 0.5, color = "red" }) == 2)
+        local doubled = double({ item = "book", quantity = 3, color = "blue" })
+        assert(doubled.item == "book" and doubled.quantity == 6 and doubled.discount == nil and doubled.color == "blue")
+        assert(not pcall(total, { item = "pen", quantity = "many", color = "red" }))
+        assert(not pcall(total, "pen"))
+    )";
+  lua["order"] = Order{"lamp", 1, 0.25, Color::GREEN};
+  auto order = lua["order"].as<Order>();
+  ASSERT_EQ(order.item, "lamp");
+  ASSERT_EQ(order.discount, 0.25);
+  ASSERT_EQ(order.color, Color::GREEN);
+}
+
+TEST(LuaBind, StructUserdata) {
+  luabind::Lua lua;
+  lua["spawn"] = [](double aX) { return Particle{{aX, 0}, 1.5f, true}; };
+  lua["energy"] = [](Particle const &aParticle) { return aParticle.mass*(aParticle.position.x + aParticle.position.y); };
+  lua << R"(
+        local p = spawn(2)
+        assert(type(p) == "userdata")
+        assert(p.mass == 1.5 and p.active == true and p.position.x == 2 and p.missing == nil)
+        p.mass = 3
+        p.position = { x = 1, y = 1 }
+        assert(energy(p) == 6)
+        assert(energy({ position = { x = 1, y = 0 }, mass = 2, active = false }) == 2)
+        assert(not pcall(function() p.mass = "heavy" end))
+        assert(not pcall(function() p.speed = 1 end))
+        kept = p
+    )";
+  auto particle = lua["kept"].as<Particle>();
+  ASSERT_EQ(particle.mass, 3.0f);
+  ASSERT_EQ(particle.position.y, 1.0);
+}
+
+TEST(LuaBind, PmrContainers) {
+  luabind::Lua lua;
+  std::pmr::monotonic_buffer_resource pool;
+  std::pmr::set_default_resource(&pool);
+  auto restore = luabind::detail::makeScopeGuard([]() { std::pmr::set_default_resource(nullptr); });
+
+  lua["join"] = [](std::pmr::vector<std::pmr::string> const &aWords) {
+    std::pmr::string joined;
+    for (auto const &word : aWords) {
+      joined += word;
+    }
+    return joined;
+  };
+  ASSERT_EQ(lua["join"](std::vector<std::string>{"lu", "a", "bind"}).as<std::string>(), "luabind");
+  ASSERT_EQ(lua["join"](std::pmr::vector<std::pmr::string>{"a", "b"}).as<std::pmr::string>(), "ab");
+  lua << "letters = {'x', 'y'}";
+  auto converted = lua["letters"].as<std::pmr::vector<std::pmr::string>>();
+  ASSERT_EQ(converted[1], "y");
+  ASSERT_EQ(converted.get_allocator().resource(), &pool);
+}
+
+TEST(LuaBind, ScratchArguments) {
+  luabind::Lua lua;
+  std::vector<bool> fromArena;
+  std::vector<bool> plainFromArena;
+  lua["count"] = luabind::scratch([&](std::pmr::vector<std::pmr::string> const &aWords, std::pmr::string const &aSep) {
+    fromArena.push_back(aWords.get_allocator().resource()==luabind::scratchResource()
+                            && aSep.get_allocator().resource()==luabind::scratchResource()
+                            && luabind::scratchResource()!=std::pmr::get_default_resource());
+    return static_cast<int>(aWords.size());
+  });
+  lua["plain"] = [&](std::pmr::string const &aWord) {
+    plainFromArena.push_back(aWord.get_allocator().resource()!=std::pmr::get_default_resource());
+    return aWord;
+  };
+  lua["nested"] = luabind::scratch([&lua](std::pmr::string const &aWord) {
+    lua << "inner = count({'a', 'b', 'c'}, ',') + #plain('xyz')";
+    return std::string(aWord);
+  });
+  lua << R"(
+        assert(count({'a', 'b'}, ' ') == 2)
+        assert(nested('kept') == 'kept' and inner == 6)
+        local long = {}
+        for i = 1, 2000 do long[i] = string.rep('w', 40) end
+        for _ = 1, 3 do assert(count(long, '') == 2000) end
+        assert(not pcall(count, 'not a table', ''))
+    )";
+  ASSERT_EQ(fromArena, std::vector<bool>(5, true));
+  ASSERT_EQ(plainFromArena, std::vector<bool>{false});
+  ASSERT_EQ(luabind::scratchResource(), std::pmr::get_default_resource());
+}
+
+TEST(LuaBind, ByteBuffer) {
+  luabind::Lua lua;
+  lua["new_buffer"] = []() { return luabind::ByteBuffer(); };
+  lua << R"(
+        function render(out, n)
+          out:reserve(64)
+          for i = 1, n do out:append("<li>", i, "</li>") end
+          return out:append(" ", 0.1, " "):append_number(2 / 3, 2)
+        end
+        function make()
+          local inner = new_buffer():append("in")
+          local outer = new_buffer():append("[", inner, "]")
+          assert(#outer == 4 and tostring(outer) == "[in]")
+          assert(not pcall(outer.append, outer, {}))
+          assert(not pcall(outer.append_number, outer, 1, -1))
+          return outer
+        end
+    )";
+  luabind::ByteBuffer page;
+  auto returned = lua["render"](page, 2).as<luabind::ByteBuffer>();
+  ASSERT_EQ(page.view(), "<li>1</li><li>2</li> 0.1 0.67");
+  ASSERT_EQ(returned.span().size(), page.size());
+  ASSERT_EQ(returned.span().data(), page.span().data());
+
+  const char *storage = page.view().data();
+  std::string taken = page.take();
+  ASSERT_EQ(taken.data(), storage);
+  ASSERT_EQ(returned.size(), 0u);
+  ASSERT_EQ(lua["make"]().as<luabind::ByteBuffer>().view(), "[in]");
+  ASSERT_THROW(lua["make"]().as<std::string>(), luabind::IncorrectType);
+}
+
 int main(int aArgc, char **aArgv) {
   ::testing::InitGoogleTest(&aArgc, aArgv);
   return RUN_ALL_TESTS();
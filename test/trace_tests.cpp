@@ -0,0 +1,117 @@
+#include "luabind/trace.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace luabind::meta::literals;
+
+namespace {
+const char *const SERVICE = R"(
+    orders = 0
+    revenue = 0
+    function order(item, quantity, options)
+        orders = orders + 1
+        revenue = revenue + price(item) * quantity * (options.discount or 1)
+        return revenue
+    end
+    function refund(item)
+        if item == "unknown" then error("no such item") end
+        revenue = revenue - price(item)
+    end
+    function audit()
+        return logged("audit")
+    end
+    function describe(kind) return "entry:" .. kind end
+)";
+
+/*
+ * Sets a state up the way the recorded one was: same script, same callbacks
+ */
+void setUp(luabind::Lua &aLua, std::vector<std::string> &aLog) {
+  aLua << SERVICE;
+  aLua["price"] = [](std::string const &aItem) { return aItem=="book" ? 12.0 : 3.0; };
+  aLua["logged"] = [&aLua, &aLog](std::string const &aKind) {
+    std::string entry = aLua["describe"](aKind);
+    aLog.push_back(entry);
+    return entry;
+  };
+}
+}
+
+TEST(Trace, RecordsAndReplays) {
+  auto path = testing::TempDir() + "luabind_trace_replay.trace";
+  std::vector<std::string> recordedLog;
+  double recordedRevenue = 0;
+  {
+    luabind::Lua lua;
+    setUp(lua, recordedLog);
+    luabind::TraceRecorder recorder(lua, path);
+    for (int i = 0; i < 20; ++i) {
+      auto options = luabind::meta::table<luabind::meta::field<"discount"_f, double>>{{0.5}};
+      lua["order"](i%2 ? "book" : "pen", i, options);
+    }
+    lua["refund"]("book");
+    ASSERT_THROW(lua["refund"]("unknown").as<std::optional<double>>(), luabind::RuntimeError);
+    std::string audit = lua["audit"]();
+    ASSERT_EQ(audit, "entry:audit");
+    recordedRevenue = lua["revenue"];
+    ASSERT_EQ(recorder.recordCount(), 20*2 + 2 + 1 + 3); // order + price, refund + price, failed refund, audit chain
+  }
+
+  luabind::Lua fresh;
+  std::vector<std::string> replayedLog;
+  setUp(fresh, replayedLog);
+  auto report = luabind::replayTrace(fresh, path);
+  ASSERT_EQ(report.fReplayedCalls, 23u);
+  ASSERT_DOUBLE_EQ(static_cast<double>(fresh["revenue"]), recordedRevenue);
+  ASSERT_EQ(static_cast<int>(fresh["orders"]), 20);
+  ASSERT_EQ(replayedLog, recordedLog);
+  ASSERT_EQ(fresh.callObserver(), nullptr);
+
+  auto const *order = report.find("order");
+  ASSERT_NE(order, nullptr);
+  ASSERT_EQ(order->fRecorded.count(), 20u);
+  ASSERT_EQ(order->fReplayed.count(), 20u);
+  auto const *price = report.find("price", true);
+  ASSERT_NE(price, nullptr);
+  ASSERT_EQ(price->fRecorded.count(), 21u);
+  ASSERT_EQ(price->fReplayed.count(), 21u);
+  auto const *refund = report.find("refund");
+  ASSERT_EQ(refund->fRecordedFailures, 1u);
+  ASSERT_EQ(refund->fReplayedFailures, 1u);
+  // Nested: audit -> logged (callback) -> describe (called from C++ inside the callback)
+  ASSERT_EQ(report.find("describe")->fRecorded.count(), 1u);
+  ASSERT_EQ(report.find("describe")->fReplayed.count(), 1u);
+  ASSERT_LE(order->fReplayed.percentile(0.5), order->fReplayed.max());
+  ASSERT_NE(report.format().find("order"), std::string::npos);
+  std::remove(path.c_str());
+}
+
+TEST(Trace, UnserializableArgumentsAreRecordedAsNil) {
+  auto path = testing::TempDir() + "luabind_trace_nil.trace";
+  {
+    luabind::Lua lua;
+    lua << "function kind(value) lastKind = type(value) end";
+    luabind::TraceRecorder recorder(lua, path);
+    lua["kind"]([](int aValue) { return aValue; });
+    ASSERT_EQ(lua["lastKind"].as<std::string>(), "function");
+  }
+  luabind::Lua fresh;
+  fresh << "function kind(value) lastKind = type(value) end";
+  auto report = luabind::replayTrace(fresh, path);
+  ASSERT_EQ(report.fReplayedCalls, 1u);
+  ASSERT_EQ(fresh["lastKind"].as<std::string>(), "nil");
+  std::remove(path.c_str());
+}
+
+TEST(Trace, RejectsOtherFiles) {
+  auto path = testing::TempDir() + "luabind_trace_invalid.trace";
+  std::ofstream(path) << "not a trace";
+  luabind::Lua lua;
+  ASSERT_THROW(luabind::replayTrace(lua, path), luabind::RuntimeError);
+  ASSERT_THROW(luabind::replayTrace(lua, path + ".missing"), luabind::FileError);
+  std::remove(path.c_str());
+}